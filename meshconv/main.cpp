@@ -0,0 +1,435 @@
+//
+// meshconv input.obj output.mesh
+//
+// Converts a Wavefront OBJ into the .mesh container the triangle sample
+// memory maps (see triangle/mesh_file.h): deduplicated, quantized vertices,
+// LODs from vertex clustering and meshlets with bounds and normal cones.
+//
+#include "mesh_file.h"
+#include <algorithm>
+#include <array>
+#include <float.h>
+#include <iostream>
+#include <map>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using Float3 = std::array<float, 3>;
+
+struct Vertex {
+  Float3 position;
+  Float3 normal;
+  float uv[2];
+  // into the OBJ position list, shared by vertices that only differ in
+  // normal / uv
+  uint32_t positionIndex;
+};
+
+// meshlet limits, typical for mesh shading hardware
+static const size_t MAX_MESHLET_VERTICES = 64;
+static const size_t MAX_MESHLET_TRIANGLES = 124;
+static const uint32_t MAX_LODS = 8;
+
+static Float3 Sub(const Float3 &a, const Float3 &b) {
+  return {a[0] - b[0], a[1] - b[1], a[2] - b[2]};
+}
+static Float3 Cross(const Float3 &a, const Float3 &b) {
+  return {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2],
+          a[0] * b[1] - a[1] * b[0]};
+}
+static float Dot(const Float3 &a, const Float3 &b) {
+  return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+static float Length(const Float3 &a) { return sqrtf(Dot(a, a)); }
+static Float3 Normalize(const Float3 &a) {
+  auto length = Length(a);
+  if (length == 0) {
+    return {0, 0, 1};
+  }
+  return {a[0] / length, a[1] / length, a[2] / length};
+}
+
+// 1-based, negative counts back from the end; 0 when absent
+static int ObjIndex(const char *token, size_t count) {
+  int index = atoi(token);
+  return index < 0 ? static_cast<int>(count) + index + 1 : index;
+}
+
+static bool LoadObj(const char *path, std::vector<Vertex> *vertices,
+                    std::vector<uint32_t> *indices) {
+  auto fp = fopen(path, "rb");
+  if (!fp) {
+    std::cerr << "can not open " << path << std::endl;
+    return false;
+  }
+  std::vector<Float3> positions;
+  std::vector<Float3> normals;
+  std::vector<std::array<float, 2>> uvs;
+  std::map<std::array<int, 3>, uint32_t> unique;
+  bool hasNormals = true;
+
+  char line[1024];
+  while (fgets(line, sizeof(line), fp)) {
+    if (strncmp(line, "v ", 2) == 0) {
+      Float3 p{};
+      sscanf(line + 2, "%f %f %f", &p[0], &p[1], &p[2]);
+      positions.push_back(p);
+    } else if (strncmp(line, "vn ", 3) == 0) {
+      Float3 n{};
+      sscanf(line + 3, "%f %f %f", &n[0], &n[1], &n[2]);
+      normals.push_back(n);
+    } else if (strncmp(line, "vt ", 3) == 0) {
+      std::array<float, 2> uv{};
+      sscanf(line + 3, "%f %f", &uv[0], &uv[1]);
+      uvs.push_back(uv);
+    } else if (strncmp(line, "f ", 2) == 0) {
+      // polygons become triangle fans
+      std::vector<uint32_t> face;
+      for (auto token = strtok(line + 2, " \t\r\n"); token;
+           token = strtok(nullptr, " \t\r\n")) {
+        std::array<int, 3> key{ObjIndex(token, positions.size()), 0, 0};
+        if (auto slash = strchr(token, '/')) {
+          key[1] = ObjIndex(slash + 1, uvs.size());
+          if (auto slash2 = strchr(slash + 1, '/')) {
+            key[2] = ObjIndex(slash2 + 1, normals.size());
+          }
+        }
+        if (key[0] <= 0 || key[0] > static_cast<int>(positions.size()) ||
+            key[1] < 0 || key[1] > static_cast<int>(uvs.size()) ||
+            key[2] < 0 || key[2] > static_cast<int>(normals.size())) {
+          std::cerr << "invalid face index: " << token << std::endl;
+          fclose(fp);
+          return false;
+        }
+        hasNormals = hasNormals && key[2] > 0;
+        auto found = unique.find(key);
+        if (found == unique.end()) {
+          Vertex v{};
+          v.positionIndex = key[0] - 1;
+          v.position = positions[key[0] - 1];
+          if (key[1]) {
+            v.uv[0] = uvs[key[1] - 1][0];
+            // OBJ has v going up, Vulkan samples top down
+            v.uv[1] = 1.0f - uvs[key[1] - 1][1];
+          }
+          if (key[2]) {
+            v.normal = Normalize(normals[key[2] - 1]);
+          }
+          found = unique.insert({key, (uint32_t)vertices->size()}).first;
+          vertices->push_back(v);
+        }
+        face.push_back(found->second);
+      }
+      for (size_t i = 2; i < face.size(); ++i) {
+        indices->insert(indices->end(), {face[0], face[i - 1], face[i]});
+      }
+    }
+  }
+  fclose(fp);
+
+  if (!hasNormals) {
+    // area weighted face normals, shared by every vertex on a position
+    std::vector<Float3> accumulated(positions.size());
+    for (size_t i = 0; i < indices->size(); i += 3) {
+      auto &a = (*vertices)[(*indices)[i]];
+      auto &b = (*vertices)[(*indices)[i + 1]];
+      auto &c = (*vertices)[(*indices)[i + 2]];
+      auto n = Cross(Sub(b.position, a.position), Sub(c.position, a.position));
+      for (auto v : {&a, &b, &c}) {
+        for (int k = 0; k < 3; ++k) {
+          accumulated[v->positionIndex][k] += n[k];
+        }
+      }
+    }
+    for (auto &v : *vertices) {
+      v.normal = Normalize(accumulated[v.positionIndex]);
+    }
+  }
+  return !indices->empty();
+}
+
+static uint16_t ToHalf(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, 4);
+  uint16_t sign = (bits >> 16) & 0x8000;
+  int exponent = static_cast<int>((bits >> 23) & 0xff) - 127 + 15;
+  uint32_t mantissa = bits & 0x7fffff;
+  if (exponent <= 0) {
+    // flush denormals
+    return sign;
+  }
+  if (exponent >= 31) {
+    return sign | 0x7c00;
+  }
+  // round to nearest
+  uint32_t half = (exponent << 10) | (mantissa >> 13);
+  if (mantissa & 0x1000) {
+    ++half;
+  }
+  return sign | static_cast<uint16_t>(half);
+}
+
+static void OctEncode(const Float3 &n, int16_t out[2]) {
+  float l1 = fabsf(n[0]) + fabsf(n[1]) + fabsf(n[2]);
+  float x = n[0] / l1;
+  float y = n[1] / l1;
+  if (n[2] < 0) {
+    float wx = (1.0f - fabsf(y)) * (x >= 0 ? 1.0f : -1.0f);
+    float wy = (1.0f - fabsf(x)) * (y >= 0 ? 1.0f : -1.0f);
+    x = wx;
+    y = wy;
+  }
+  out[0] = static_cast<int16_t>(lroundf(x * 32767.0f));
+  out[1] = static_cast<int16_t>(lroundf(y * 32767.0f));
+}
+
+// collapse every vertex onto the first vertex of its grid cell and drop the
+// triangles that degenerate
+static std::vector<uint32_t> Cluster(const std::vector<Vertex> &vertices,
+                                     const std::vector<uint32_t> &indices,
+                                     const Float3 &boundsMin, float cell) {
+  std::unordered_map<uint64_t, uint32_t> cells;
+  std::vector<uint32_t> remap(vertices.size());
+  for (uint32_t i = 0; i < vertices.size(); ++i) {
+    uint64_t key = 0;
+    for (int k = 0; k < 3; ++k) {
+      auto c = static_cast<uint64_t>(
+          (vertices[i].position[k] - boundsMin[k]) / cell);
+      key = key << 21 | (c & 0x1fffff);
+    }
+    remap[i] = cells.insert({key, i}).first->second;
+  }
+  std::vector<uint32_t> result;
+  for (size_t i = 0; i < indices.size(); i += 3) {
+    auto a = remap[indices[i]];
+    auto b = remap[indices[i + 1]];
+    auto c = remap[indices[i + 2]];
+    if (a != b && b != c && c != a) {
+      result.insert(result.end(), {a, b, c});
+    }
+  }
+  return result;
+}
+
+static MeshFile::Meshlet MakeMeshlet(const std::vector<Vertex> &vertices,
+                                     const uint32_t *indices, uint32_t count) {
+  MeshFile::Meshlet meshlet{};
+  Float3 lo{FLT_MAX, FLT_MAX, FLT_MAX};
+  Float3 hi{-FLT_MAX, -FLT_MAX, -FLT_MAX};
+  for (uint32_t i = 0; i < count; ++i) {
+    auto &p = vertices[indices[i]].position;
+    for (int k = 0; k < 3; ++k) {
+      lo[k] = std::min(lo[k], p[k]);
+      hi[k] = std::max(hi[k], p[k]);
+    }
+  }
+  Float3 center;
+  for (int k = 0; k < 3; ++k) {
+    center[k] = (lo[k] + hi[k]) * 0.5f;
+  }
+  float radius = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    radius = std::max(
+        radius, Length(Sub(vertices[indices[i]].position, center)));
+  }
+
+  std::vector<Float3> normals;
+  Float3 axis{};
+  for (uint32_t i = 0; i < count; i += 3) {
+    auto &a = vertices[indices[i]].position;
+    auto n = Cross(Sub(vertices[indices[i + 1]].position, a),
+                   Sub(vertices[indices[i + 2]].position, a));
+    if (Length(n) > 0) {
+      n = Normalize(n);
+      normals.push_back(n);
+      for (int k = 0; k < 3; ++k) {
+        axis[k] += n[k];
+      }
+    }
+  }
+  axis = Normalize(axis);
+  float minDot = normals.empty() ? -1.0f : 1.0f;
+  for (auto &n : normals) {
+    minDot = std::min(minDot, Dot(n, axis));
+  }
+
+  for (int k = 0; k < 3; ++k) {
+    meshlet.center[k] = center[k];
+    meshlet.coneAxis[k] = axis[k];
+  }
+  meshlet.radius = radius;
+  // sin of the cone half angle; a cone wider than a hemisphere never culls
+  meshlet.coneCutoff = minDot <= 0 ? 1.0f : sqrtf(1.0f - minDot * minDot);
+  return meshlet;
+}
+
+// greedy runs of triangles in index order
+static void BuildMeshlets(const std::vector<Vertex> &vertices,
+                          const std::vector<uint32_t> &indices,
+                          uint32_t indexOffset,
+                          std::vector<MeshFile::Meshlet> *meshlets) {
+  uint32_t begin = 0;
+  std::vector<uint32_t> used;
+  auto flush = [&](uint32_t end) {
+    if (end > begin) {
+      auto meshlet = MakeMeshlet(vertices, indices.data() + begin, end - begin);
+      meshlet.indexOffset = indexOffset + begin;
+      meshlet.indexCount = end - begin;
+      meshlets->push_back(meshlet);
+    }
+    begin = end;
+    used.clear();
+  };
+  for (uint32_t i = 0; i < indices.size(); i += 3) {
+    size_t added = 0;
+    for (int k = 0; k < 3; ++k) {
+      if (std::find(used.begin(), used.end(), indices[i + k]) == used.end()) {
+        ++added;
+      }
+    }
+    if (used.size() + added > MAX_MESHLET_VERTICES ||
+        (i - begin) / 3 >= MAX_MESHLET_TRIANGLES) {
+      flush(i);
+    }
+    for (int k = 0; k < 3; ++k) {
+      if (std::find(used.begin(), used.end(), indices[i + k]) == used.end()) {
+        used.push_back(indices[i + k]);
+      }
+    }
+  }
+  flush(static_cast<uint32_t>(indices.size()));
+}
+
+static uint64_t Align16(uint64_t offset) { return (offset + 15) & ~15ull; }
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    std::cerr << "usage: meshconv input.obj output.mesh" << std::endl;
+    return 1;
+  }
+  auto ext = strrchr(argv[1], '.');
+  if (ext && (strcmp(ext, ".gltf") == 0 || strcmp(ext, ".glb") == 0)) {
+    std::cerr << "glTF is not supported yet, export to OBJ" << std::endl;
+    return 1;
+  }
+
+  std::vector<Vertex> vertices;
+  std::vector<uint32_t> indices;
+  if (!LoadObj(argv[1], &vertices, &indices)) {
+    std::cerr << argv[1] << ": no triangles" << std::endl;
+    return 1;
+  }
+
+  MeshFile::Header header{};
+  memcpy(header.magic, "MSH1", 4);
+  header.version = MeshFile::VERSION;
+  header.vertexCount = static_cast<uint32_t>(vertices.size());
+  Float3 boundsMin{FLT_MAX, FLT_MAX, FLT_MAX};
+  Float3 boundsMax{-FLT_MAX, -FLT_MAX, -FLT_MAX};
+  for (auto &v : vertices) {
+    for (int k = 0; k < 3; ++k) {
+      boundsMin[k] = std::min(boundsMin[k], v.position[k]);
+      boundsMax[k] = std::max(boundsMax[k], v.position[k]);
+    }
+  }
+  float largest = 0;
+  for (int k = 0; k < 3; ++k) {
+    header.boundsMin[k] = boundsMin[k];
+    header.boundsMax[k] = boundsMax[k];
+    largest = std::max(largest, boundsMax[k] - boundsMin[k]);
+  }
+
+  std::vector<MeshFile::Vertex> packed(vertices.size());
+  for (size_t i = 0; i < vertices.size(); ++i) {
+    auto &v = vertices[i];
+    for (int k = 0; k < 3; ++k) {
+      auto extent = boundsMax[k] - boundsMin[k];
+      auto t = extent > 0 ? (v.position[k] - boundsMin[k]) / extent : 0.0f;
+      packed[i].position[k] = static_cast<uint16_t>(lroundf(t * 65535.0f));
+    }
+    OctEncode(v.normal, packed[i].normal);
+    packed[i].uv[0] = ToHalf(v.uv[0]);
+    packed[i].uv[1] = ToHalf(v.uv[1]);
+  }
+
+  // LOD 0, then coarser grids while they still remove enough triangles
+  std::vector<uint32_t> allIndices;
+  std::vector<MeshFile::Lod> lods;
+  std::vector<MeshFile::Meshlet> meshlets;
+  auto addLod = [&](const std::vector<uint32_t> &lodIndices, float error) {
+    MeshFile::Lod lod{};
+    lod.indexOffset = static_cast<uint32_t>(allIndices.size());
+    lod.indexCount = static_cast<uint32_t>(lodIndices.size());
+    lod.meshletOffset = static_cast<uint32_t>(meshlets.size());
+    BuildMeshlets(vertices, lodIndices, lod.indexOffset, &meshlets);
+    lod.meshletCount = static_cast<uint32_t>(meshlets.size()) -
+                       lod.meshletOffset;
+    lod.error = error;
+    allIndices.insert(allIndices.end(), lodIndices.begin(), lodIndices.end());
+    lods.push_back(lod);
+  };
+  addLod(indices, 0.0f);
+  auto previous = indices.size();
+  for (uint32_t grid = 256; grid >= 2 && lods.size() < MAX_LODS; grid /= 2) {
+    if (largest <= 0 || previous <= 3 * 64) {
+      break;
+    }
+    auto cell = largest / grid;
+    auto lod = Cluster(vertices, indices, boundsMin, cell);
+    if (lod.empty()) {
+      break;
+    }
+    if (lod.size() > previous * 3 / 4) {
+      continue;
+    }
+    addLod(lod, cell * sqrtf(3.0f));
+    previous = lod.size();
+  }
+
+  header.indexCount = static_cast<uint32_t>(allIndices.size());
+  header.lodCount = static_cast<uint32_t>(lods.size());
+  header.meshletCount = static_cast<uint32_t>(meshlets.size());
+  header.vertexOffset = Align16(sizeof(header));
+  header.indexOffset =
+      Align16(header.vertexOffset + packed.size() * sizeof(MeshFile::Vertex));
+  header.lodOffset =
+      Align16(header.indexOffset + allIndices.size() * sizeof(uint32_t));
+  header.meshletOffset =
+      Align16(header.lodOffset + lods.size() * sizeof(MeshFile::Lod));
+  auto fileSize =
+      header.meshletOffset + meshlets.size() * sizeof(MeshFile::Meshlet);
+
+  std::vector<uint8_t> out(fileSize);
+  memcpy(out.data(), &header, sizeof(header));
+  memcpy(out.data() + header.vertexOffset, packed.data(),
+         packed.size() * sizeof(MeshFile::Vertex));
+  memcpy(out.data() + header.indexOffset, allIndices.data(),
+         allIndices.size() * sizeof(uint32_t));
+  memcpy(out.data() + header.lodOffset, lods.data(),
+         lods.size() * sizeof(MeshFile::Lod));
+  memcpy(out.data() + header.meshletOffset, meshlets.data(),
+         meshlets.size() * sizeof(MeshFile::Meshlet));
+
+  auto fp = fopen(argv[2], "wb");
+  if (!fp || fwrite(out.data(), 1, out.size(), fp) != out.size()) {
+    std::cerr << "can not write " << argv[2] << std::endl;
+    if (fp) {
+      fclose(fp);
+    }
+    return 1;
+  }
+  fclose(fp);
+
+  std::cout << argv[2] << ": " << vertices.size() << " vertices";
+  for (auto &lod : lods) {
+    std::cout << ", " << lod.indexCount / 3 << " triangles / "
+              << lod.meshletCount << " meshlets";
+  }
+  std::cout << std::endl;
+  return 0;
+}
@@ -1,3 +1,10 @@
 mkdir prefix\shaders
 glslc triangle\base.vert -o prefix\shaders\vert.spv
 glslc triangle\base.frag -o prefix\shaders\frag.spv
+glslc triangle\textured.vert -o prefix\shaders\textured_vert.spv
+glslc triangle\textured.frag -o prefix\shaders\textured_frag.spv
+glslc triangle\mesh.vert -o prefix\shaders\mesh_vert.spv
+glslc triangle\mesh.frag -o prefix\shaders\mesh_frag.spv
+glslc triangle\cull.comp -o prefix\shaders\cull_comp.spv
+glslc triangle\particles.vert -o prefix\shaders\particles_vert.spv
+glslc triangle\particles.comp -o prefix\shaders\particles_comp.spv
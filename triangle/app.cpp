@@ -1,74 +1,1344 @@
 #include "app.h"
+#include "camera.h"
+#include "command_stream.h"
+#include "frame_pacer.h"
+#include "job_system.h"
+#include "mapped_file.h"
+#include "resolution_scaler.h"
+#include "scene.h"
+#include "spsc_queue.h"
+#include "startup_timer.h"
+#include "triple_buffer.h"
+#include "vulkan_allocator.h"
+#include "vulkan_capture.h"
 #include "vulkan_device.h"
+#include "vulkan_dispatch.h"
+#include "vulkan_gpu_metrics.h"
 #include "vulkan_instance.h"
+#include "vulkan_mesh.h"
+#include "vulkan_mesh_culler.h"
+#include "vulkan_particles.h"
 #include "vulkan_pipeline.h"
 #include "vulkan_renderer.h"
+#include "vulkan_residency.h"
 #include "vulkan_swapchain.h"
+#include "vulkan_texture.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <iomanip>
+#include <iostream>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <stdint.h>
+#include <string.h>
+#include <thread>
+#include <utility>
 #include <vulkan/vulkan_core.h>
 
 static const std::vector<const char *> deviceExtensions_ = {
     VK_KHR_SWAPCHAIN_EXTENSION_NAME};
 
+// startup steps that run side by side on the job system, each one timed.
+// The first exception any of them throws is rethrown by Wait(), on the
+// thread that waits; jobs still running keep the caller's locals alive
+// until then
+class StartupJobs {
+  JobSystem &jobs_;
+  StartupTimer *timer_;
+  JobSystem::Counter done_;
+  std::mutex mutex_;
+  std::exception_ptr error_;
+
+public:
+  StartupJobs(JobSystem &jobs, StartupTimer *timer)
+      : jobs_(jobs), timer_(timer) {}
+  ~StartupJobs() { jobs_.Wait(done_); }
+
+  void Run(const char *name, std::function<void()> body) {
+    jobs_.Run(
+        [this, name, body = std::move(body)] {
+          StartupTimer::Scope phase(timer_, name);
+          try {
+            body();
+          } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!error_) {
+              error_ = std::current_exception();
+            }
+          }
+        },
+        &done_);
+  }
+
+  void Wait() {
+    jobs_.Wait(done_);
+    if (error_) {
+      std::rethrow_exception(std::exchange(error_, nullptr));
+    }
+  }
+};
+
 class Impl {
   std::shared_ptr<Vulkan::Instance> instance_;
-  VkSurfaceKHR surface_;
   VkPhysicalDevice physicalDevice_;
+  VkSampleCountFlagBits samples_ = VK_SAMPLE_COUNT_1_BIT;
   std::shared_ptr<Vulkan::Device> device_;
-  std::shared_ptr<Vulkan::SwapChain> swapChain_;
+  std::shared_ptr<Vulkan::ResidencyManager> residency_;
+  // one per window, all sharing the device, the pipelines and the scene.
+  // The first one also records the uploads, the culling and the capture
+  struct View {
+    VkSurfaceKHR surface = VK_NULL_HANDLE;
+    // the window's framebuffer size, as reported by getSurface
+    int width = 0;
+    int height = 0;
+    std::shared_ptr<Vulkan::SwapChain> swapChain;
+    // its own command buffer, submitted together with the others
+    std::shared_ptr<Vulkan::Renderer> renderer;
+    // dynamic rendering only
+    std::shared_ptr<Vulkan::RenderGraph> graph;
+    Vulkan::RenderGraph::Resource backbuffer = Vulkan::RenderGraph::NONE;
+    Vulkan::RenderGraph::Resource drawCommands = Vulkan::RenderGraph::NONE;
+    Vulkan::RenderGraph::Resource particles = Vulkan::RenderGraph::NONE;
+    // --dynamic-resolution: drawn into the top left of scene (through
+    // sceneMsaa with MSAA) and blitted to the backbuffer
+    Vulkan::RenderGraph::Resource scene = Vulkan::RenderGraph::NONE;
+    Vulkan::RenderGraph::Resource sceneMsaa = Vulkan::RenderGraph::NONE;
+    uint32_t imageIndex = 0;
+  };
+  std::vector<View> views_;
   std::shared_ptr<Vulkan::Pipeline> pipeline_;
-  std::shared_ptr<Vulkan::Renderer> renderer_;
+  // --texture: drawn as a fullscreen background behind the triangle
+  std::shared_ptr<Vulkan::TextureStreamer> streamer_;
+  Vulkan::TextureStreamer::Handle texture_ = Vulkan::TextureStreamer::NONE;
+  std::shared_ptr<Vulkan::Pipeline> texturedPipeline_;
+  // --mesh: drawn instead of the triangle, orbited by the camera
+  std::shared_ptr<Vulkan::MeshBuffer> mesh_;
+  std::shared_ptr<Vulkan::Pipeline> meshPipeline_;
+  std::shared_ptr<Vulkan::MeshCuller> culler_;
+  uint32_t meshGrid_ = 1;
+  // --particles: simulated on the GPU and drawn instead of the triangle,
+  // orbited by the camera like the mesh
+  std::shared_ptr<Vulkan::ParticleSystem> particles_;
+  std::shared_ptr<Vulkan::Pipeline> particlesPipeline_;
+  // filled by the event thread, drained by drawFrame()
+  SpscQueue<AppEvent, 64> events_;
+  TripleBuffer<AppInput> input_;
+  bool paused_ = false;
+  float orbitAngle_ = 0;
+  // a simulate job has run or is running that no cull has consumed yet
+  bool simulatePending_ = false;
+  // bumped by every event / input, waited on by waitForChanges()
+  std::atomic<uint32_t> wakeups_{0};
+  uint32_t wakeupsSeen_ = 0;
+  std::mutex wakeupMutex_;
+  std::condition_variable wakeup_;
+  std::shared_ptr<JobSystem> jobs_;
+  // frame stages in flight on jobs_
+  JobSystem::Counter simulated_;
+  JobSystem::Counter culled_;
+  // --gpu-metrics or --dynamic-resolution, first view only; occlusion
+  // queried per DrawGroup
+  std::shared_ptr<Vulkan::GpuMetrics> metrics_;
+  // --dynamic-resolution: fed with the first view's GPU time, scales every
+  // view
+  std::optional<ResolutionScaler> scaler_;
+  // --low-latency: when the frame in flight sampled its input, -1 before
+  // the first frame
+  std::optional<FramePacer> pacer_;
+  double inputMs_ = -1;
+  enum DrawGroup : uint32_t { BACKGROUND, SCENE };
+  // first view only
+  std::shared_ptr<Vulkan::Capture> capture_;
+  Vulkan::RenderGraph::Resource readback_ = Vulkan::RenderGraph::NONE;
+  uint32_t captureFrames_ = 0;
+  // --record; the camera and instances are written again only after a cull
+  std::shared_ptr<CommandStreamWriter> recorder_;
+  uint32_t recordFrames_ = 0;
+  bool recordCull_ = true;
+  // --replay: frames come from stream_ instead of the simulation, into an
+  // offscreen target
+  std::shared_ptr<MappedFile> replayFile_;
+  CommandStream stream_;
+  bool replay_ = false;
+  uint64_t replayFrame_ = 0;
+  uint32_t replayLoops_ = 1;
+  const CommandStream::Instance *replayApplied_ = nullptr;
+  std::chrono::steady_clock::time_point replayLap_;
+  std::vector<double> replayTimes_;
+  VkClearColorValue clear_{{0.0f, 0.0f, 0.0f, 1.0f}};
+  bool trackHostMemory_ = false;
+  // until the first frame has been submitted
+  StartupTimer *startup_ = nullptr;
+
+  struct MeshPush {
+    Mat4 viewProjection;
+    float boundsMin[4];
+    float boundsExtent[4];
+  };
+
+  MeshPush meshPush_{};
+  float meshRadius_ = 1.0f;
+  float pixelsPerUnit_ = 1.0f;
+  float eye_[3] = {};
+  float planes_[6][4] = {};
+  // --mesh-grid: root -> one node per row -> one turned cell per copy -> the
+  // mesh, moved so that its bounds are centered on the cell
+  Scene scene_;
+  std::vector<Scene::Node> meshNodes_;
+
+  void BuildMeshScene() {
+    auto &header = *mesh_->File().header;
+    float center[3];
+    float radius = 0;
+    for (int i = 0; i < 3; ++i) {
+      meshPush_.boundsMin[i] = header.boundsMin[i];
+      meshPush_.boundsExtent[i] = header.boundsMax[i] - header.boundsMin[i];
+      center[i] = header.boundsMin[i] + meshPush_.boundsExtent[i] * 0.5f;
+      radius += meshPush_.boundsExtent[i] * meshPush_.boundsExtent[i] * 0.25f;
+    }
+    meshRadius_ = std::max(sqrtf(radius), 1e-3f);
+
+    // one bounding diameter apart on the xz plane
+    auto spacing = meshRadius_ * 2.0f;
+    auto half = (meshGrid_ - 1) * spacing * 0.5f;
+    auto root = scene_.Add();
+    for (uint32_t z = 0; z < meshGrid_; ++z) {
+      auto row = scene_.Add(root);
+      scene_.SetTranslation(row, -half, 0, z * spacing - half);
+      for (uint32_t x = 0; x < meshGrid_; ++x) {
+        auto cell = scene_.Add(row);
+        scene_.SetTranslation(cell, x * spacing, 0, 0);
+        auto angle = (x + z) * 0.5f;
+        scene_.SetRotation(cell, 0, sinf(angle * 0.5f), 0, cosf(angle * 0.5f));
+        auto mesh = scene_.Add(cell);
+        scene_.SetTranslation(mesh, -center[0], -center[1], -center[2]);
+        meshNodes_.push_back(mesh);
+      }
+    }
+  }
+
+  // stage 1, simulate: camera and world transforms. Touches no GPU
+  // resource, so frame N + 1 runs while frame N is still in flight.
+  // renderHeight: the scene's height in pixels, below extent's when scaled
+  void Simulate(VkExtent2D extent, uint32_t renderHeight, float angle,
+                const AppInput &input) {
+    auto half = (meshGrid_ - 1) * meshRadius_;
+    auto orbit = meshRadius_ * 2.5f + half * 1.5f;
+    auto height = meshRadius_ * 0.75f + half * 0.5f;
+    auto distance = sqrtf(orbit * orbit + height * height);
+    auto yaw = angle + input.yaw;
+    auto pitch = std::clamp(atan2f(height, orbit) + input.pitch, -1.4f, 1.4f);
+    eye_[0] = sinf(yaw) * cosf(pitch) * distance;
+    eye_[1] = sinf(pitch) * distance;
+    eye_[2] = cosf(yaw) * cosf(pitch) * distance;
+    const float target[3] = {0, 0, 0};
+    const float fovY = 0.8f;
+    auto viewProjection =
+        Mat4::Perspective(fovY, (float)extent.width / (float)extent.height,
+                          meshRadius_ * 0.05f, orbit * 4.0f) *
+        Mat4::LookAt(eye_, target);
+    meshPush_.viewProjection = viewProjection;
+    viewProjection.FrustumPlanes(planes_);
+    pixelsPerUnit_ = renderHeight / (2.0f * tanf(fovY * 0.5f));
+
+    // only subtrees touched since the last frame are recomputed
+    scene_.Update();
+  }
+
+  void StartSimulate() {
+    auto extent = views_[0].swapChain->swapChainExtent_;
+    // read here: Render() updates the scaler while the job runs
+    auto renderHeight = scaler_ ? scaler_->Apply(extent.height) : extent.height;
+    jobs_->Run(
+        [this, extent, renderHeight, angle = orbitAngle_,
+         input = input_.Front()] {
+          Simulate(extent, renderHeight, angle, input);
+        },
+        &simulated_);
+    simulatePending_ = true;
+  }
+
+  // something changes from frame to frame without any input
+  bool Animating() const {
+    return ((culler_ || particles_) && !paused_) || capture_ ||
+           (streamer_ && streamer_->Busy());
+  }
+
+  // stage 2, cull: LOD selection in parallel and the meshlet list. Writes
+  // the instance buffer, so only after the frame fence
+  void Cull() {
+    auto count = static_cast<uint32_t>(meshNodes_.size());
+    culler_->Begin(count);
+    jobs_->ParallelFor(count, 1024, [this](uint32_t begin, uint32_t end) {
+      for (auto i = begin; i < end; ++i) {
+        Vulkan::MeshCuller::Instance instance;
+        auto &world = scene_.World(meshNodes_[i]);
+        std::copy(world.m, world.m + 12, instance.world);
+        culler_->Select(i, instance, eye_, pixelsPerUnit_);
+      }
+    });
+    culler_->End();
+  }
+
+  void DrawMesh(VkCommandBuffer commandBuffer, VkExtent2D extent) {
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                      meshPipeline_->graphicsPipeline_);
+    Vulkan::Renderer::SetViewport(commandBuffer, extent);
+    vkCmdPushConstants(commandBuffer, meshPipeline_->pipelineLayout_,
+                       VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(meshPush_),
+                       &meshPush_);
+    culler_->Draw(commandBuffer, meshPipeline_->pipelineLayout_);
+  }
+
+  // the camera straight from the newest input; there is no simulation
+  // stage on the CPU
+  void DrawParticles(VkCommandBuffer commandBuffer, VkExtent2D extent) {
+    auto &input = input_.Front();
+    auto yaw = orbitAngle_ + input.yaw;
+    auto pitch = std::clamp(0.5f + input.pitch, -1.4f, 1.4f);
+    const float distance = 4.5f;
+    const float eye[3] = {sinf(yaw) * cosf(pitch) * distance,
+                          sinf(pitch) * distance,
+                          cosf(yaw) * cosf(pitch) * distance};
+    const float target[3] = {0, 0, 0};
+    auto viewProjection =
+        Mat4::Perspective(0.8f, (float)extent.width / (float)extent.height,
+                          0.05f, 20.0f) *
+        Mat4::LookAt(eye, target);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                      particlesPipeline_->graphicsPipeline_);
+    Vulkan::Renderer::SetViewport(commandBuffer, extent);
+    vkCmdPushConstants(commandBuffer, particlesPipeline_->pipelineLayout_,
+                       VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(viewProjection),
+                       &viewProjection);
+    particles_->Draw(commandBuffer);
+  }
+
+  // one fixed step per frame, frozen while paused
+  void StepParticles(VkCommandBuffer commandBuffer) {
+    if (!paused_) {
+      particles_->Dispatch(commandBuffer, 1.0f / 60.0f);
+    }
+  }
+
+  // measured: the view whose command buffer carries the metrics queries
+  void DrawScene(VkCommandBuffer commandBuffer, VkExtent2D extent,
+                 bool measured) {
+    // nothing until the mip tail has landed
+    if (streamer_) {
+      vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                        texturedPipeline_->graphicsPipeline_);
+      if (streamer_->Bind(commandBuffer, texturedPipeline_->pipelineLayout_,
+                          texture_)) {
+        Vulkan::Renderer::SetViewport(commandBuffer, extent);
+        BeginGroup(commandBuffer, BACKGROUND, measured);
+        vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+        EndGroup(commandBuffer, BACKGROUND, measured);
+      }
+    }
+    BeginGroup(commandBuffer, SCENE, measured);
+    if (mesh_) {
+      DrawMesh(commandBuffer, extent);
+    } else if (particles_) {
+      DrawParticles(commandBuffer, extent);
+    } else {
+      Vulkan::Renderer::Draw(commandBuffer, extent,
+                             pipeline_->graphicsPipeline_);
+    }
+    EndGroup(commandBuffer, SCENE, measured);
+  }
+
+  void BeginGroup(VkCommandBuffer commandBuffer, DrawGroup group,
+                  bool measured) {
+    if (metrics_ && measured) {
+      metrics_->BeginGroup(commandBuffer, group);
+    }
+  }
+
+  void EndGroup(VkCommandBuffer commandBuffer, DrawGroup group,
+                bool measured) {
+    if (metrics_ && measured) {
+      metrics_->EndGroup(commandBuffer, group);
+    }
+  }
+
+  // completed uploads, before anything samples them. Without a graph the
+  // meshlet culling and the particle step are recorded here too, with their
+  // own barriers. First view only: the later command buffers of the submit
+  // see the results
+  std::function<void(VkCommandBuffer)> BeforeDraw() {
+    auto cull = culler_ && !views_[0].graph;
+    auto step = particles_ && !views_[0].graph;
+    if (!streamer_ && !cull && !step) {
+      return {};
+    }
+    return [this, cull, step](VkCommandBuffer commandBuffer) {
+      if (streamer_) {
+        streamer_->Record(commandBuffer);
+      }
+      if (cull) {
+        culler_->Dispatch(commandBuffer, planes_, eye_);
+        culler_->Barrier(commandBuffer);
+      }
+      if (step) {
+        StepParticles(commandBuffer);
+        particles_->Barrier(commandBuffer);
+      }
+    };
+  }
+
+  // src's top left `from` stretched over all of dst, bilinear
+  static void Upscale(VkCommandBuffer commandBuffer, VkImage src,
+                      VkExtent2D from, VkImage dst, VkExtent2D to) {
+    VkImageBlit region{};
+    region.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    region.srcOffsets[1] = {static_cast<int32_t>(from.width),
+                            static_cast<int32_t>(from.height), 1};
+    region.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    region.dstOffsets[1] = {static_cast<int32_t>(to.width),
+                            static_cast<int32_t>(to.height), 1};
+    vkCmdBlitImage(commandBuffer, src, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                   dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region,
+                   VK_FILTER_LINEAR);
+  }
+
+  // the first view culls and captures; the others read its draw commands,
+  // written earlier in the same submit
+  bool BuildRenderGraph(View &view, bool first) {
+    auto graph = Vulkan::RenderGraph::Create(
+        device_->device_, physicalDevice_, device_->deletionQueue_.get());
+    view.graph = graph;
+    auto backbuffer = graph->ImportImage("backbuffer",
+                                         view.swapChain->swapChainImageFormat_,
+                                         view.swapChain->finalLayout_);
+    view.backbuffer = backbuffer;
+    if (culler_ && culler_->Indirect()) {
+      view.drawCommands = graph->ImportBuffer("draw commands");
+      if (first) {
+        graph
+            ->AddPass("cull",
+                      [this](VkCommandBuffer commandBuffer,
+                             const Vulkan::RenderGraph &) {
+                        culler_->Dispatch(commandBuffer, planes_, eye_);
+                      })
+            .Write(view.drawCommands, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                   VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+      }
+    }
+    if (particles_) {
+      view.particles = graph->ImportBuffer("particles");
+      if (first) {
+        graph
+            ->AddPass("particles",
+                      [this](VkCommandBuffer commandBuffer,
+                             const Vulkan::RenderGraph &) {
+                        StepParticles(commandBuffer);
+                      })
+            .Write(view.particles, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                   VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+                       VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+      }
+    }
+    auto target = backbuffer;
+    if (scaler_) {
+      // full size; Record() sets the scaled area every frame
+      Vulkan::RenderGraph::ImageDesc desc;
+      desc.format = view.swapChain->swapChainImageFormat_;
+      desc.extent = view.swapChain->swapChainExtent_;
+      view.scene = graph->CreateImage("scene", desc);
+      target = view.scene;
+    }
+    auto triangle = graph->AddPass(
+        "triangle",
+        [this, target, first](VkCommandBuffer commandBuffer,
+                              const Vulkan::RenderGraph &compiled) {
+          DrawScene(commandBuffer, compiled.Extent(target), first);
+        });
+    auto clear = clear_;
+    if (samples_ != VK_SAMPLE_COUNT_1_BIT) {
+      Vulkan::RenderGraph::ImageDesc desc;
+      desc.format = view.swapChain->swapChainImageFormat_;
+      desc.extent = view.swapChain->swapChainExtent_;
+      desc.samples = samples_;
+      desc.transientAttachment = true;
+      auto msaa = graph->CreateImage("msaa color", desc);
+      triangle.Color(msaa, clear, target);
+      if (scaler_) {
+        view.sceneMsaa = msaa;
+      }
+    } else {
+      triangle.Color(target, clear);
+    }
+    if (view.drawCommands != Vulkan::RenderGraph::NONE) {
+      triangle.Read(view.drawCommands, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT,
+                    VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT);
+    }
+    if (view.particles != Vulkan::RenderGraph::NONE) {
+      triangle.Read(view.particles,
+                    VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT,
+                    VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT);
+    }
+    if (scaler_) {
+      graph
+          ->AddPass("upscale",
+                    [target, backbuffer](VkCommandBuffer commandBuffer,
+                                         const Vulkan::RenderGraph &compiled) {
+                      Upscale(commandBuffer, compiled.Image(target),
+                              compiled.Extent(target),
+                              compiled.Image(backbuffer),
+                              compiled.Extent(backbuffer));
+                    })
+          .TransferSrc(target)
+          .TransferDst(backbuffer);
+    }
+    graph->Output(backbuffer);
+    if (capture_ && first) {
+      readback_ = graph->ImportBuffer("readback", Vulkan::Capture::HOST_READ);
+      graph
+          ->AddPass("capture",
+                    [this, backbuffer](VkCommandBuffer commandBuffer,
+                                       const Vulkan::RenderGraph &compiled) {
+                      capture_->Record(commandBuffer,
+                                       compiled.Image(backbuffer));
+                    })
+          .TransferSrc(backbuffer)
+          .Write(readback_, VK_PIPELINE_STAGE_2_COPY_BIT,
+                 VK_ACCESS_2_TRANSFER_WRITE_BIT);
+      graph->Output(readback_);
+    }
+    return graph->Compile();
+  }
+
+  bool StartRecording(const std::string &path, const std::string &meshPath) {
+    CommandStream::Setup setup{};
+    auto &swapChain = *views_[0].swapChain;
+    setup.width = swapChain.swapChainExtent_.width;
+    setup.height = swapChain.swapChainExtent_.height;
+    setup.format = swapChain.swapChainImageFormat_;
+    setup.samples = samples_;
+    setup.dynamicRendering = device_->dynamicRendering_;
+    std::copy(clear_.float32, clear_.float32 + 4, setup.clear);
+    if (culler_) {
+      // the replay would refuse the stream
+      if (uint64_t(meshGrid_) * meshGrid_ > CommandStream::MAX_INSTANCES) {
+        std::cerr << "record: more than " << CommandStream::MAX_INSTANCES
+                  << " instances" << std::endl;
+        return false;
+      }
+      setup.maxInstances = meshGrid_ * meshGrid_;
+      if (meshPath.size() >= sizeof(setup.meshPath)) {
+        std::cerr << "record: mesh path too long" << std::endl;
+        return false;
+      }
+      meshPath.copy(setup.meshPath, meshPath.size());
+    }
+    recorder_ = CommandStreamWriter::Create(path, setup);
+    if (!recorder_) {
+      std::cerr << path << ": can not write frame stream" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  // what Render() is about to be handed, after the cull
+  void WriteFrame() {
+    static_assert(sizeof(CommandStream::Instance) ==
+                  sizeof(Vulkan::MeshCuller::Instance));
+    if (culler_ && recordCull_) {
+      CommandStream::Camera camera{};
+      memcpy(camera.planes, planes_, sizeof(planes_));
+      std::copy(eye_, eye_ + 3, camera.eye);
+      static_assert(sizeof(meshPush_) <= sizeof(camera.push));
+      camera.pushSize = sizeof(meshPush_);
+      memcpy(camera.push, &meshPush_, sizeof(meshPush_));
+      recorder_->Camera(camera);
+      recorder_->Instances(
+          culler_->InstanceCount(),
+          reinterpret_cast<const CommandStream::Instance *>(
+              culler_->Instances()),
+          culler_->Lods());
+      recordCull_ = false;
+    }
+    auto frames = recorder_->Frame();
+    if (!recorder_->Good()) {
+      throw std::runtime_error("record: failed to write frame stream");
+    }
+    if (recordFrames_ && frames >= recordFrames_) {
+      recorder_ = nullptr;
+      std::cerr << "record: " << frames << " frames written" << std::endl;
+    }
+  }
+
+  // time since the previous call, from the second frame on
+  void ReplayLap() {
+    auto now = std::chrono::steady_clock::now();
+    if (replayFrame_) {
+      replayTimes_.push_back(
+          std::chrono::duration<double, std::milli>(now - replayLap_).count());
+    }
+    replayLap_ = now;
+  }
+
+  void PrintReplay() {
+    auto count = replayTimes_.size();
+    if (!count) {
+      std::cout << "replay: no frames" << std::endl;
+      return;
+    }
+    auto times = replayTimes_;
+    std::sort(times.begin(), times.end());
+    double total = 0;
+    for (auto time : times) {
+      total += time;
+    }
+    auto flags = std::cout.flags();
+    auto precision = std::cout.precision();
+    std::cout << std::fixed << std::setprecision(2) << "replay: " << count
+              << " frames in " << total << " ms, " << count * 1000.0 / total
+              << " fps, frame ms mean " << total / count << " p50 "
+              << times[count / 2] << " p99 "
+              << times[std::min(count - 1, count * 99 / 100)] << std::endl;
+    std::cout.flags(flags);
+    std::cout.precision(precision);
+  }
+
+  // --replay: the next recorded frame, no simulation and no LOD selection.
+  // Each frame is timed from its start to the next one's, the last one
+  // until the GPU is done with it
+  bool ReplayFrame() {
+    auto &frames = stream_.frames;
+    if (replayFrame_ == frames.size() * replayLoops_) {
+      device_->Wait();
+      ReplayLap();
+      PrintReplay();
+      return false;
+    }
+    ReplayLap();
+    auto &frame = frames[replayFrame_++ % frames.size()];
+
+    device_->Sync();
+    if (culler_) {
+      auto &camera = *frame.camera;
+      memcpy(&meshPush_, camera.push,
+             std::min<size_t>(camera.pushSize, sizeof(meshPush_)));
+      memcpy(planes_, camera.planes, sizeof(planes_));
+      std::copy(camera.eye, camera.eye + 3, eye_);
+      // a frame that recorded no cull draws the last lists again, as the
+      // app did
+      if (frame.instances != replayApplied_) {
+        replayApplied_ = frame.instances;
+        culler_->Begin(frame.instanceCount);
+        for (uint32_t i = 0; i < frame.instanceCount; ++i) {
+          Vulkan::MeshCuller::Instance instance;
+          std::copy(frame.instances[i].world, frame.instances[i].world + 12,
+                    instance.world);
+          culler_->Set(i, instance, frame.lods[i]);
+        }
+        culler_->End();
+      }
+    }
+    Render();
+    return true;
+  }
+
+  static double NowMs() {
+    return std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  // --low-latency: until the previous frame is on screen (or, without
+  // present wait, complete), then the pacer's delay. Input sampled after
+  // this is as late as the frame can afford
+  void Pace() {
+    auto presented = inputMs_ >= 0;
+    if (device_->presentWait_) {
+      // the first window; 100 ms is a 10 Hz refresh
+      presented = device_->WaitPresent(views_[0].swapChain->swapChain_,
+                                       100'000'000) &&
+                  presented;
+    } else {
+      device_->WaitFrame();
+    }
+    auto now = NowMs();
+    if (presented) {
+      pacer_->Presented(inputMs_, now);
+    }
+    pacer_->Report(now, std::cerr);
+    std::this_thread::sleep_for(
+        std::chrono::duration<double, std::milli>(pacer_->Delay()));
+    inputMs_ = NowMs();
+  }
+
+  // every view into its own command buffer, after every acquire; one
+  // submit and one present for all of them
+  void Render() {
+    if (scaler_) {
+      // frames behind; Update() skips a frame it has already seen
+      auto &latest = metrics_->Latest();
+      scaler_->Update(latest.index, latest.gpuMs);
+    }
+    std::vector<VkCommandBuffer> commandBuffers;
+    std::vector<Vulkan::Device::Present> presents;
+    for (size_t i = 0; i < views_.size(); ++i) {
+      auto &view = views_[i];
+      commandBuffers.push_back(*Record(view, i == 0));
+      if (view.swapChain->swapChain_) {
+        presents.push_back({view.swapChain->swapChain_, view.imageIndex,
+                            view.swapChain->imageAvailable_});
+      }
+    }
+    device_->Submit(commandBuffers, presents);
+  }
+
+  const VkCommandBuffer *Record(View &view, bool first) {
+    auto &swapChain = *view.swapChain;
+    auto imageIndex = view.imageIndex;
+    auto extent = swapChain.swapChainExtent_;
+    auto draw = [this, extent, first](VkCommandBuffer commandBuffer) {
+      DrawScene(commandBuffer, extent, first);
+    };
+    auto beforeDraw =
+        first ? BeforeDraw() : std::function<void(VkCommandBuffer)>();
+
+    if (view.graph) {
+      auto &graph = *view.graph;
+      // acquired contents are discarded; the acquire semaphore is waited on
+      // at COLOR_ATTACHMENT_OUTPUT
+      graph.BindImage(view.backbuffer, swapChain.swapChainImages_[imageIndex],
+                      swapChain.swapChainImageViews_[imageIndex], extent,
+                      {VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+                       VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_UNDEFINED});
+      if (view.scene != Vulkan::RenderGraph::NONE) {
+        VkExtent2D area = {scaler_->Apply(extent.width),
+                           scaler_->Apply(extent.height)};
+        graph.SetRenderArea(view.scene, area);
+        if (view.sceneMsaa != Vulkan::RenderGraph::NONE) {
+          graph.SetRenderArea(view.sceneMsaa, area);
+        }
+      }
+      if (capture_ && first) {
+        graph.BindBuffer(readback_, capture_->Begin());
+      }
+      if (view.drawCommands != Vulkan::RenderGraph::NONE) {
+        // written by the first view's cull pass
+        Vulkan::ResourceState written;
+        if (!first) {
+          written = {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                     VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT};
+        }
+        graph.BindBuffer(view.drawCommands, culler_->CommandBuffer(),
+                         written);
+      }
+      if (view.particles != Vulkan::RenderGraph::NONE) {
+        // stepped by the first view's particles pass
+        Vulkan::ResourceState written;
+        if (!first) {
+          written = {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                     VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT};
+        }
+        graph.BindBuffer(view.particles, particles_->Buffer(), written);
+      }
+      return view.renderer->Render(graph, beforeDraw);
+    }
+    if (capture_ && first) {
+      capture_->Begin();
+      auto image = swapChain.swapChainImages_[imageIndex];
+      return view.renderer->Render(
+          swapChain.renderPass_, swapChain.swapChainFramebuffers_[imageIndex],
+          extent, draw,
+          [this, image](VkCommandBuffer commandBuffer,
+                        Vulkan::BarrierTracker &barriers) {
+            // the render pass leaves it in PRESENT_SRC, made visible to
+            // TRANSFER by its outgoing dependency
+            capture_->Record(commandBuffer, barriers, image,
+                             {VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_NONE,
+                              VK_IMAGE_LAYOUT_PRESENT_SRC_KHR});
+          },
+          beforeDraw);
+    }
+    return view.renderer->Render(
+        swapChain.renderPass_, swapChain.swapChainFramebuffers_[imageIndex],
+        extent, draw, {}, beforeDraw);
+  }
 
 public:
   Impl() {}
   ~Impl() {
-    device_->Wait();
-    renderer_ = nullptr;
+    if (jobs_) {
+      jobs_->Wait(simulated_);
+      jobs_->Wait(culled_);
+      jobs_ = nullptr;
+    }
+    if (device_) {
+      device_->Wait();
+    }
+    if (metrics_) {
+      // the last frames
+      metrics_->Collect();
+      metrics_ = nullptr;
+    }
+    if (capture_) {
+      capture_->Collect();
+    }
+    if (capture_ && capture_->Dropped()) {
+      std::cerr << "capture: dropped " << capture_->Dropped() << " frames"
+                << std::endl;
+    }
+    capture_ = nullptr;
+    streamer_ = nullptr;
+    texturedPipeline_ = nullptr;
+    culler_ = nullptr;
+    mesh_ = nullptr;
+    meshPipeline_ = nullptr;
+    particles_ = nullptr;
+    particlesPipeline_ = nullptr;
+    for (auto &view : views_) {
+      view.graph = nullptr;
+      view.renderer = nullptr;
+      view.swapChain = nullptr;
+    }
+    residency_ = nullptr;
     pipeline_ = nullptr;
-    swapChain_ = nullptr;
     device_ = nullptr;
-    vkDestroySurfaceKHR(instance_->handle, surface_, nullptr);
+    // created by glfwCreateWindowSurface with the default allocator; a
+    // replay has neither, nor VK_KHR_surface
+    for (auto &view : views_) {
+      if (instance_ && view.surface) {
+        vkDestroySurfaceKHR(instance_->handle, view.surface, nullptr);
+      }
+    }
+    views_.clear();
+    instance_ = nullptr;
+    if (trackHostMemory_) {
+      // anything still live here is a leak
+      Vulkan::PrintAllocationStats(std::cerr);
+    }
   }
 
   bool initialize(const char **extensions, size_t size,
-                  const GetSurface &getSurface, bool enableValidationLayers) {
+                  const GetSurface &getSurface, bool enableValidationLayers,
+                  const AppOptions &options, StartupTimer *startup) {
+    startup_ = startup;
+    if (options.trackHostMemory) {
+      Vulkan::EnableAllocationTracking();
+      trackHostMemory_ = true;
+    }
+    jobs_ = JobSystem::Create(options.jobThreads);
+    if ((!options.recordPath.empty() || !options.replayPath.empty()) &&
+        !options.texturePath.empty()) {
+      std::cerr << "--texture can not be recorded or replayed" << std::endl;
+      return false;
+    }
+    if (options.particles &&
+        (!options.recordPath.empty() || !options.replayPath.empty() ||
+         !options.meshPath.empty())) {
+      std::cerr << "--particles: not with --mesh, --record or --replay"
+                << std::endl;
+      return false;
+    }
+    // a replay takes target, pipelines and mesh from the stream
+    const CommandStream::Setup *setup = nullptr;
+    if (!options.replayPath.empty()) {
+      if (!options.capturePath.empty()) {
+        std::cerr << "capture: not supported with --replay" << std::endl;
+        return false;
+      }
+      if (options.dynamicResolution > 0) {
+        std::cerr << "--dynamic-resolution: a replay renders at the "
+                  << "recorded extent" << std::endl;
+        return false;
+      }
+      if (options.lowLatency) {
+        std::cerr << "--low-latency: a replay does not present" << std::endl;
+        return false;
+      }
+      replayFile_ = MappedFile::Open(options.replayPath);
+      std::string error = "can not open";
+      if (!replayFile_ ||
+          !CommandStream::Parse(replayFile_->Data(), replayFile_->Size(),
+                                &stream_, &error)) {
+        std::cerr << options.replayPath << ": " << error << std::endl;
+        return false;
+      }
+      setup = stream_.setup;
+      replay_ = true;
+      replayLoops_ = std::max(options.replayLoops, 1u);
+    }
+    StartupTimer::Scope instancePhase(startup_, "instance");
     instance_ =
         Vulkan::Instance::Create(extensions, size, enableValidationLayers);
+    instancePhase.End();
     if (!instance_) {
       return false;
     }
+    if (auto &sink = instance_->debugSink) {
+      VkDebugUtilsMessageSeverityFlagsEXT severities;
+      if (!Vulkan::DebugSink::ParseSeverity(options.debugSeverity,
+                                            &severities)) {
+        std::cerr << "unknown debug severity: " << options.debugSeverity
+                  << std::endl;
+        return false;
+      }
+      sink->SetSeverities(severities);
+      if (!options.debugTypes.empty()) {
+        VkDebugUtilsMessageTypeFlagsEXT types;
+        if (!Vulkan::DebugSink::ParseTypes(options.debugTypes, &types)) {
+          std::cerr << "unknown debug types: " << options.debugTypes
+                    << std::endl;
+          return false;
+        }
+        sink->SetTypes(types);
+      }
+      for (auto id : options.debugMute) {
+        sink->Mute(id);
+      }
+    }
+
+    // the windows may still be on their way: the physical devices, where
+    // the drivers initialize, are enumerated meanwhile
+    std::vector<VkPhysicalDevice> candidates;
+    views_.resize(setup ? 1 : std::max(options.windows, 1u));
+    auto &first = views_[0];
+    if (setup) {
+      // headless: no window, no surface, no VK_KHR_swapchain
+      candidates = Vulkan::EnumeratePhysicalDevices(instance_->handle, {});
+      first.width = static_cast<int>(setup->width);
+      first.height = static_cast<int>(setup->height);
+    } else {
+      StartupJobs enumerate(*jobs_, startup_);
+      enumerate.Run("enumerate devices", [this, &candidates] {
+        candidates = Vulkan::EnumeratePhysicalDevices(instance_->handle,
+                                                      deviceExtensions_);
+      });
+      StartupTimer::Scope surfacePhase(startup_, "surface");
+      for (uint32_t i = 0; i < views_.size(); ++i) {
+        auto &view = views_[i];
+        view.surface =
+            getSurface(instance_->handle, i, &view.width, &view.height);
+      }
+      surfacePhase.End();
+      enumerate.Wait();
+      for (auto &view : views_) {
+        if (!view.surface) {
+          return false;
+        }
+      }
+    }
+
+    StartupTimer::Scope devicePhase(startup_, "device");
+    physicalDevice_ = Vulkan::PickPhysicalDevice(candidates, first.surface);
+    if (!physicalDevice_) {
+      return false;
+    }
+    // every window is presented by the one queue the first one picked
+    auto presentFamily = Vulkan::QueueFamilyIndices::FindQueueFamilies(
+                             physicalDevice_, first.surface)
+                             .presentFamily.value();
+    for (uint32_t i = 1; i < views_.size(); ++i) {
+      VkBool32 supported = false;
+      vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice_, presentFamily,
+                                           views_[i].surface, &supported);
+      if (!supported) {
+        std::cerr << "window " << i << ": can not present from the queue of "
+                  << "the first window" << std::endl;
+        return false;
+      }
+    }
+    device_ = Vulkan::Device::CreateLogicalDevice(
+        physicalDevice_, first.surface,
+        setup ? std::vector<const char *>{} : deviceExtensions_,
+        setup ? setup->dynamicRendering != 0 : options.dynamicRendering,
+        options.lowLatency && !setup);
+    devicePhase.End();
+    if (!device_) {
+      return false;
+    }
+    if (options.lowLatency) {
+      pacer_.emplace(device_->presentWait_ ? "present wait" : "fence");
+    }
+    if (options.dynamicResolution > 0) {
+      // the scaled area is a graph feature
+      if (!device_->dynamicRendering_) {
+        std::cerr << "--dynamic-resolution: needs dynamic rendering"
+                  << std::endl;
+        return false;
+      }
+      scaler_.emplace(options.dynamicResolution);
+    }
+    residency_ = Vulkan::ResidencyManager::Create(physicalDevice_,
+                                                  device_->memoryBudget_);
+    samples_ = Vulkan::SwapChain::ChooseSampleCount(
+        physicalDevice_, setup ? setup->samples : options.msaaSamples);
 
-    int w, h;
-    surface_ = getSurface(instance_->handle, &w, &h);
+    // the swapchains, the shaders and the pipelines are independent of each
+    // other with dynamic rendering: everything but the queue users below
+    // runs on the job system. The render pass path builds its pipelines
+    // against the first swapchain's render pass, so they have to wait for
+    // it. Either way every window has to use the same format
+    auto colorFormat =
+        setup ? static_cast<VkFormat>(setup->format)
+              : Vulkan::SwapChain::ChooseFormat(physicalDevice_,
+                                                first.surface);
+    if (setup) {
+      std::copy(setup->clear, setup->clear + 4, clear_.float32);
+    }
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    std::vector<std::pair<const char *, std::function<void()>>> deferred;
+    StartupJobs jobs(*jobs_, startup_);
+    for (auto &view : views_) {
+      auto capture = &view == &first && !options.capturePath.empty();
+      jobs.Run("swapchain", [this, &view, colorFormat, capture] {
+        if (replay_) {
+          view.swapChain = Vulkan::SwapChain::CreateOffscreen(
+              device_->device_, physicalDevice_, colorFormat,
+              {static_cast<uint32_t>(view.width),
+               static_cast<uint32_t>(view.height)},
+              device_->dynamicRendering_, samples_);
+          return;
+        }
+        view.swapChain = Vulkan::SwapChain::CreateSwapChain(
+            device_->device_, physicalDevice_, view.surface, view.width,
+            view.height, device_->dynamicRendering_, samples_, capture,
+            scaler_.has_value());
+      });
+    }
+    auto compile = [&](const char *name,
+                       std::shared_ptr<Vulkan::Pipeline> *pipeline,
+                       const Vulkan::GraphicsPipelineDesc &desc) {
+      std::function<void()> body = [this, pipeline, desc, colorFormat,
+                                    &renderPass] {
+        *pipeline = Vulkan::Pipeline::CreateGraphicsPipeline(
+            device_->device_, renderPass, colorFormat, samples_, desc);
+      };
+      if (device_->dynamicRendering_) {
+        jobs.Run(name, std::move(body));
+      } else {
+        deferred.push_back({name, std::move(body)});
+      }
+    };
+    compile("triangle pipeline", &pipeline_, {});
 
-    physicalDevice_ = Vulkan::PickPhysicalDevice(instance_->handle, surface_,
-                                                 deviceExtensions_);
-    device_ = Vulkan::Device::CreateLogicalDevice(physicalDevice_, surface_,
-                                                  deviceExtensions_);
-    swapChain_ = Vulkan::SwapChain::CreateSwapChain(
-        device_->device_, physicalDevice_, surface_, w, h);
+    if (!options.texturePath.empty()) {
+      StartupTimer::Scope phase(startup_, "texture");
+      Vulkan::TextureStreamer::Options streamerOptions;
+      streamerOptions.uploadBudget =
+          static_cast<VkDeviceSize>(options.uploadBudget) * 1024;
+      streamer_ = Vulkan::TextureStreamer::Create(device_, physicalDevice_,
+                                                  residency_, streamerOptions);
+      if (!streamer_) {
+        return false;
+      }
+      std::string error;
+      texture_ = streamer_->Load(options.texturePath, &error);
+      if (texture_ == Vulkan::TextureStreamer::NONE) {
+        std::cerr << options.texturePath << ": " << error << std::endl;
+        return false;
+      }
+      streamer_->Request(texture_, 0);
+      Vulkan::GraphicsPipelineDesc desc;
+      desc.vert = "shaders/textured_vert.spv";
+      desc.frag = "shaders/textured_frag.spv";
+      desc.setLayout = streamer_->descriptorSetLayout_;
+      compile("textured pipeline", &texturedPipeline_, desc);
+    }
 
-    pipeline_ = Vulkan::Pipeline::CreateGraphicsPipeline(
-        device_->device_, swapChain_->renderPass_);
+    std::string meshPath = setup ? setup->meshPath : options.meshPath;
+    if (setup && !setup->maxInstances) {
+      meshPath.clear();
+    }
+    if (!meshPath.empty()) {
+      StartupTimer::Scope phase(startup_, "mesh");
+      std::string error;
+      mesh_ = Vulkan::MeshBuffer::Load(device_, physicalDevice_, meshPath,
+                                       &error);
+      if (!mesh_) {
+        std::cerr << meshPath << ": " << error << std::endl;
+        return false;
+      }
+      meshGrid_ = std::max(options.meshGrid, 1u);
+      culler_ = Vulkan::MeshCuller::Create(
+          device_, physicalDevice_, mesh_,
+          setup ? setup->maxInstances : meshGrid_ * meshGrid_);
+      if (!culler_) {
+        return false;
+      }
+      if (!setup) {
+        BuildMeshScene();
+        StartSimulate();
+      }
+      // no depth buffer: closed meshes rely on back face culling
+      Vulkan::GraphicsPipelineDesc desc;
+      desc.vert = "shaders/mesh_vert.spv";
+      desc.frag = "shaders/mesh_frag.spv";
+      desc.setLayout = culler_->descriptorSetLayout_;
+      desc.pushConstantSize = sizeof(MeshPush);
+      Vulkan::MeshBuffer::VertexInput(&desc);
+      compile("mesh pipeline", &meshPipeline_, desc);
+    }
+
+    if (options.particles) {
+      StartupTimer::Scope phase(startup_, "particles");
+      particles_ = Vulkan::ParticleSystem::Create(
+          device_->device_, physicalDevice_, device_->graphicsFamily_,
+          options.particles);
+      if (!particles_) {
+        std::cerr << "particles: " << options.particles
+                  << " exceed the device limits or memory" << std::endl;
+        return false;
+      }
+      Vulkan::GraphicsPipelineDesc desc;
+      desc.vert = "shaders/particles_vert.spv";
+      desc.pushConstantSize = sizeof(Mat4);
+      Vulkan::ParticleSystem::VertexInput(&desc);
+      compile("particles pipeline", &particlesPipeline_, desc);
+    }
 
-    renderer_ = Vulkan::Renderer::CreateCommandPool(device_->device_,
-                                                    physicalDevice_, surface_);
+    for (auto &view : views_) {
+      view.renderer = Vulkan::Renderer::CreateCommandPool(
+          device_, physicalDevice_, view.surface);
+      view.renderer->SetClearColor(clear_);
+    }
+    if (!options.gpuMetricsPath.empty() || scaler_) {
+      metrics_ = Vulkan::GpuMetrics::Create(
+          device_->device_, physicalDevice_, device_->graphicsFamily_,
+          device_->pipelineStatistics_, device_->occlusionQueryPrecise_,
+          {"background", "scene"}, options.gpuMetricsPath);
+      if (!metrics_) {
+        std::cerr << options.gpuMetricsPath << ": can not write metrics"
+                  << std::endl;
+        return false;
+      }
+      if (scaler_ && !metrics_->Timed()) {
+        std::cerr << "--dynamic-resolution: no timestamps on this queue"
+                  << std::endl;
+        return false;
+      }
+      first.renderer->SetMetrics(metrics_);
+    }
+
+    auto created = [this, colorFormat] {
+      for (auto &view : views_) {
+        if (!view.swapChain) {
+          return false;
+        }
+        if (view.swapChain->swapChainImageFormat_ != colorFormat) {
+          std::cerr << "windows with different surface formats" << std::endl;
+          return false;
+        }
+      }
+      return true;
+    };
+    if (!deferred.empty()) {
+      jobs.Wait();
+      if (!created()) {
+        return false;
+      }
+      // compatible with the other windows' render passes
+      renderPass = first.swapChain->renderPass_;
+      for (auto &[name, body] : deferred) {
+        jobs.Run(name, std::move(body));
+      }
+    }
+    jobs.Wait();
+    if (!created() || !pipeline_ || (streamer_ && !texturedPipeline_) ||
+        (mesh_ && !meshPipeline_) || (particles_ && !particlesPipeline_)) {
+      return false;
+    }
+
+    if (!options.capturePath.empty()) {
+      FrameWriter::Format format;
+      if (!FrameWriter::ParseFormat(options.captureFormat, &format)) {
+        return false;
+      }
+      if (options.captureRate == 0) {
+        std::cerr << "capture: the rate must be at least 1" << std::endl;
+        return false;
+      }
+      auto &swapChain = *first.swapChain;
+      if (swapChain.transferSrc_) {
+        capture_ = Vulkan::Capture::Create(
+            device_->device_, physicalDevice_, swapChain.swapChainImageFormat_,
+            swapChain.swapChainExtent_, options.capturePath, format,
+            options.captureRate);
+      }
+      if (!capture_) {
+        std::cerr << "capture: not supported for this swapchain" << std::endl;
+        return false;
+      }
+      captureFrames_ = options.captureFrames;
+    }
+
+    if (scaler_) {
+      // the scene is blitted with LINEAR from and to the surface format
+      VkFormatProperties properties;
+      vkGetPhysicalDeviceFormatProperties(physicalDevice_, colorFormat,
+                                          &properties);
+      VkFormatFeatureFlags needed =
+          VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+          VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+      auto blittable = (properties.optimalTilingFeatures & needed) == needed;
+      for (auto &view : views_) {
+        blittable = blittable && view.swapChain->transferDst_;
+      }
+      if (!blittable) {
+        std::cerr << "--dynamic-resolution: can not blit to this swapchain"
+                  << std::endl;
+        return false;
+      }
+    }
+
+    StartupTimer::Scope graphPhase(startup_, "render graph");
+    if (device_->dynamicRendering_) {
+      for (auto &view : views_) {
+        if (!BuildRenderGraph(view, &view == &first)) {
+          return false;
+        }
+      }
+    }
+    graphPhase.End();
+
+    if (!options.recordPath.empty() && !replay_) {
+      if (!StartRecording(options.recordPath, meshPath)) {
+        return false;
+      }
+      recordFrames_ = options.recordFrames;
+    }
 
     return true;
   }
 
-  void drawFrame() {
+  bool drawFrame() {
+    if (replay_) {
+      return ReplayFrame();
+    }
+    if (pacer_) {
+      Pace();
+    }
+    auto frameStart = startup_ ? startup_->Now() : 0.0;
+    // anything arriving from here on wakes the next waitForChanges()
+    wakeupsSeen_ = wakeups_.load(std::memory_order_acquire);
+    AppEvent event;
+    while (events_.Pop(&event)) {
+      switch (event.type) {
+      case AppEvent::Type::TogglePause:
+        paused_ = !paused_;
+        break;
+      case AppEvent::Type::Refresh:
+        // drawn again from the state there is
+        break;
+      case AppEvent::Type::Quit:
+        return false;
+      }
+    }
+    if (particles_) {
+      // no simulation stage: the camera takes the newest input as it is
+      input_.Update();
+    }
+    if (culler_ && (input_.Update() || (pacer_ && !paused_))) {
+      // newer than what the pipelined simulation saw; paced frames always
+      // simulate here, with the input of this moment
+      jobs_->Wait(simulated_);
+      StartSimulate();
+    }
+
     device_->Sync();
+    if (simulatePending_) {
+      // overlaps with the acquire below. Without a new simulation the
+      // instance and meshlet lists of the last frame are still valid
+      simulatePending_ = false;
+      recordCull_ = true;
+      jobs_->Run([this] { Cull(); }, &culled_, &simulated_);
+    }
+    // poll the memory budget, evict before anything new is streamed in
+    residency_->Update();
 
-    auto imageIndex =
-        swapChain_->AcquireNextImageIndex(device_->imageAvailableSemaphore_);
+    if (capture_) {
+      // the previous frame's copy has landed
+      capture_->Collect();
+      if (captureFrames_ && capture_->Frames() >= captureFrames_) {
+        return false;
+      }
+    }
 
-    auto pCommandBuffer = renderer_->Render(
-        swapChain_->renderPass_, swapChain_->swapChainFramebuffers_[imageIndex],
-        swapChain_->swapChainExtent_, pipeline_->graphicsPipeline_);
+    if (streamer_) {
+      // this frame's submit waits for the uploads
+      streamer_->Update();
+    }
 
-    device_->Submit(pCommandBuffer, swapChain_->swapChain_, imageIndex);
+    for (auto &view : views_) {
+      view.imageIndex = view.swapChain->AcquireNextImageIndex();
+    }
+    if (culler_) {
+      jobs_->Wait(culled_);
+    }
+    if (recorder_) {
+      WriteFrame();
+    }
+    Render();
+    if (startup_) {
+      startup_->Add("first frame", frameStart);
+      startup_->Print(std::cerr);
+      startup_ = nullptr;
+    }
+    if (particles_) {
+      particles_->Report(std::cout);
+    }
+    if ((culler_ || particles_) && !paused_) {
+      orbitAngle_ += 0.01f;
+      if (culler_ && !pacer_) {
+        // the next frame's simulation, with the newest input there is,
+        // overlaps with the next acquire
+        input_.Update();
+        StartSimulate();
+      }
+    }
+    return true;
+  }
+
+  bool pushEvent(const AppEvent &event) {
+    if (!events_.Push(event)) {
+      return false;
+    }
+    requestRedraw();
+    return true;
+  }
+
+  void publishInput(const AppInput &input) {
+    input_.Back() = input;
+    input_.Publish();
+    requestRedraw();
+  }
+
+  void requestRedraw() {
+    wakeups_.fetch_add(1, std::memory_order_release);
+    // held only for the hand over: a waiter between its check and its
+    // wait can not miss the notify
+    { std::lock_guard<std::mutex> lock(wakeupMutex_); }
+    wakeup_.notify_one();
+  }
+
+  void waitForChanges() {
+    if (Animating()) {
+      return;
+    }
+    auto changed = [this] {
+      return wakeups_.load(std::memory_order_acquire) != wakeupsSeen_;
+    };
+    std::unique_lock<std::mutex> lock(wakeupMutex_);
+    if (!streamer_) {
+      wakeup_.wait(lock, changed);
+      return;
+    }
+    // the memory budget, and with it whether a finer texture level fits,
+    // is only polled by drawFrame(): give it a frame now and then
+    wakeup_.wait_until(
+        lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(250),
+        changed);
   }
 };
 
@@ -79,8 +1349,18 @@ HelloTriangleApplication::HelloTriangleApplication() : impl_(new Impl) {}
 HelloTriangleApplication::~HelloTriangleApplication() { delete impl_; }
 bool HelloTriangleApplication::initialize(const char **extensions, size_t size,
                                           const GetSurface &getSurface,
-                                          bool enableValidationLayers) {
+                                          bool enableValidationLayers,
+                                          const AppOptions &options,
+                                          StartupTimer *startup) {
   return impl_->initialize(extensions, size, getSurface,
-                           enableValidationLayers);
+                           enableValidationLayers, options, startup);
+}
+bool HelloTriangleApplication::drawFrame() { return impl_->drawFrame(); }
+bool HelloTriangleApplication::pushEvent(const AppEvent &event) {
+  return impl_->pushEvent(event);
+}
+void HelloTriangleApplication::publishInput(const AppInput &input) {
+  impl_->publishInput(input);
 }
-void HelloTriangleApplication::drawFrame() { impl_->drawFrame(); }
+void HelloTriangleApplication::requestRedraw() { impl_->requestRedraw(); }
+void HelloTriangleApplication::waitForChanges() { impl_->waitForChanges(); }
@@ -1,9 +1,94 @@
 #pragma once
 #include <functional>
+#include <stdint.h>
+#include <string>
+#include <vector>
 #include <vulkan/vulkan.h>
 
-using GetSurface =
-    std::function<VkSurfaceKHR(VkInstance, int *width, int *height)>;
+// surface and framebuffer size of window 0 .. AppOptions::windows - 1
+using GetSurface = std::function<VkSurfaceKHR(VkInstance, uint32_t window,
+                                              int *width, int *height)>;
+
+struct AppOptions {
+  // use VK_KHR_dynamic_rendering when the device supports it, otherwise fall
+  // back to VkRenderPass / VkFramebuffer
+  bool dynamicRendering = true;
+  // MSAA sample count, clamped to framebufferColorSampleCounts
+  uint32_t msaaSamples = 1;
+  // read every frame back and write it under this path prefix; empty: off
+  std::string capturePath;
+  // "raw", "png" or "y4m"
+  std::string captureFormat = "png";
+  // stop after this many captured frames, 0: until the window is closed
+  uint32_t captureFrames = 0;
+  // playback rate written to the y4m header, frames per second
+  uint32_t captureRate = 60;
+  // route driver host allocations through counting VkAllocationCallbacks and
+  // print per-scope statistics on exit
+  bool trackHostMemory = false;
+  // KTX2 file streamed in and drawn behind the triangle; empty: off
+  std::string texturePath;
+  // texture upload staging per frame, in KiB
+  uint32_t uploadBudget = 4096;
+  // .mesh file (see meshconv) drawn instead of the triangle; empty: off
+  std::string meshPath;
+  // N x N copies of the mesh, each with its own LOD
+  uint32_t meshGrid = 1;
+  // this many particles simulated in a compute pass and drawn as points
+  // instead of the triangle, a throughput benchmark; 0: off
+  uint32_t particles = 0;
+  // windows showing the scene, sharing the device, the pipelines and the
+  // memory; drawn into one submit and presented by one present
+  uint32_t windows = 1;
+  // draw only when something changed instead of as fast as present allows
+  bool onDemand = false;
+  // job system workers besides the main thread, 0: hardware threads - 1
+  uint32_t jobThreads = 0;
+  // validation messages printed: this severity and above ("verbose",
+  // "info", "warning", "error"), of these comma separated types
+  // ("general", "validation", "performance"; empty: all), except these
+  // messageIdNumbers
+  std::string debugSeverity = "warning";
+  std::string debugTypes;
+  std::vector<int32_t> debugMute;
+  // per frame pipeline statistics, GPU time and occlusion samples per draw
+  // group, written to this CSV file; empty: off
+  std::string gpuMetricsPath;
+  // GPU frame time budget in ms: the scene is rendered at the scale that
+  // keeps the first window within it and blitted up to the window. Dynamic
+  // rendering only; 0: off
+  float dynamicResolution = 0;
+  // start every frame as late as it can still make the next refresh, so
+  // that its input is fresh; presents are observed with VK_KHR_present_wait
+  // where available, else through the frame fence. Prints present to
+  // present and input to present latency once a second
+  bool lowLatency = false;
+  // write what the renderer is handed every frame to this .vkcs file, for
+  // --replay; empty: off. Stops after recordFrames, 0: until closed
+  std::string recordPath;
+  uint32_t recordFrames = 0;
+  // no window: render the frames of this .vkcs file into an offscreen image
+  // as fast as possible, replayLoops times over, and print the frame times.
+  // Target, pipelines and mesh come from the file
+  std::string replayPath;
+  uint32_t replayLoops = 1;
+};
+
+// discrete input, delivered to the render thread in order
+struct AppEvent {
+  // Refresh: the window contents were damaged and need to be drawn again
+  enum class Type { TogglePause, Refresh, Quit };
+  Type type;
+};
+
+// continuous input; the render thread only ever sees the latest state
+struct AppInput {
+  // accumulated camera drag, in radians
+  float yaw = 0;
+  float pitch = 0;
+};
+
+class StartupTimer;
 
 class HelloTriangleApplication {
   class Impl *impl_ = nullptr;
@@ -11,7 +96,24 @@ class HelloTriangleApplication {
 public:
   HelloTriangleApplication();
   ~HelloTriangleApplication();
+  // callback may block until the window exists; it is not called for a
+  // replay. Startup phases are added to startup, if any, and printed once
+  // the first frame is submitted
   bool initialize(const char **extensions, size_t size,
-                  const GetSurface &callback, bool enableValidationLayers);
-  void drawFrame();
+                  const GetSurface &callback, bool enableValidationLayers,
+                  const AppOptions &options = {},
+                  StartupTimer *startup = nullptr);
+  // false once there is nothing left to draw
+  bool drawFrame();
+
+  // from the event thread while another thread is in drawFrame(); never
+  // block. False when the event queue is full
+  bool pushEvent(const AppEvent &event);
+  void publishInput(const AppInput &input);
+  // wakes waitForChanges() without any input, from any thread
+  void requestRedraw();
+  // on demand rendering, between drawFrame() calls: blocks until the next
+  // frame would differ from the last one. Returns at once while something
+  // animates or streams in
+  void waitForChanges();
 };
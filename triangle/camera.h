@@ -0,0 +1,92 @@
+#pragma once
+#include <math.h>
+
+//
+// Minimal column major matrix math for the vertex stage, Vulkan clip space
+// (y down, depth 0..1).
+//
+struct Mat4 {
+  float m[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+
+  Mat4 operator*(const Mat4 &rhs) const {
+    Mat4 result;
+    for (int c = 0; c < 4; ++c) {
+      for (int r = 0; r < 4; ++r) {
+        float sum = 0;
+        for (int k = 0; k < 4; ++k) {
+          sum += m[k * 4 + r] * rhs.m[c * 4 + k];
+        }
+        result.m[c * 4 + r] = sum;
+      }
+    }
+    return result;
+  }
+
+  // right handed, looking down -z
+  static Mat4 Perspective(float fovY, float aspect, float zNear, float zFar) {
+    float f = 1.0f / tanf(fovY * 0.5f);
+    Mat4 p;
+    p.m[0] = f / aspect;
+    p.m[5] = -f;
+    p.m[10] = zFar / (zNear - zFar);
+    p.m[11] = -1.0f;
+    p.m[14] = zNear * zFar / (zNear - zFar);
+    p.m[15] = 0.0f;
+    return p;
+  }
+
+  static Mat4 LookAt(const float eye[3], const float target[3]) {
+    float f[3] = {target[0] - eye[0], target[1] - eye[1], target[2] - eye[2]};
+    Normalize(f);
+    // +y up
+    float s[3] = {-f[2], 0.0f, f[0]};
+    Normalize(s);
+    float u[3] = {s[1] * f[2] - s[2] * f[1], s[2] * f[0] - s[0] * f[2],
+                  s[0] * f[1] - s[1] * f[0]};
+    Mat4 v;
+    for (int i = 0; i < 3; ++i) {
+      v.m[i * 4 + 0] = s[i];
+      v.m[i * 4 + 1] = u[i];
+      v.m[i * 4 + 2] = -f[i];
+    }
+    v.m[12] = -(s[0] * eye[0] + s[1] * eye[1] + s[2] * eye[2]);
+    v.m[13] = -(u[0] * eye[0] + u[1] * eye[1] + u[2] * eye[2]);
+    v.m[14] = f[0] * eye[0] + f[1] * eye[1] + f[2] * eye[2];
+    return v;
+  }
+
+  // left, right, bottom, top, near, far of this view projection; a point p
+  // is inside when dot(plane.xyz, p) + plane.w >= 0 for all of them
+  void FrustumPlanes(float planes[6][4]) const {
+    for (int i = 0; i < 4; ++i) {
+      float r0 = m[i * 4 + 0];
+      float r1 = m[i * 4 + 1];
+      float r2 = m[i * 4 + 2];
+      float r3 = m[i * 4 + 3];
+      planes[0][i] = r3 + r0;
+      planes[1][i] = r3 - r0;
+      planes[2][i] = r3 + r1;
+      planes[3][i] = r3 - r1;
+      // depth 0..1
+      planes[4][i] = r2;
+      planes[5][i] = r3 - r2;
+    }
+    for (int p = 0; p < 6; ++p) {
+      float length = sqrtf(planes[p][0] * planes[p][0] +
+                           planes[p][1] * planes[p][1] +
+                           planes[p][2] * planes[p][2]);
+      for (int i = 0; i < 4; ++i) {
+        planes[p][i] /= length;
+      }
+    }
+  }
+
+  static void Normalize(float v[3]) {
+    float length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    if (length > 0) {
+      v[0] /= length;
+      v[1] /= length;
+      v[2] /= length;
+    }
+  }
+};
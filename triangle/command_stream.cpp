@@ -0,0 +1,167 @@
+#include "command_stream.h"
+#include <string.h>
+
+static constexpr uint32_t HEADER_SIZE = 8;
+
+static uint32_t Padded(size_t size) {
+  return static_cast<uint32_t>((size + 3) & ~size_t(3));
+}
+
+bool CommandStream::Parse(const uint8_t *data, size_t size,
+                          CommandStream *stream, std::string *error) {
+  if (size < HEADER_SIZE || memcmp(data, "VKCS", 4) != 0) {
+    *error = "not a frame stream";
+    return false;
+  }
+  uint32_t version;
+  memcpy(&version, data + 4, sizeof(version));
+  if (version != VERSION) {
+    *error = "unsupported frame stream version";
+    return false;
+  }
+
+  // camera and instances carry over to the following frames until they are
+  // recorded again
+  Frame current;
+  size_t offset = HEADER_SIZE;
+  while (offset < size) {
+    if (size - offset < sizeof(RecordHeader)) {
+      *error = "truncated record";
+      return false;
+    }
+    // the mapping is page aligned, records 4 byte aligned
+    auto record = reinterpret_cast<const RecordHeader *>(data + offset);
+    offset += sizeof(RecordHeader);
+    if (record->size > size - offset) {
+      *error = "record out of range";
+      return false;
+    }
+    auto payload = data + offset;
+    offset += Padded(record->size);
+
+    auto type = static_cast<Type>(record->type);
+    if (!stream->setup && type != Type::Setup) {
+      *error = "stream does not start with its setup";
+      return false;
+    }
+    switch (type) {
+    case Type::Setup:
+      if (stream->setup || record->size != sizeof(Setup)) {
+        *error = "invalid setup record";
+        return false;
+      }
+      stream->setup = reinterpret_cast<const Setup *>(payload);
+      if (!stream->setup->width || !stream->setup->height ||
+          stream->setup->maxInstances > MAX_INSTANCES ||
+          !memchr(stream->setup->meshPath, 0,
+                  sizeof(stream->setup->meshPath))) {
+        *error = "invalid setup record";
+        return false;
+      }
+      break;
+
+    case Type::Camera:
+      if (record->size != sizeof(Camera) ||
+          reinterpret_cast<const Camera *>(payload)->pushSize >
+              sizeof(Camera::push)) {
+        *error = "invalid camera record";
+        return false;
+      }
+      current.camera = reinterpret_cast<const Camera *>(payload);
+      break;
+
+    case Type::Instances: {
+      if (record->size < sizeof(Instances)) {
+        *error = "invalid instances record";
+        return false;
+      }
+      auto instances = reinterpret_cast<const Instances *>(payload);
+      if (instances->count > stream->setup->maxInstances ||
+          record->size != sizeof(Instances) +
+                              instances->count *
+                                  (sizeof(Instance) + sizeof(uint32_t))) {
+        *error = "invalid instances record";
+        return false;
+      }
+      current.instanceCount = instances->count;
+      current.instances =
+          reinterpret_cast<const Instance *>(payload + sizeof(Instances));
+      current.lods = reinterpret_cast<const uint32_t *>(
+          current.instances + instances->count);
+      break;
+    }
+
+    case Type::Frame:
+      if (stream->setup->maxInstances &&
+          (!current.camera || !current.instances)) {
+        *error = "mesh frame without camera or instances";
+        return false;
+      }
+      stream->frames.push_back(current);
+      break;
+
+    default:
+      // written by a newer version; nothing this one could replay
+      break;
+    }
+  }
+  if (!stream->setup) {
+    *error = "empty frame stream";
+    return false;
+  }
+  return true;
+}
+
+std::shared_ptr<CommandStreamWriter>
+CommandStreamWriter::Create(const std::string &path,
+                            const CommandStream::Setup &setup) {
+  auto ptr = std::shared_ptr<CommandStreamWriter>(new CommandStreamWriter);
+  ptr->file_.open(path, std::ios::binary);
+  if (!ptr->file_) {
+    return nullptr;
+  }
+  auto version = CommandStream::VERSION;
+  ptr->file_.write("VKCS", 4);
+  ptr->file_.write(reinterpret_cast<const char *>(&version), sizeof(version));
+  ptr->Record(CommandStream::Type::Setup, {{&setup, sizeof(setup)}});
+  if (!ptr->file_) {
+    return nullptr;
+  }
+  return ptr;
+}
+
+void CommandStreamWriter::Record(CommandStream::Type type,
+                                 std::initializer_list<Part> parts) {
+  size_t size = 0;
+  for (auto &part : parts) {
+    size += part.size;
+  }
+  CommandStream::RecordHeader header{static_cast<uint32_t>(type),
+                                     static_cast<uint32_t>(size)};
+  file_.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  for (auto &part : parts) {
+    file_.write(static_cast<const char *>(part.data), part.size);
+  }
+  static const char zeros[4] = {};
+  file_.write(zeros, Padded(size) - size);
+}
+
+void CommandStreamWriter::Camera(const CommandStream::Camera &camera) {
+  Record(CommandStream::Type::Camera, {{&camera, sizeof(camera)}});
+}
+
+void CommandStreamWriter::Instances(uint32_t count,
+                                    const CommandStream::Instance *instances,
+                                    const uint32_t *lods) {
+  CommandStream::Instances header{};
+  header.count = count;
+  Record(CommandStream::Type::Instances,
+         {{&header, sizeof(header)},
+          {instances, count * sizeof(CommandStream::Instance)},
+          {lods, count * sizeof(uint32_t)}});
+}
+
+uint32_t CommandStreamWriter::Frame() {
+  Record(CommandStream::Type::Frame, {});
+  return ++frames_;
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include <fstream>
+#include <initializer_list>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//
+// .vkcs frame stream, written by --record and read by --replay.
+//
+// What the renderer is handed every frame, none of what the app did to get
+// there: the render target and pipelines once, then per frame the camera
+// (push constants, frustum, eye) and the instance buffer with the LOD each
+// instance was drawn at. Replaying it runs the culling, recording and
+// submission of exactly those frames without simulation, LOD selection or
+// input.
+//
+// "VKCS", the version as uint32, then a sequence of records: a RecordHeader
+// and `size` bytes of payload padded to 4 bytes. All values little endian.
+//
+struct CommandStream {
+  static constexpr uint32_t VERSION = 1;
+  // Setup::maxInstances sizes the replay's instance and culling buffers;
+  // a 1024 x 1024 --mesh-grid at most
+  static constexpr uint32_t MAX_INSTANCES = 1024 * 1024;
+
+  enum class Type : uint32_t {
+    // once, first
+    Setup = 1,
+    // per frame, before its Frame record
+    Camera,
+    Instances,
+    // one Renderer::Render and submit
+    Frame,
+  };
+
+  struct RecordHeader {
+    uint32_t type;
+    uint32_t size;
+  };
+
+  // the render target, the clear and extent passed to Renderer::Render,
+  // and the pipelines; constant for the whole stream
+  struct Setup {
+    uint32_t width;
+    uint32_t height;
+    // VkFormat / VkSampleCountFlagBits of the color target
+    uint32_t format;
+    uint32_t samples;
+    uint32_t dynamicRendering;
+    float clear[4];
+    // 0: the triangle, else the mesh pipeline with this many instances
+    uint32_t maxInstances;
+    // .mesh file, as given to --mesh
+    char meshPath[256];
+  };
+
+  // push constants of the mesh pipeline and the culling pass
+  struct Camera {
+    float planes[6][4];
+    float eye[4];
+    uint32_t pushSize;
+    uint32_t reserved[3];
+    uint8_t push[128];
+  };
+
+  // followed by count Instances and count uint32 LODs
+  struct Instances {
+    uint32_t count;
+    uint32_t reserved[3];
+  };
+  struct Instance {
+    float world[12];
+  };
+
+  // one frame, pointing into the caller's buffer; camera and instances are
+  // null for the triangle
+  struct Frame {
+    const Camera *camera = nullptr;
+    uint32_t instanceCount = 0;
+    const Instance *instances = nullptr;
+    const uint32_t *lods = nullptr;
+  };
+
+  const Setup *setup = nullptr;
+  std::vector<Frame> frames;
+
+  // checks the header and that every record lies inside the file;
+  // maxInstances against MAX_INSTANCES and instance counts against
+  // maxInstances, LODs are trusted
+  static bool Parse(const uint8_t *data, size_t size, CommandStream *stream,
+                    std::string *error);
+};
+
+class CommandStreamWriter {
+  std::ofstream file_;
+  uint32_t frames_ = 0;
+
+  CommandStreamWriter() {}
+  struct Part {
+    const void *data;
+    size_t size;
+  };
+  void Record(CommandStream::Type type, std::initializer_list<Part> parts);
+
+public:
+  static std::shared_ptr<CommandStreamWriter>
+  Create(const std::string &path, const CommandStream::Setup &setup);
+
+  // a frame's records, then Frame()
+  void Camera(const CommandStream::Camera &camera);
+  void Instances(uint32_t count, const CommandStream::Instance *instances,
+                 const uint32_t *lods);
+  // closes the frame; returns the number of frames written
+  uint32_t Frame();
+  // false once a write failed
+  bool Good() const { return file_.good(); }
+};
@@ -0,0 +1,67 @@
+#include "frame_pacer.h"
+#include <algorithm>
+#include <iomanip>
+
+// delay added per frame on time
+static constexpr double STEP_MS = 0.05;
+// never closer to the deadline than this
+static constexpr double HEADROOM_MS = 1.0;
+// an interval this many periods long is a late frame / idle time
+static constexpr double LATE = 1.5;
+static constexpr double IDLE = 4;
+
+void FramePacer::Presented(double inputMs, double presentMs) {
+  auto latency = presentMs - inputMs;
+  ++frames_;
+  latencySumMs_ += latency;
+  latencyMaxMs_ = std::max(latencyMaxMs_, latency);
+
+  auto interval = lastPresentMs_ < 0 ? 0 : presentMs - lastPresentMs_;
+  lastPresentMs_ = presentMs;
+  if (interval <= 0) {
+    return;
+  }
+  if (!periodMs_) {
+    periodMs_ = interval;
+    return;
+  }
+  if (interval > periodMs_ * IDLE) {
+    return;
+  }
+  ++intervals_;
+  intervalSumMs_ += interval;
+  intervalMaxMs_ = std::max(intervalMaxMs_, interval);
+
+  if (interval > periodMs_ * LATE) {
+    ++late_;
+    delayMs_ *= 0.5;
+    return;
+  }
+  // quick to follow a faster refresh, slow to believe a slower one
+  periodMs_ += (interval - periodMs_) * (interval < periodMs_ ? 0.5 : 0.02);
+  delayMs_ = std::clamp(delayMs_ + STEP_MS, 0.0,
+                        std::max(periodMs_ - HEADROOM_MS, 0.0));
+}
+
+void FramePacer::Report(double nowMs, std::ostream &os) {
+  if (lastReportMs_ < 0) {
+    lastReportMs_ = nowMs;
+    return;
+  }
+  if (nowMs - lastReportMs_ < 1000 || !frames_) {
+    return;
+  }
+  lastReportMs_ = nowMs;
+  auto flags = os.flags();
+  auto precision = os.precision();
+  os << std::fixed << std::setprecision(2) << "latency (" << source_
+     << "): present to present ms mean "
+     << (intervals_ ? intervalSumMs_ / intervals_ : 0) << " max "
+     << intervalMaxMs_ << ", input to present ms mean "
+     << latencySumMs_ / frames_ << " max " << latencyMaxMs_ << ", late "
+     << late_ << ", delay " << delayMs_ << " ms" << std::endl;
+  os.flags(flags);
+  os.precision(precision);
+  frames_ = late_ = intervals_ = 0;
+  intervalSumMs_ = intervalMaxMs_ = latencySumMs_ = latencyMaxMs_ = 0;
+}
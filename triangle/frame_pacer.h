@@ -0,0 +1,47 @@
+#pragma once
+#include <ostream>
+
+//
+// Just in time frame start for --low-latency.
+//
+// The render thread observes every present, through VK_KHR_present_wait
+// or, without it, as the completion of the frame's fence, and then waits
+// Delay() before it samples input and starts the next frame. The delay
+// grows by a small step for every frame that still makes the next refresh
+// and halves when a present is late, so it settles just short of the
+// deadline: input is as fresh as the frame's own CPU and GPU time allow.
+//
+// The refresh interval is learnt from the presents themselves; a gap of
+// several intervals (nothing to draw with --on-demand) is idle time, not a
+// late frame.
+//
+class FramePacer {
+  const char *source_;
+  // estimated refresh interval, 0 until two presents were seen
+  double periodMs_ = 0;
+  double delayMs_ = 0;
+  double lastPresentMs_ = -1;
+
+  // since the last report
+  double lastReportMs_ = -1;
+  int frames_ = 0;
+  int late_ = 0;
+  double intervalSumMs_ = 0;
+  double intervalMaxMs_ = 0;
+  int intervals_ = 0;
+  double latencySumMs_ = 0;
+  double latencyMaxMs_ = 0;
+
+public:
+  // source: how presents are observed, for the report
+  FramePacer(const char *source) : source_(source) {}
+
+  // the frame whose input was sampled at inputMs was presented at
+  // presentMs, both on the same clock
+  void Presented(double inputMs, double presentMs);
+  // from observing a present to sampling the next frame's input
+  double Delay() const { return delayMs_; }
+  // once a second: present to present and input to present, mean and max
+  // since the previous report, and the current delay
+  void Report(double nowMs, std::ostream &os);
+};
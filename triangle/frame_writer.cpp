@@ -0,0 +1,234 @@
+#include "frame_writer.h"
+#include <algorithm>
+#include <array>
+#include <stdio.h>
+#include <vector>
+
+static uint32_t Crc32(const uint8_t *data, size_t size, uint32_t crc = 0) {
+  static const auto table = [] {
+    std::array<uint32_t, 256> t;
+    for (uint32_t n = 0; n < 256; ++n) {
+      uint32_t c = n;
+      for (int k = 0; k < 8; ++k) {
+        c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      }
+      t[n] = c;
+    }
+    return t;
+  }();
+  crc = ~crc;
+  for (size_t i = 0; i < size; ++i) {
+    crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+static void PushBE32(std::vector<uint8_t> &out, uint32_t value) {
+  out.push_back(static_cast<uint8_t>(value >> 24));
+  out.push_back(static_cast<uint8_t>(value >> 16));
+  out.push_back(static_cast<uint8_t>(value >> 8));
+  out.push_back(static_cast<uint8_t>(value));
+}
+
+static void WriteChunk(std::ofstream &os, const char *type,
+                       const std::vector<uint8_t> &data) {
+  std::vector<uint8_t> chunk;
+  chunk.reserve(data.size() + 12);
+  PushBE32(chunk, static_cast<uint32_t>(data.size()));
+  chunk.insert(chunk.end(), type, type + 4);
+  chunk.insert(chunk.end(), data.begin(), data.end());
+  PushBE32(chunk, Crc32(chunk.data() + 4, data.size() + 4));
+  os.write(reinterpret_cast<const char *>(chunk.data()), chunk.size());
+}
+
+// frame pixel at (x, y) as r, g, b
+static void Rgb(const FrameWriter::Frame &frame, uint32_t x, uint32_t y,
+                uint8_t *r, uint8_t *g, uint8_t *b) {
+  auto p = frame.pixels + y * frame.rowPitch + x * 4;
+  *r = frame.bgra ? p[2] : p[0];
+  *g = p[1];
+  *b = frame.bgra ? p[0] : p[2];
+}
+
+static std::string FramePath(const std::string &path, uint64_t index,
+                             const char *ext) {
+  char name[32];
+  snprintf(name, sizeof(name), "_%06llu.%s",
+           static_cast<unsigned long long>(index), ext);
+  return path + name;
+}
+
+FrameWriter::~FrameWriter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_ = true;
+  }
+  cv_.notify_one();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+std::shared_ptr<FrameWriter> FrameWriter::Create(const std::string &path,
+                                                 Format format,
+                                                 uint32_t frameRate) {
+  if (frameRate == 0) {
+    return nullptr;
+  }
+  auto ptr =
+      std::shared_ptr<FrameWriter>(new FrameWriter(path, format, frameRate));
+  if (format == Format::Y4m) {
+    ptr->stream_.open(path + ".y4m", std::ios::binary);
+    if (!ptr->stream_.is_open()) {
+      return nullptr;
+    }
+  }
+  ptr->thread_ = std::thread([p = ptr.get()] { p->Run(); });
+  return ptr;
+}
+
+bool FrameWriter::ParseFormat(const std::string &name, Format *format) {
+  if (name == "raw") {
+    *format = Format::Raw;
+  } else if (name == "png") {
+    *format = Format::Png;
+  } else if (name == "y4m") {
+    *format = Format::Y4m;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void FrameWriter::Push(const Frame &frame) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push_back(frame);
+  }
+  cv_.notify_one();
+}
+
+void FrameWriter::Run() {
+  for (;;) {
+    Frame frame;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this] { return quit_ || !queue_.empty(); });
+      if (queue_.empty()) {
+        // quit only once everything queued is on disk
+        return;
+      }
+      frame = queue_.front();
+      queue_.pop_front();
+    }
+    Write(frame);
+    if (frame.release) {
+      frame.release();
+    }
+  }
+}
+
+void FrameWriter::Write(const Frame &frame) {
+  switch (format_) {
+  case Format::Raw:
+    WriteRaw(frame);
+    break;
+  case Format::Png:
+    WritePng(frame);
+    break;
+  case Format::Y4m:
+    WriteY4m(frame);
+    break;
+  }
+}
+
+void FrameWriter::WriteRaw(const Frame &frame) {
+  std::ofstream os(FramePath(path_, frame.index, "raw"), std::ios::binary);
+  for (uint32_t y = 0; y < frame.height; ++y) {
+    os.write(reinterpret_cast<const char *>(frame.pixels + y * frame.rowPitch),
+             frame.width * 4);
+  }
+}
+
+// RGB8 PNG with stored (uncompressed) deflate blocks, cheap enough to keep up
+// with the frame rate on one thread
+void FrameWriter::WritePng(const Frame &frame) {
+  std::vector<uint8_t> scanlines;
+  scanlines.reserve((frame.width * 3 + 1) * frame.height);
+  for (uint32_t y = 0; y < frame.height; ++y) {
+    scanlines.push_back(0); // filter: none
+    for (uint32_t x = 0; x < frame.width; ++x) {
+      uint8_t r, g, b;
+      Rgb(frame, x, y, &r, &g, &b);
+      scanlines.push_back(r);
+      scanlines.push_back(g);
+      scanlines.push_back(b);
+    }
+  }
+
+  std::vector<uint8_t> zlib = {0x78, 0x01};
+  uint32_t a = 1, b = 0;
+  for (auto c : scanlines) {
+    a = (a + c) % 65521;
+    b = (b + a) % 65521;
+  }
+  size_t offset = 0;
+  do {
+    size_t size = std::min<size_t>(65535, scanlines.size() - offset);
+    bool last = offset + size == scanlines.size();
+    zlib.push_back(last ? 1 : 0);
+    zlib.push_back(static_cast<uint8_t>(size));
+    zlib.push_back(static_cast<uint8_t>(size >> 8));
+    zlib.push_back(static_cast<uint8_t>(~size));
+    zlib.push_back(static_cast<uint8_t>(~size >> 8));
+    zlib.insert(zlib.end(), scanlines.begin() + offset,
+                scanlines.begin() + offset + size);
+    offset += size;
+  } while (offset < scanlines.size());
+  PushBE32(zlib, (b << 16) | a);
+
+  std::vector<uint8_t> ihdr;
+  PushBE32(ihdr, frame.width);
+  PushBE32(ihdr, frame.height);
+  ihdr.push_back(8); // bit depth
+  ihdr.push_back(2); // color type: RGB
+  ihdr.push_back(0); // compression
+  ihdr.push_back(0); // filter
+  ihdr.push_back(0); // interlace
+
+  std::ofstream os(FramePath(path_, frame.index, "png"), std::ios::binary);
+  static const uint8_t signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A,
+                                      '\n'};
+  os.write(reinterpret_cast<const char *>(signature), sizeof(signature));
+  WriteChunk(os, "IHDR", ihdr);
+  WriteChunk(os, "IDAT", zlib);
+  WriteChunk(os, "IEND", {});
+}
+
+// BT.601 limited range, planar 4:4:4
+void FrameWriter::WriteY4m(const Frame &frame) {
+  if (stream_.tellp() == 0) {
+    stream_ << "YUV4MPEG2 W" << frame.width << " H" << frame.height
+            << " F" << frameRate_ << ":1 Ip A1:1 C444\n";
+  }
+  size_t planeSize = static_cast<size_t>(frame.width) * frame.height;
+  std::vector<uint8_t> planes(planeSize * 3);
+  auto Y = planes.data();
+  auto U = Y + planeSize;
+  auto V = U + planeSize;
+  for (uint32_t y = 0; y < frame.height; ++y) {
+    for (uint32_t x = 0; x < frame.width; ++x) {
+      uint8_t r, g, b;
+      Rgb(frame, x, y, &r, &g, &b);
+      size_t i = static_cast<size_t>(y) * frame.width + x;
+      Y[i] =
+          static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+      U[i] = static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8) +
+                                  128);
+      V[i] = static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) +
+                                  128);
+    }
+  }
+  stream_ << "FRAME\n";
+  stream_.write(reinterpret_cast<const char *>(planes.data()), planes.size());
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+
+//
+// Encodes captured frames on a background thread so the render loop never
+// waits on the disk.
+//
+// Raw and Png write one file per frame (<path>_000000.raw / .png), Y4m
+// appends to a single 4:4:4 YUV4MPEG2 stream (<path>.y4m).
+//
+class FrameWriter {
+public:
+  enum class Format { Raw, Png, Y4m };
+
+  struct Frame {
+    const uint8_t *pixels;
+    uint32_t width;
+    uint32_t height;
+    // bytes per row, 4 bytes per pixel
+    uint32_t rowPitch;
+    // B8G8R8A8 rather than R8G8B8A8
+    bool bgra;
+    uint64_t index;
+    // called on the writer thread once pixels are no longer needed
+    std::function<void()> release;
+  };
+
+private:
+  std::string path_;
+  Format format_;
+  uint32_t frameRate_;
+  std::ofstream stream_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<Frame> queue_;
+  bool quit_ = false;
+  std::thread thread_;
+
+  FrameWriter(const std::string &path, Format format, uint32_t frameRate)
+      : path_(path), format_(format), frameRate_(frameRate) {}
+  void Run();
+  void Write(const Frame &frame);
+  void WriteRaw(const Frame &frame);
+  void WritePng(const Frame &frame);
+  void WriteY4m(const Frame &frame);
+
+public:
+  ~FrameWriter();
+  // frameRate: frames per second of the Y4m stream
+  static std::shared_ptr<FrameWriter>
+  Create(const std::string &path, Format format, uint32_t frameRate = 60);
+  // "raw", "png" or "y4m"
+  static bool ParseFormat(const std::string &name, Format *format);
+  void Push(const Frame &frame);
+};
@@ -0,0 +1,167 @@
+#include "job_system.h"
+#include <algorithm>
+
+static thread_local const JobSystem *t_system = nullptr;
+static thread_local uint32_t t_index = 0;
+
+JobSystem::~JobSystem() {
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex_);
+    quit_ = true;
+  }
+  wake_.notify_all();
+  for (auto &thread : threads_) {
+    thread.join();
+  }
+  if (t_system == this) {
+    t_system = nullptr;
+  }
+}
+
+std::shared_ptr<JobSystem> JobSystem::Create(uint32_t threads) {
+  if (threads == 0) {
+    auto hardware = std::thread::hardware_concurrency();
+    threads = hardware > 1 ? hardware - 1 : 1;
+  }
+  auto ptr = std::shared_ptr<JobSystem>(new JobSystem);
+  for (uint32_t i = 0; i <= threads; ++i) {
+    ptr->workers_.push_back(std::make_unique<Worker>());
+  }
+  t_system = ptr.get();
+  t_index = 0;
+  for (uint32_t i = 1; i <= threads; ++i) {
+    ptr->threads_.emplace_back(&JobSystem::Loop, ptr.get(), i);
+  }
+  return ptr;
+}
+
+// threads outside the system push to worker 0 and steal like any other
+uint32_t JobSystem::Self() const { return t_system == this ? t_index : 0; }
+
+void JobSystem::Push(Job job) {
+  auto &worker = *workers_[Self()];
+  {
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    worker.jobs.push_back(std::move(job));
+  }
+  queued_.fetch_add(1, std::memory_order_release);
+  {
+    // a worker between its empty check and wait() must see queued_
+    std::lock_guard<std::mutex> lock(sleepMutex_);
+  }
+  wake_.notify_one();
+}
+
+void JobSystem::Finish(Counter *done) {
+  if (!done) {
+    return;
+  }
+  std::vector<Job> continuations;
+  {
+    // under the lock, so that Wait() can not return and free the counter
+    // while it is still being touched here
+    std::lock_guard<std::mutex> lock(done->mutex_);
+    if (done->pending_.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+      return;
+    }
+    continuations.swap(done->continuations_);
+  }
+  for (auto &job : continuations) {
+    Push(std::move(job));
+  }
+}
+
+bool JobSystem::TryRun(uint32_t self) {
+  Job job;
+  {
+    // newest first: its data is most likely still in cache
+    auto &own = *workers_[self];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.jobs.empty()) {
+      job = std::move(own.jobs.back());
+      own.jobs.pop_back();
+    }
+  }
+  auto count = static_cast<uint32_t>(workers_.size());
+  for (uint32_t i = 1; !job && i < count; ++i) {
+    // oldest first: the biggest remaining piece of someone else's work
+    auto &victim = *workers_[(self + i) % count];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.jobs.empty()) {
+      job = std::move(victim.jobs.front());
+      victim.jobs.pop_front();
+    }
+  }
+  if (!job) {
+    return false;
+  }
+  queued_.fetch_sub(1, std::memory_order_relaxed);
+  job();
+  return true;
+}
+
+void JobSystem::Loop(uint32_t index) {
+  t_system = this;
+  t_index = index;
+  for (;;) {
+    if (TryRun(index)) {
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(sleepMutex_);
+    wake_.wait(lock, [this] {
+      return quit_ || queued_.load(std::memory_order_acquire) > 0;
+    });
+    if (quit_ && queued_.load(std::memory_order_acquire) == 0) {
+      return;
+    }
+  }
+}
+
+void JobSystem::Run(Job job, Counter *done, Counter *after) {
+  if (done) {
+    done->pending_.fetch_add(1, std::memory_order_relaxed);
+  }
+  Job wrapped = [this, job = std::move(job), done] {
+    job();
+    Finish(done);
+  };
+  if (after) {
+    // Finish() brings the count to zero and takes the continuations under
+    // the same lock, so a job is parked or pushed, never lost
+    std::lock_guard<std::mutex> lock(after->mutex_);
+    if (!after->Done()) {
+      after->continuations_.push_back(std::move(wrapped));
+      return;
+    }
+  }
+  Push(std::move(wrapped));
+}
+
+void JobSystem::Wait(Counter &counter) {
+  auto self = Self();
+  while (!counter.Done()) {
+    if (!TryRun(self)) {
+      std::this_thread::yield();
+    }
+  }
+  // the last Finish() may still hold the lock
+  std::lock_guard<std::mutex> lock(counter.mutex_);
+}
+
+void JobSystem::ParallelFor(
+    uint32_t count, uint32_t grain,
+    const std::function<void(uint32_t, uint32_t)> &body) {
+  grain = std::max(grain, 1u);
+  if (count <= grain) {
+    if (count) {
+      body(0, count);
+    }
+    return;
+  }
+  Counter counter;
+  for (uint32_t begin = 0; begin < count; begin += grain) {
+    auto end = std::min(begin + grain, count);
+    Run([&body, begin, end] { body(begin, end); }, &counter);
+  }
+  Wait(counter);
+}
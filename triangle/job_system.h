@@ -0,0 +1,76 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+//
+// Work stealing job scheduler shared by everything that runs in parallel.
+//
+// Every worker owns a deque: it pushes and pops its own jobs at the back
+// and, when empty, steals from the front of the others. The thread that
+// created the JobSystem is worker 0 and only runs jobs while it is inside
+// Wait() / ParallelFor(), so waiting never idles a core.
+//
+// Dependencies go through Counters: a job counted by `done` keeps it
+// pending until it has returned, and a job run `after` a Counter is parked
+// on it and scheduled by whichever job brings it to zero.
+//
+class JobSystem {
+public:
+  using Job = std::function<void()>;
+
+  class Counter {
+    friend class JobSystem;
+    std::atomic<uint32_t> pending_{0};
+    std::mutex mutex_;
+    std::vector<Job> continuations_;
+
+  public:
+    bool Done() const { return pending_.load(std::memory_order_acquire) == 0; }
+  };
+
+private:
+  struct Worker {
+    std::mutex mutex;
+    std::deque<Job> jobs;
+  };
+  // [0] is the creating thread
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::vector<std::thread> threads_;
+  std::atomic<uint32_t> queued_{0};
+  std::mutex sleepMutex_;
+  std::condition_variable wake_;
+  bool quit_ = false;
+
+  JobSystem() {}
+  uint32_t Self() const;
+  void Push(Job job);
+  void Finish(Counter *done);
+  bool TryRun(uint32_t self);
+  void Loop(uint32_t index);
+
+public:
+  ~JobSystem();
+  JobSystem(const JobSystem &) = delete;
+  JobSystem &operator=(const JobSystem &) = delete;
+  // threads: workers besides the calling thread; 0: one per remaining
+  // hardware thread
+  static std::shared_ptr<JobSystem> Create(uint32_t threads = 0);
+  // including the creating thread
+  uint32_t Workers() const { return static_cast<uint32_t>(workers_.size()); }
+
+  // done and after may be null
+  void Run(Job job, Counter *done = nullptr, Counter *after = nullptr);
+  // runs other jobs until counter reaches zero
+  void Wait(Counter &counter);
+  // body(begin, end) over [0, count) in chunks of grain, returns when all
+  // of them have
+  void ParallelFor(uint32_t count, uint32_t grain,
+                   const std::function<void(uint32_t, uint32_t)> &body);
+};
@@ -0,0 +1,75 @@
+#include "ktx2.h"
+#include <algorithm>
+#include <string.h>
+
+static const uint8_t IDENTIFIER[12] = {0xAB, 'K',  'T',  'X', ' ',  '2',
+                                       '0',  0xBB, '\r', '\n', 0x1A, '\n'};
+
+template <typename T> static T Read(const uint8_t *p) {
+  T value;
+  memcpy(&value, p, sizeof(T));
+  return value;
+}
+
+bool Ktx2::Parse(const uint8_t *data, size_t size, Ktx2 *ktx,
+                 std::string *error) {
+  // identifier, 9 x uint32 header, 4 x uint32 + 2 x uint64 index
+  const size_t headerSize = 12 + 9 * 4 + 4 * 4 + 2 * 8;
+  if (size < headerSize || memcmp(data, IDENTIFIER, sizeof(IDENTIFIER)) != 0) {
+    *error = "not a KTX2 file";
+    return false;
+  }
+  auto header = data + sizeof(IDENTIFIER);
+  ktx->vkFormat = Read<uint32_t>(header + 0);
+  ktx->width = Read<uint32_t>(header + 8);
+  ktx->height = Read<uint32_t>(header + 12);
+  auto depth = Read<uint32_t>(header + 16);
+  auto layerCount = Read<uint32_t>(header + 20);
+  auto faceCount = Read<uint32_t>(header + 24);
+  auto levelCount = Read<uint32_t>(header + 28);
+  auto supercompression = Read<uint32_t>(header + 32);
+
+  if (ktx->vkFormat == 0) {
+    *error = "Basis Universal (VK_FORMAT_UNDEFINED) is not supported";
+    return false;
+  }
+  if (supercompression != 0) {
+    *error = "supercompressed KTX2 is not supported";
+    return false;
+  }
+  if (ktx->width == 0 || ktx->height == 0 || depth > 1 || layerCount > 1 ||
+      faceCount != 1) {
+    *error = "only single 2D images are supported";
+    return false;
+  }
+  ktx->generateMips = levelCount == 0;
+  if (levelCount == 0) {
+    levelCount = 1;
+  }
+  // a full chain ends at 1x1; more levels would shift the extent by 32
+  uint32_t maxLevels = 1;
+  while (std::max(ktx->width, ktx->height) >> maxLevels) {
+    ++maxLevels;
+  }
+  if (levelCount > maxLevels) {
+    *error = "more levels than a full mip chain";
+    return false;
+  }
+  if (size < headerSize + uint64_t(levelCount) * 24) {
+    *error = "truncated level index";
+    return false;
+  }
+
+  ktx->levels.resize(levelCount);
+  auto index = data + headerSize;
+  for (uint32_t i = 0; i < levelCount; ++i) {
+    auto offset = Read<uint64_t>(index + i * 24);
+    auto length = Read<uint64_t>(index + i * 24 + 8);
+    if (offset > size || length > size - offset) {
+      *error = "level data out of range";
+      return false;
+    }
+    ktx->levels[i] = {data + offset, static_cast<size_t>(length)};
+  }
+  return true;
+}
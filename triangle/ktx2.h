@@ -0,0 +1,28 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//
+// KTX 2.0 container, 2D textures only: one layer, one face, no
+// supercompression. Level data points into the caller's buffer (usually a
+// MappedFile), nothing is copied.
+//
+struct Ktx2 {
+  struct Level {
+    const uint8_t *data;
+    size_t size;
+  };
+  // a VkFormat value
+  uint32_t vkFormat = 0;
+  uint32_t width = 0;
+  uint32_t height = 0;
+  // levels[0] is the full resolution image
+  std::vector<Level> levels;
+  // levelCount was 0: the file asks the loader to generate the mip chain
+  bool generateMips = false;
+
+  static bool Parse(const uint8_t *data, size_t size, Ktx2 *ktx,
+                    std::string *error);
+};
@@ -1,25 +1,86 @@
 #include "app.h"
+#include "startup_timer.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <future>
 #include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
 const uint32_t WIDTH = 800;
 const uint32_t HEIGHT = 600;
 
+// glfwInit() and glfwTerminate(), around every window
+class Glfw {
+public:
+  ~Glfw() { glfwTerminate(); }
+  // enough for getRequiredExtensions()
+  bool init() { return glfwInit() == GLFW_TRUE; }
+};
+
 class AppWindow {
   GLFWwindow *window_ = nullptr;
+  HelloTriangleApplication *app_ = nullptr;
+  // left button camera drag
+  bool dragging_ = false;
+  double lastX_ = 0;
+  double lastY_ = 0;
+  // shared by every window: a drag in any of them turns the one camera
+  AppInput *input_ = nullptr;
+
+  static AppWindow *From(GLFWwindow *window) {
+    return static_cast<AppWindow *>(glfwGetWindowUserPointer(window));
+  }
+
+  static void OnKey(GLFWwindow *window, int key, int, int action, int) {
+    if (action != GLFW_PRESS) {
+      return;
+    }
+    auto self = From(window);
+    if (key == GLFW_KEY_SPACE) {
+      self->app_->pushEvent({AppEvent::Type::TogglePause});
+    } else if (key == GLFW_KEY_ESCAPE) {
+      self->app_->pushEvent({AppEvent::Type::Quit});
+    }
+  }
+
+  static void OnMouseButton(GLFWwindow *window, int button, int action, int) {
+    auto self = From(window);
+    if (button == GLFW_MOUSE_BUTTON_LEFT) {
+      self->dragging_ = action == GLFW_PRESS;
+      glfwGetCursorPos(window, &self->lastX_, &self->lastY_);
+    }
+  }
+
+  static void OnCursor(GLFWwindow *window, double x, double y) {
+    auto self = From(window);
+    if (!self->dragging_) {
+      return;
+    }
+    self->input_->yaw -= static_cast<float>(x - self->lastX_) * 0.005f;
+    self->input_->pitch += static_cast<float>(y - self->lastY_) * 0.005f;
+    self->lastX_ = x;
+    self->lastY_ = y;
+    self->app_->publishInput(*self->input_);
+  }
+
+  static void OnRefresh(GLFWwindow *window) {
+    From(window)->app_->pushEvent({AppEvent::Type::Refresh});
+  }
 
 public:
   ~AppWindow() {
-    glfwDestroyWindow(window_);
-    glfwTerminate();
+    if (window_) {
+      glfwDestroyWindow(window_);
+    }
   }
 
   bool create(int width, int height, const char *title) {
-    if (!glfwInit()) {
-      return false;
-    }
-
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
     glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
     window_ = glfwCreateWindow(width, height, title, nullptr, nullptr);
@@ -30,6 +91,7 @@ public:
     return true;
   }
 
+  // any thread
   VkSurfaceKHR createSurface(VkInstance instance) {
     VkSurfaceKHR surface;
     if (glfwCreateWindowSurface(instance, window_, nullptr, &surface) !=
@@ -40,14 +102,25 @@ public:
     return surface;
   }
 
-  bool newFrame() {
-    if (glfwWindowShouldClose(window_)) {
-      return false;
-    }
-    glfwPollEvents();
-    return true;
+  // input goes to app from the callbacks, on this thread
+  void attach(HelloTriangleApplication *app, AppInput *input) {
+    app_ = app;
+    input_ = input;
+    glfwSetWindowUserPointer(window_, this);
+    glfwSetKeyCallback(window_, OnKey);
+    glfwSetMouseButtonCallback(window_, OnMouseButton);
+    glfwSetCursorPosCallback(window_, OnCursor);
+    glfwSetWindowRefreshCallback(window_, OnRefresh);
   }
 
+  bool shouldClose() { return glfwWindowShouldClose(window_); }
+
+  // every window's events; blocks until there are any, or wake() from
+  // another thread
+  static void waitEvents() { glfwWaitEvents(); }
+
+  static void wake() { glfwPostEmptyEvent(); }
+
   void getBufferSize(int *w, int *h) { glfwGetFramebufferSize(window_, w, h); }
 };
 
@@ -72,34 +145,197 @@ const bool enableValidationLayers = false;
 const bool enableValidationLayers = true;
 #endif
 
-int main() {
-  AppWindow window;
+static AppOptions parseOptions(int argc, char **argv) {
+  AppOptions options;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--no-dynamic-rendering") == 0) {
+      options.dynamicRendering = false;
+    } else if (strcmp(argv[i], "--msaa") == 0 && i + 1 < argc) {
+      options.msaaSamples = static_cast<uint32_t>(atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+      options.capturePath = argv[++i];
+    } else if (strcmp(argv[i], "--capture-format") == 0 && i + 1 < argc) {
+      options.captureFormat = argv[++i];
+    } else if (strcmp(argv[i], "--capture-frames") == 0 && i + 1 < argc) {
+      options.captureFrames = static_cast<uint32_t>(atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--capture-rate") == 0 && i + 1 < argc) {
+      options.captureRate = static_cast<uint32_t>(atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--track-host-memory") == 0) {
+      options.trackHostMemory = true;
+    } else if (strcmp(argv[i], "--texture") == 0 && i + 1 < argc) {
+      options.texturePath = argv[++i];
+    } else if (strcmp(argv[i], "--upload-budget") == 0 && i + 1 < argc) {
+      options.uploadBudget = static_cast<uint32_t>(atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--mesh") == 0 && i + 1 < argc) {
+      options.meshPath = argv[++i];
+    } else if (strcmp(argv[i], "--mesh-grid") == 0 && i + 1 < argc) {
+      options.meshGrid = static_cast<uint32_t>(atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--particles") == 0 && i + 1 < argc) {
+      options.particles = static_cast<uint32_t>(atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+      options.jobThreads = static_cast<uint32_t>(atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--windows") == 0 && i + 1 < argc) {
+      options.windows = static_cast<uint32_t>(atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--on-demand") == 0) {
+      options.onDemand = true;
+    } else if (strcmp(argv[i], "--low-latency") == 0) {
+      options.lowLatency = true;
+    } else if (strcmp(argv[i], "--gpu-metrics") == 0 && i + 1 < argc) {
+      options.gpuMetricsPath = argv[++i];
+    } else if (strcmp(argv[i], "--dynamic-resolution") == 0 &&
+               i + 1 < argc) {
+      options.dynamicResolution = static_cast<float>(atof(argv[++i]));
+    } else if (strcmp(argv[i], "--debug-severity") == 0 && i + 1 < argc) {
+      options.debugSeverity = argv[++i];
+    } else if (strcmp(argv[i], "--debug-types") == 0 && i + 1 < argc) {
+      options.debugTypes = argv[++i];
+    } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+      options.recordPath = argv[++i];
+    } else if (strcmp(argv[i], "--record-frames") == 0 && i + 1 < argc) {
+      options.recordFrames = static_cast<uint32_t>(atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+      options.replayPath = argv[++i];
+    } else if (strcmp(argv[i], "--replay-loops") == 0 && i + 1 < argc) {
+      options.replayLoops = static_cast<uint32_t>(atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--debug-mute") == 0 && i + 1 < argc) {
+      // as printed by the layer, usually hex
+      options.debugMute.push_back(
+          static_cast<int32_t>(strtoul(argv[++i], nullptr, 0)));
+    }
+  }
+  return options;
+}
 
-  if (!window.create(WIDTH, HEIGHT, "Vulkan")) {
-    return 1;
+// headless, on this thread: no GLFW, no window, no surface
+static int replay(const AppOptions &options) {
+  std::vector<const char *> extensions;
+  if (enableValidationLayers) {
+    extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
   }
+  HelloTriangleApplication app;
+  try {
+    if (!app.initialize(extensions.data(), extensions.size(), {},
+                        enableValidationLayers, options)) {
+      return 1;
+    }
+    while (app.drawFrame()) {
+    }
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
 
+int main(int argc, char **argv) {
+  StartupTimer startup;
+  auto options = parseOptions(argc, argv);
+  if (!options.replayPath.empty()) {
+    return replay(options);
+  }
+
+  Glfw glfw;
+  StartupTimer::Scope glfwPhase(&startup, "glfw");
+  if (!glfw.init()) {
+    return 1;
+  }
   auto extensions = getRequiredExtensions(enableValidationLayers);
+  glfwPhase.End();
 
-  auto getSurface = [&w = window](VkInstance instance, int *width,
-                                  int *height) {
-    w.getBufferSize(width, height);
-    return w.createSurface(instance);
+  // the windows are created here, on the thread GLFW requires, while the
+  // render thread already loads Vulkan and enumerates the devices. Their
+  // surfaces are created there once all of them exist
+  struct Windows {
+    bool created = false;
+    std::vector<std::pair<int, int>> sizes;
+  };
+  auto windowCount = std::max(options.windows, 1u);
+  std::vector<std::unique_ptr<AppWindow>> windows;
+  std::promise<Windows> windowPromise;
+  auto windowFuture = windowPromise.get_future().share();
+  auto getSurface = [&windows, windowFuture](
+                        VkInstance instance, uint32_t index, int *width,
+                        int *height) -> VkSurfaceKHR {
+    auto &created = windowFuture.get();
+    if (!created.created) {
+      return VK_NULL_HANDLE;
+    }
+    *width = created.sizes[index].first;
+    *height = created.sizes[index].second;
+    return windows[index]->createSurface(instance);
   };
 
+  // every Vulkan call is made on the render thread, this one only handles
+  // window events: a blocking acquire or present no longer stalls input,
+  // and slow event handling no longer stalls frames
   HelloTriangleApplication app;
-  if (!app.initialize(extensions.data(), extensions.size(), getSurface, enableValidationLayers)) {
-    return 1;
-  }
+  std::atomic<bool> running{true};
+  bool initialized = false;
+  std::string error;
+  std::thread renderThread([&] {
+    try {
+      initialized =
+          app.initialize(extensions.data(), extensions.size(), getSurface,
+                         enableValidationLayers, options, &startup);
+      while (initialized && running.load(std::memory_order_relaxed) &&
+             app.drawFrame()) {
+        if (options.onDemand) {
+          app.waitForChanges();
+        }
+      }
+    } catch (const std::exception &e) {
+      error = e.what();
+    }
+    running = false;
+    AppWindow::wake();
+  });
 
-  try {
-    while (window.newFrame()) {
-      app.drawFrame();
+  Windows created;
+  AppInput input;
+  {
+    StartupTimer::Scope phase(&startup, "window");
+    created.created = true;
+    for (uint32_t i = 0; i < windowCount && created.created; ++i) {
+      auto title =
+          windowCount == 1 ? "Vulkan" : "Vulkan " + std::to_string(i + 1);
+      auto window = std::make_unique<AppWindow>();
+      created.created = window->create(WIDTH, HEIGHT, title.c_str());
+      if (created.created) {
+        created.sizes.emplace_back();
+        window->getBufferSize(&created.sizes.back().first,
+                              &created.sizes.back().second);
+      }
+      windows.push_back(std::move(window));
     }
-  } catch (const std::exception &e) {
-    std::cerr << e.what() << std::endl;
+  }
+  windowPromise.set_value(created);
+  if (created.created) {
+    for (auto &window : windows) {
+      window->attach(&app, &input);
+    }
+    // until any window is closed
+    auto open = [&windows] {
+      for (auto &window : windows) {
+        if (window->shouldClose()) {
+          return false;
+        }
+      }
+      return true;
+    };
+    while (running.load() && open()) {
+      AppWindow::waitEvents();
+    }
+  }
+  running = false;
+  app.requestRedraw();
+  renderThread.join();
+  if (!error.empty()) {
+    std::cerr << error << std::endl;
     return EXIT_FAILURE;
   }
+  if (!created.created || !initialized) {
+    return 1;
+  }
 
   return EXIT_SUCCESS;
 }
@@ -0,0 +1,82 @@
+#include "mapped_file.h"
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::~MappedFile() {
+  if (data_) {
+    UnmapViewOfFile(data_);
+  }
+  if (mapping_) {
+    CloseHandle(mapping_);
+  }
+  if (file_ && file_ != INVALID_HANDLE_VALUE) {
+    CloseHandle(file_);
+  }
+}
+
+std::shared_ptr<MappedFile> MappedFile::Open(const std::string &path) {
+  auto ptr = std::shared_ptr<MappedFile>(new MappedFile);
+  ptr->file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                           OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (ptr->file_ == INVALID_HANDLE_VALUE) {
+    return nullptr;
+  }
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(ptr->file_, &size) || size.QuadPart == 0) {
+    return nullptr;
+  }
+  ptr->size_ = static_cast<size_t>(size.QuadPart);
+  ptr->mapping_ =
+      CreateFileMappingA(ptr->file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!ptr->mapping_) {
+    return nullptr;
+  }
+  ptr->data_ = static_cast<const uint8_t *>(
+      MapViewOfFile(ptr->mapping_, FILE_MAP_READ, 0, 0, 0));
+  if (!ptr->data_) {
+    return nullptr;
+  }
+  return ptr;
+}
+
+#else
+
+MappedFile::~MappedFile() {
+  if (data_) {
+    munmap(const_cast<uint8_t *>(data_), size_);
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+std::shared_ptr<MappedFile> MappedFile::Open(const std::string &path) {
+  auto ptr = std::shared_ptr<MappedFile>(new MappedFile);
+  ptr->fd_ = open(path.c_str(), O_RDONLY);
+  if (ptr->fd_ < 0) {
+    return nullptr;
+  }
+  struct stat st;
+  if (fstat(ptr->fd_, &st) != 0 || st.st_size == 0) {
+    return nullptr;
+  }
+  ptr->size_ = static_cast<size_t>(st.st_size);
+  auto data = mmap(nullptr, ptr->size_, PROT_READ, MAP_PRIVATE, ptr->fd_, 0);
+  if (data == MAP_FAILED) {
+    return nullptr;
+  }
+  ptr->data_ = static_cast<const uint8_t *>(data);
+  return ptr;
+}
+
+#endif
@@ -0,0 +1,30 @@
+#pragma once
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+//
+// Read-only memory mapping of a whole file. Pages are faulted in by the OS
+// as they are touched, so only the parts actually read ever occupy memory.
+//
+class MappedFile {
+  const uint8_t *data_ = nullptr;
+  size_t size_ = 0;
+#ifdef _WIN32
+  void *file_ = nullptr;
+  void *mapping_ = nullptr;
+#else
+  int fd_ = -1;
+#endif
+
+  MappedFile() {}
+
+public:
+  ~MappedFile();
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  static std::shared_ptr<MappedFile> Open(const std::string &path);
+  const uint8_t *Data() const { return data_; }
+  size_t Size() const { return size_; }
+};
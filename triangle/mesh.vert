@@ -0,0 +1,40 @@
+#version 450
+
+layout(push_constant) uniform Push {
+    mat4 viewProjection;
+    // dequantization: boundsMin + position * boundsExtent
+    vec4 boundsMin;
+    vec4 boundsExtent;
+} push;
+
+// MeshCuller::Instance: three rows of a 3x4 world transform, uniform scale
+layout(std430, set = 0, binding = 1) readonly buffer Instances {
+    vec4 instances[];
+};
+
+layout(location = 0) in vec4 inPosition;
+layout(location = 1) in vec2 inNormal;
+layout(location = 2) in vec2 inUV;
+
+layout(location = 0) out vec3 fragNormal;
+
+vec3 octDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * sign(n.xy);
+    }
+    return normalize(n);
+}
+
+void main() {
+    vec3 position = push.boundsMin.xyz + inPosition.xyz * push.boundsExtent.xyz;
+    vec4 r0 = instances[gl_InstanceIndex * 3];
+    vec4 r1 = instances[gl_InstanceIndex * 3 + 1];
+    vec4 r2 = instances[gl_InstanceIndex * 3 + 2];
+    vec4 p = vec4(position, 1.0);
+    position = vec3(dot(r0, p), dot(r1, p), dot(r2, p));
+    gl_Position = push.viewProjection * vec4(position, 1.0);
+    vec3 n = octDecode(inNormal);
+    fragNormal = normalize(vec3(dot(r0.xyz, n), dot(r1.xyz, n),
+                                dot(r2.xyz, n)));
+}
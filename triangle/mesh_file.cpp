@@ -0,0 +1,79 @@
+#include "mesh_file.h"
+#include <string.h>
+
+static bool InRange(uint64_t offset, uint64_t count, size_t stride,
+                    size_t size) {
+  return offset % 16 == 0 && offset <= size &&
+         count <= (size - offset) / stride;
+}
+
+bool MeshFile::Parse(const uint8_t *data, size_t size, MeshFile *mesh,
+                     std::string *error) {
+  if (size < sizeof(Header) || memcmp(data, "MSH1", 4) != 0) {
+    *error = "not a mesh file";
+    return false;
+  }
+  // the mapping is page aligned, so are the sections
+  auto header = reinterpret_cast<const Header *>(data);
+  if (header->version != VERSION) {
+    *error = "unsupported mesh version";
+    return false;
+  }
+  if (header->vertexCount == 0 || header->indexCount == 0 ||
+      header->lodCount == 0 || header->meshletCount == 0 ||
+      !InRange(header->vertexOffset, header->vertexCount, sizeof(Vertex),
+               size) ||
+      !InRange(header->indexOffset, header->indexCount, sizeof(uint32_t),
+               size) ||
+      !InRange(header->lodOffset, header->lodCount, sizeof(Lod), size) ||
+      !InRange(header->meshletOffset, header->meshletCount, sizeof(Meshlet),
+               size)) {
+    *error = "mesh section out of range";
+    return false;
+  }
+
+  auto lods = reinterpret_cast<const Lod *>(data + header->lodOffset);
+  auto meshlets =
+      reinterpret_cast<const Meshlet *>(data + header->meshletOffset);
+  for (uint32_t i = 0; i < header->lodCount; ++i) {
+    auto &lod = lods[i];
+    if (lod.indexCount % 3 != 0 || lod.indexOffset > header->indexCount ||
+        lod.indexCount > header->indexCount - lod.indexOffset ||
+        lod.meshletOffset > header->meshletCount ||
+        lod.meshletCount > header->meshletCount - lod.meshletOffset) {
+      *error = "LOD out of range";
+      return false;
+    }
+  }
+  for (uint32_t i = 0; i < header->meshletCount; ++i) {
+    auto &meshlet = meshlets[i];
+    if (meshlet.indexOffset > header->indexCount ||
+        meshlet.indexCount > header->indexCount - meshlet.indexOffset) {
+      *error = "meshlet out of range";
+      return false;
+    }
+  }
+
+  mesh->header = header;
+  mesh->vertices =
+      reinterpret_cast<const Vertex *>(data + header->vertexOffset);
+  mesh->indices =
+      reinterpret_cast<const uint32_t *>(data + header->indexOffset);
+  mesh->lods = lods;
+  mesh->meshlets = meshlets;
+  return true;
+}
+
+uint32_t MeshFile::SelectLod(uint32_t current, float pixelsPerUnit,
+                             float threshold, float hysteresis) const {
+  auto count = header->lodCount;
+  auto lod = current < count ? current : 0;
+  while (lod > 0 && lods[lod].error * pixelsPerUnit > threshold) {
+    --lod;
+  }
+  while (lod + 1 < count && lods[lod + 1].error * pixelsPerUnit <=
+                                threshold * (1.0f - hysteresis)) {
+    ++lod;
+  }
+  return lod;
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+//
+// .mesh container, written by meshconv.
+//
+// Everything the GPU reads is stored exactly as it is bound: the vertex and
+// index sections are copied into buffers as they are, the LOD and meshlet
+// tables are read in place. Loading is a memory map and a header check, no
+// parsing. Sections are 16 byte aligned, all values little endian.
+//
+struct MeshFile {
+  static constexpr uint32_t VERSION = 1;
+
+  // positions are UNORM inside the bounds of the header, normals
+  // octahedral SNORM, texture coordinates half floats
+  struct Vertex {
+    uint16_t position[4];
+    int16_t normal[2];
+    uint16_t uv[2];
+  };
+  static_assert(sizeof(Vertex) == 16);
+
+  // LOD 0 is the full mesh; coarser LODs share the vertex section
+  struct Lod {
+    uint32_t indexOffset;
+    uint32_t indexCount;
+    uint32_t meshletOffset;
+    uint32_t meshletCount;
+    // object space distance the simplified surface may be off by
+    float error;
+    uint32_t reserved[3];
+  };
+  static_assert(sizeof(Lod) == 32);
+
+  // a run of triangles in the index section, laid out for std430
+  struct Meshlet {
+    float center[3];
+    float radius;
+    // normal cone: every triangle faces away from a viewer at v when
+    // dot(center - v, coneAxis) >= coneCutoff * |center - v| + radius
+    float coneAxis[3];
+    float coneCutoff;
+    uint32_t indexOffset;
+    uint32_t indexCount;
+    uint32_t reserved[2];
+  };
+  static_assert(sizeof(Meshlet) == 48);
+
+  struct Header {
+    char magic[4];
+    uint32_t version;
+    uint32_t vertexCount;
+    // uint32 indices
+    uint32_t indexCount;
+    uint32_t lodCount;
+    uint32_t meshletCount;
+    float boundsMin[3];
+    float boundsMax[3];
+    // byte offsets from the start of the file
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    uint64_t lodOffset;
+    uint64_t meshletOffset;
+  };
+  static_assert(sizeof(Header) == 80);
+
+  // point into the caller's buffer (usually a MappedFile)
+  const Header *header = nullptr;
+  const Vertex *vertices = nullptr;
+  const uint32_t *indices = nullptr;
+  const Lod *lods = nullptr;
+  const Meshlet *meshlets = nullptr;
+
+  // checks the header and that every table lies inside the file; index
+  // values are trusted
+  static bool Parse(const uint8_t *data, size_t size, MeshFile *mesh,
+                    std::string *error);
+
+  // coarsest LOD whose error projects to at most `threshold` pixels, given
+  // the pixels one object space unit covers at the object's distance.
+  // Refines as soon as the current LOD is over the threshold but only
+  // coarsens once the next one is under threshold * (1 - hysteresis), so an
+  // object near a switch distance does not pop back and forth.
+  uint32_t SelectLod(uint32_t current, float pixelsPerUnit,
+                     float threshold = 1.0f, float hysteresis = 0.25f) const;
+};
@@ -0,0 +1,76 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// Bounded lock-free queue for any number of producer threads and one
+// consumer thread.
+//
+// Every slot carries a sequence number that says whose turn it is: a
+// producer claims a position by advancing tail_, fills the slot and then
+// publishes it through the sequence, so a slow producer only holds up the
+// consumer at its own slot and never another producer. Push() fails
+// instead of waiting when the queue is full.
+//
+template <typename T, size_t Capacity> class MpscQueue {
+  static_assert((Capacity & (Capacity - 1)) == 0, "power of two");
+
+  struct Slot {
+    // position + 1 once written, position + Capacity once read
+    std::atomic<size_t> sequence;
+    T value;
+  };
+  std::array<Slot, Capacity> slots_;
+  // next position to claim, shared by the producers
+  alignas(64) std::atomic<size_t> tail_{0};
+  // next position to read, owned by the consumer
+  alignas(64) size_t head_ = 0;
+
+public:
+  MpscQueue() {
+    for (size_t i = 0; i < Capacity; ++i) {
+      slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+  MpscQueue(const MpscQueue &) = delete;
+  MpscQueue &operator=(const MpscQueue &) = delete;
+
+  // any thread; false when full
+  bool Push(const T &value) {
+    auto tail = tail_.load(std::memory_order_relaxed);
+    Slot *slot;
+    for (;;) {
+      slot = &slots_[tail & (Capacity - 1)];
+      auto sequence = slot->sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(tail);
+      if (diff == 0) {
+        if (tail_.compare_exchange_weak(tail, tail + 1,
+                                        std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        // not read yet since the last lap
+        return false;
+      } else {
+        tail = tail_.load(std::memory_order_relaxed);
+      }
+    }
+    slot->value = value;
+    slot->sequence.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // consumer; false when empty or the next slot is still being written
+  bool Pop(T *value) {
+    auto &slot = slots_[head_ & (Capacity - 1)];
+    if (slot.sequence.load(std::memory_order_acquire) != head_ + 1) {
+      return false;
+    }
+    *value = slot.value;
+    slot.sequence.store(head_ + Capacity, std::memory_order_release);
+    ++head_;
+    return true;
+  }
+};
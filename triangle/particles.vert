@@ -0,0 +1,18 @@
+#version 450
+
+layout(push_constant) uniform Push {
+    mat4 viewProjection;
+} push;
+
+// ParticleSystem::Particle
+layout(location = 0) in vec4 inPosition;
+layout(location = 1) in vec4 inVelocity;
+
+layout(location = 0) out vec3 fragColor;
+
+void main() {
+    gl_Position = push.viewProjection * vec4(inPosition.xyz, 1.0);
+    gl_PointSize = 1.0;
+    float speed = clamp(length(inVelocity.xyz) * 0.7, 0.0, 1.0);
+    fragColor = mix(vec3(0.2, 0.4, 1.0), vec3(1.0, 0.6, 0.2), speed);
+}
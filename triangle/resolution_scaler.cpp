@@ -0,0 +1,25 @@
+#include "resolution_scaler.h"
+#include <algorithm>
+#include <math.h>
+
+// fraction of the correction applied per frame
+static constexpr float DAMPING = 0.1f;
+
+void ResolutionScaler::Update(uint64_t frame, double gpuMs) {
+  if (frame == frame_ || gpuMs <= 0) {
+    return;
+  }
+  frame_ = frame;
+  auto target = scale_ * static_cast<float>(sqrt(budgetMs_ / gpuMs));
+  scale_ += (target - scale_) * DAMPING;
+  scale_ = std::clamp(scale_, minScale_, 1.0f);
+}
+
+uint32_t ResolutionScaler::Apply(uint32_t full) const {
+  if (scale_ >= 1) {
+    return full;
+  }
+  auto scaled = static_cast<uint32_t>(full * scale_) / GRANULARITY *
+                GRANULARITY;
+  return std::clamp(scaled, std::min(GRANULARITY, full), full);
+}
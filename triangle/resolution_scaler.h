@@ -0,0 +1,33 @@
+#pragma once
+#include <stdint.h>
+
+//
+// Render scale for a GPU frame time budget (--dynamic-resolution).
+//
+// GPU time is taken to follow the pixel count, the square of the scale: every
+// measured frame moves the scale a fraction of the way towards
+// scale * sqrt(budget / measured). The damping absorbs single slow frames and
+// the frames still in flight at the old scale; the extent snaps to multiples
+// of GRANULARITY so that small corrections do not change it every frame.
+//
+class ResolutionScaler {
+  double budgetMs_;
+  float minScale_;
+  float scale_ = 1;
+  // last frame fed to Update()
+  uint64_t frame_ = ~0ull;
+
+public:
+  static constexpr uint32_t GRANULARITY = 8;
+
+  // scale stays within [minScale, 1]
+  ResolutionScaler(double budgetMs, float minScale = 0.5f)
+      : budgetMs_(budgetMs), minScale_(minScale) {}
+
+  // GPU time of a finished frame; a frame seen before or without a time is
+  // ignored
+  void Update(uint64_t frame, double gpuMs);
+  float Scale() const { return scale_; }
+  // full, scaled and snapped; full itself at scale 1
+  uint32_t Apply(uint32_t full) const;
+};
@@ -0,0 +1,204 @@
+#include "scene.h"
+#include <assert.h>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SCENE_SSE
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SCENE_NEON
+#endif
+
+namespace {
+
+// four floats in one register, or a plain array without SIMD
+#if defined(SCENE_SSE)
+struct F4 {
+  __m128 v;
+};
+F4 Load(const float *p) { return {_mm_loadu_ps(p)}; }
+void Store(float *p, F4 a) { _mm_storeu_ps(p, a.v); }
+F4 Splat(float f) { return {_mm_set1_ps(f)}; }
+F4 operator+(F4 a, F4 b) { return {_mm_add_ps(a.v, b.v)}; }
+F4 operator-(F4 a, F4 b) { return {_mm_sub_ps(a.v, b.v)}; }
+F4 operator*(F4 a, F4 b) { return {_mm_mul_ps(a.v, b.v)}; }
+void Transpose(F4 &a, F4 &b, F4 &c, F4 &d) {
+  _MM_TRANSPOSE4_PS(a.v, b.v, c.v, d.v);
+}
+#elif defined(SCENE_NEON)
+struct F4 {
+  float32x4_t v;
+};
+F4 Load(const float *p) { return {vld1q_f32(p)}; }
+void Store(float *p, F4 a) { vst1q_f32(p, a.v); }
+F4 Splat(float f) { return {vdupq_n_f32(f)}; }
+F4 operator+(F4 a, F4 b) { return {vaddq_f32(a.v, b.v)}; }
+F4 operator-(F4 a, F4 b) { return {vsubq_f32(a.v, b.v)}; }
+F4 operator*(F4 a, F4 b) { return {vmulq_f32(a.v, b.v)}; }
+void Transpose(F4 &a, F4 &b, F4 &c, F4 &d) {
+  auto ab = vzipq_f32(a.v, b.v);
+  auto cd = vzipq_f32(c.v, d.v);
+  a.v = vcombine_f32(vget_low_f32(ab.val[0]), vget_low_f32(cd.val[0]));
+  b.v = vcombine_f32(vget_high_f32(ab.val[0]), vget_high_f32(cd.val[0]));
+  c.v = vcombine_f32(vget_low_f32(ab.val[1]), vget_low_f32(cd.val[1]));
+  d.v = vcombine_f32(vget_high_f32(ab.val[1]), vget_high_f32(cd.val[1]));
+}
+#else
+struct F4 {
+  float v[4];
+};
+F4 Load(const float *p) { return {{p[0], p[1], p[2], p[3]}}; }
+void Store(float *p, F4 a) {
+  for (int i = 0; i < 4; ++i) {
+    p[i] = a.v[i];
+  }
+}
+F4 Splat(float f) { return {{f, f, f, f}}; }
+F4 operator+(F4 a, F4 b) {
+  return {{a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3]}};
+}
+F4 operator-(F4 a, F4 b) {
+  return {{a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3]}};
+}
+F4 operator*(F4 a, F4 b) {
+  return {{a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3]}};
+}
+void Transpose(F4 &a, F4 &b, F4 &c, F4 &d) {
+  F4 r[4] = {a, b, c, d};
+  for (int i = 0; i < 4; ++i) {
+    a.v[i] = r[i].v[0];
+    b.v[i] = r[i].v[1];
+    c.v[i] = r[i].v[2];
+    d.v[i] = r[i].v[3];
+  }
+}
+#endif
+
+// world = parent * local, one output row per register
+void Compose(const Scene::Affine &parent, const Scene::Affine &local,
+             Scene::Affine *world) {
+  auto l0 = Load(local.m);
+  auto l1 = Load(local.m + 4);
+  auto l2 = Load(local.m + 8);
+  const float e3[4] = {0, 0, 0, 1};
+  auto l3 = Load(e3);
+  for (int r = 0; r < 3; ++r) {
+    auto p = parent.m + r * 4;
+    Store(world->m + r * 4, Splat(p[0]) * l0 + Splat(p[1]) * l1 +
+                                Splat(p[2]) * l2 + Splat(p[3]) * l3);
+  }
+}
+
+} // namespace
+
+Scene::Node Scene::Add(Node parent) {
+  assert(parent == NONE || parent < count_);
+  if (count_ % 4 == 0) {
+    auto padded = count_ + 4;
+    tx_.resize(padded, 0.0f);
+    ty_.resize(padded, 0.0f);
+    tz_.resize(padded, 0.0f);
+    qx_.resize(padded, 0.0f);
+    qy_.resize(padded, 0.0f);
+    qz_.resize(padded, 0.0f);
+    qw_.resize(padded, 1.0f);
+    scale_.resize(padded, 1.0f);
+    localDirty_.resize(padded, 0);
+    changed_.resize(padded, 0);
+    locals_.resize(padded);
+    worlds_.resize(padded);
+  }
+  auto node = count_++;
+  parents_.push_back(parent);
+  localDirty_[node] = 1;
+  return node;
+}
+
+void Scene::SetTranslation(Node node, float x, float y, float z) {
+  tx_[node] = x;
+  ty_[node] = y;
+  tz_[node] = z;
+  localDirty_[node] = 1;
+}
+
+void Scene::SetRotation(Node node, float x, float y, float z, float w) {
+  qx_[node] = x;
+  qy_[node] = y;
+  qz_[node] = z;
+  qw_[node] = w;
+  localDirty_[node] = 1;
+}
+
+void Scene::SetScale(Node node, float scale) {
+  scale_[node] = scale;
+  localDirty_[node] = 1;
+}
+
+void Scene::Update() {
+  UpdateLocals();
+  UpdateWorlds();
+}
+
+// T * R * S for four nodes per iteration, transposed into their rows
+void Scene::UpdateLocals() {
+  auto one = Splat(1.0f);
+  auto two = Splat(2.0f);
+  for (uint32_t i = 0; i < count_; i += 4) {
+    if (!(localDirty_[i] | localDirty_[i + 1] | localDirty_[i + 2] |
+          localDirty_[i + 3])) {
+      continue;
+    }
+    auto x = Load(&qx_[i]);
+    auto y = Load(&qy_[i]);
+    auto z = Load(&qz_[i]);
+    auto w = Load(&qw_[i]);
+    auto s = Load(&scale_[i]);
+    auto xx = x * x, yy = y * y, zz = z * z;
+    auto xy = x * y, xz = x * z, yz = y * z;
+    auto wx = w * x, wy = w * y, wz = w * z;
+
+    auto r00 = (one - two * (yy + zz)) * s;
+    auto r01 = two * (xy - wz) * s;
+    auto r02 = two * (xz + wy) * s;
+    auto r03 = Load(&tx_[i]);
+    auto r10 = two * (xy + wz) * s;
+    auto r11 = (one - two * (xx + zz)) * s;
+    auto r12 = two * (yz - wx) * s;
+    auto r13 = Load(&ty_[i]);
+    auto r20 = two * (xz - wy) * s;
+    auto r21 = two * (yz + wx) * s;
+    auto r22 = (one - two * (xx + yy)) * s;
+    auto r23 = Load(&tz_[i]);
+    Transpose(r00, r01, r02, r03);
+    Transpose(r10, r11, r12, r13);
+    Transpose(r20, r21, r22, r23);
+
+    F4 rows[3][4] = {{r00, r01, r02, r03},
+                     {r10, r11, r12, r13},
+                     {r20, r21, r22, r23}};
+    for (uint32_t n = 0; n < 4; ++n) {
+      for (int r = 0; r < 3; ++r) {
+        Store(locals_[i + n].m + r * 4, rows[r][n]);
+      }
+    }
+  }
+}
+
+// parents come first, so a changed parent is known before its children
+void Scene::UpdateWorlds() {
+  for (uint32_t i = 0; i < count_; ++i) {
+    auto parent = parents_[i];
+    auto dirty = localDirty_[i] || (parent != NONE && changed_[parent]);
+    changed_[i] = dirty;
+    if (!dirty) {
+      continue;
+    }
+    localDirty_[i] = 0;
+    if (parent == NONE) {
+      worlds_[i] = locals_[i];
+    } else {
+      Compose(worlds_[parent], locals_[i], &worlds_[i]);
+    }
+  }
+}
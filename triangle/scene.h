@@ -0,0 +1,60 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+//
+// Transform hierarchy stored as structure of arrays.
+//
+// Nodes are only ever appended and a parent must exist before its children,
+// so the arrays are always sorted parents first and Update() is one linear
+// pass: dirty local transforms are rebuilt four nodes at a time from the
+// translation / rotation / scale streams, then every node whose local or
+// parent world changed gets world = parent world * local. Both kernels use
+// SSE or NEON when the target has them.
+//
+// World transforms are row major 3x4 affine matrices, the layout
+// MeshCuller::Instance uploads.
+//
+class Scene {
+public:
+  using Node = uint32_t;
+  static constexpr Node NONE = UINT32_MAX;
+
+  struct alignas(16) Affine {
+    float m[12] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0};
+  };
+
+private:
+  // SoA, padded to a multiple of 4 for the local kernel
+  std::vector<float> tx_, ty_, tz_;
+  std::vector<float> qx_, qy_, qz_, qw_;
+  std::vector<float> scale_;
+  std::vector<Node> parents_;
+  std::vector<uint8_t> localDirty_;
+  // set by Update() for every node whose world was rewritten
+  std::vector<uint8_t> changed_;
+  std::vector<Affine> locals_;
+  std::vector<Affine> worlds_;
+  uint32_t count_ = 0;
+
+  void UpdateLocals();
+  void UpdateWorlds();
+
+public:
+  // parent: NONE or an existing node
+  Node Add(Node parent = NONE);
+  uint32_t Size() const { return count_; }
+  Node Parent(Node node) const { return parents_[node]; }
+
+  void SetTranslation(Node node, float x, float y, float z);
+  // unit quaternion
+  void SetRotation(Node node, float x, float y, float z, float w);
+  // uniform, so bounding spheres stay spheres
+  void SetScale(Node node, float scale);
+
+  // rebuilds the world transforms of every changed subtree
+  void Update();
+  const Affine &World(Node node) const { return worlds_[node]; }
+  bool Changed(Node node) const { return changed_[node] != 0; }
+};
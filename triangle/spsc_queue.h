@@ -0,0 +1,42 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <stddef.h>
+
+//
+// Bounded lock-free queue for exactly one producer thread and one consumer
+// thread. Head and tail live on separate cache lines so the two sides only
+// share the slots they hand over.
+//
+template <typename T, size_t Capacity> class SpscQueue {
+  static_assert((Capacity & (Capacity - 1)) == 0, "power of two");
+
+  std::array<T, Capacity> slots_;
+  // next slot to read, written by the consumer only
+  alignas(64) std::atomic<size_t> head_{0};
+  // next slot to write, written by the producer only
+  alignas(64) std::atomic<size_t> tail_{0};
+
+public:
+  // producer; false when full
+  bool Push(const T &value) {
+    auto tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) == Capacity) {
+      return false;
+    }
+    slots_[tail & (Capacity - 1)] = value;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // consumer; false when empty
+  bool Pop(T *value) {
+    auto head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    *value = slots_[head & (Capacity - 1)];
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+};
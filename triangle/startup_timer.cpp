@@ -0,0 +1,36 @@
+#include "startup_timer.h"
+#include <algorithm>
+#include <iomanip>
+
+double StartupTimer::Now() const {
+  return std::chrono::duration<double, std::milli>(Clock::now() - origin_)
+      .count();
+}
+
+void StartupTimer::Add(const std::string &name, double start) {
+  auto now = Now();
+  std::lock_guard<std::mutex> lock(mutex_);
+  phases_.push_back({name, start, now - start});
+}
+
+void StartupTimer::Print(std::ostream &os) {
+  std::vector<Phase> phases;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    phases = phases_;
+  }
+  std::stable_sort(phases.begin(), phases.end(),
+                   [](const Phase &a, const Phase &b) {
+                     return a.start < b.start;
+                   });
+  auto flags = os.flags();
+  auto precision = os.precision();
+  os << std::fixed << std::setprecision(1);
+  for (auto &phase : phases) {
+    os << "startup " << std::left << std::setw(20) << phase.name << std::right
+       << " at " << std::setw(8) << phase.start << " ms, took "
+       << std::setw(8) << phase.duration << " ms" << std::endl;
+  }
+  os.flags(flags);
+  os.precision(precision);
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+//
+// Wall clock record of the startup phases, written from any thread.
+//
+// Phases overlap, so each one keeps its start relative to the creation of
+// the timer as well as its duration: the report shows what ran side by side
+// and which chain of phases the first frame actually waited for.
+//
+class StartupTimer {
+  using Clock = std::chrono::steady_clock;
+
+  struct Phase {
+    std::string name;
+    // ms since creation
+    double start;
+    double duration;
+  };
+  Clock::time_point origin_ = Clock::now();
+  std::mutex mutex_;
+  std::vector<Phase> phases_;
+
+public:
+  // times one phase from construction to End() or destruction; a null
+  // timer records nothing
+  class Scope {
+    StartupTimer *timer_;
+    const char *name_;
+    double start_;
+
+  public:
+    Scope(StartupTimer *timer, const char *name)
+        : timer_(timer), name_(name), start_(timer ? timer->Now() : 0) {}
+    ~Scope() { End(); }
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+    void End() {
+      if (timer_) {
+        timer_->Add(name_, start_);
+        timer_ = nullptr;
+      }
+    }
+  };
+
+  // ms since creation
+  double Now() const;
+  // a phase that started at start and ends now
+  void Add(const std::string &name, double start);
+  // sorted by start
+  void Print(std::ostream &os);
+};
@@ -0,0 +1,40 @@
+#pragma once
+#include <atomic>
+#include <stdint.h>
+
+//
+// Latest-value handoff between one writer and one reader thread.
+//
+// The writer fills Back() and publishes it by swapping it with the middle
+// slot; the reader swaps the middle slot with its front one when something
+// new was published. Neither side ever waits, and the reader always sees a
+// complete snapshot, skipping any it was too slow for.
+//
+template <typename T> class TripleBuffer {
+  static constexpr uint32_t FRESH = 4;
+
+  T slots_[3] = {};
+  // index of the middle slot | FRESH once published and not yet taken
+  std::atomic<uint32_t> middle_{1};
+  // owned by the writer
+  uint32_t back_ = 2;
+  // owned by the reader
+  uint32_t front_ = 0;
+
+public:
+  // writer
+  T &Back() { return slots_[back_]; }
+  void Publish() {
+    back_ = middle_.exchange(back_ | FRESH, std::memory_order_acq_rel) & 3;
+  }
+
+  // reader; true when Front() changed
+  bool Update() {
+    if (!(middle_.load(std::memory_order_relaxed) & FRESH)) {
+      return false;
+    }
+    front_ = middle_.exchange(front_, std::memory_order_acq_rel) & 3;
+    return true;
+  }
+  const T &Front() const { return slots_[front_]; }
+};
@@ -0,0 +1,235 @@
+#include "vulkan_allocator.h"
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+
+// precedes every pointer handed to the driver
+struct Header {
+  // heap block, or the ArenaChunk for arena allocations
+  void *base;
+  size_t size;
+  uint32_t scope;
+  uint32_t arena;
+};
+static_assert(sizeof(Header) % alignof(Header) == 0);
+
+struct Counters {
+  std::atomic<uint64_t> bytes{0};
+  std::atomic<uint64_t> allocations{0};
+  std::atomic<uint64_t> peakBytes{0};
+  std::atomic<uint64_t> totalAllocations{0};
+  std::atomic<uint64_t> arenaAllocations{0};
+  std::atomic<uint64_t> internalBytes{0};
+};
+
+Counters g_counters[VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1];
+bool g_enabled = false;
+
+//
+// per-thread bump arena for COMMAND scope
+//
+// A chunk is freed by whoever drops its last reference: the owning thread
+// holds one while the chunk is current, every live allocation holds one.
+// When only the owner's reference is left the chunk is rewound in place.
+//
+constexpr size_t ARENA_CHUNK_SIZE = 256 * 1024;
+constexpr size_t ARENA_MAX_ALLOCATION = 4 * 1024;
+
+struct alignas(16) ArenaChunk {
+  std::atomic<uint32_t> refs{1};
+  size_t offset = 0;
+  uint8_t *Data() { return reinterpret_cast<uint8_t *>(this + 1); }
+};
+
+void Release(ArenaChunk *chunk) {
+  if (chunk->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    chunk->~ArenaChunk();
+    free(chunk);
+  }
+}
+
+struct ThreadArena {
+  ArenaChunk *current = nullptr;
+  ~ThreadArena() {
+    if (current) {
+      Release(current);
+    }
+  }
+};
+thread_local ThreadArena t_arena;
+
+uint8_t *AlignUp(uint8_t *p, size_t alignment) {
+  auto value = reinterpret_cast<uintptr_t>(p);
+  return reinterpret_cast<uint8_t *>((value + alignment - 1) &
+                                     ~(uintptr_t)(alignment - 1));
+}
+
+void *ArenaAllocate(size_t size, size_t alignment) {
+  size_t need = sizeof(Header) + alignment + size;
+  if (need > ARENA_MAX_ALLOCATION) {
+    return nullptr;
+  }
+  auto chunk = t_arena.current;
+  if (chunk && chunk->refs.load(std::memory_order_acquire) == 1) {
+    // everything allocated from it is gone
+    chunk->offset = 0;
+  }
+  if (!chunk || chunk->offset + need > ARENA_CHUNK_SIZE) {
+    if (chunk) {
+      Release(chunk);
+    }
+    auto memory = malloc(sizeof(ArenaChunk) + ARENA_CHUNK_SIZE);
+    if (!memory) {
+      t_arena.current = nullptr;
+      return nullptr;
+    }
+    chunk = new (memory) ArenaChunk;
+    t_arena.current = chunk;
+  }
+  auto p = AlignUp(chunk->Data() + chunk->offset + sizeof(Header), alignment);
+  chunk->offset = (p + size) - chunk->Data();
+  chunk->refs.fetch_add(1, std::memory_order_relaxed);
+  auto header = reinterpret_cast<Header *>(p) - 1;
+  header->base = chunk;
+  header->arena = 1;
+  return p;
+}
+
+void *HeapAllocate(size_t size, size_t alignment) {
+  auto base = static_cast<uint8_t *>(malloc(sizeof(Header) + alignment + size));
+  if (!base) {
+    return nullptr;
+  }
+  auto p = AlignUp(base + sizeof(Header), alignment);
+  auto header = reinterpret_cast<Header *>(p) - 1;
+  header->base = base;
+  header->arena = 0;
+  return p;
+}
+
+void *VKAPI_PTR Allocate(void *, size_t size, size_t alignment,
+                         VkSystemAllocationScope scope) {
+  alignment = std::max(alignment, alignof(Header));
+  void *p = nullptr;
+  auto &c = g_counters[scope];
+  if (scope == VK_SYSTEM_ALLOCATION_SCOPE_COMMAND) {
+    p = ArenaAllocate(size, alignment);
+    if (p) {
+      c.arenaAllocations.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  if (!p) {
+    p = HeapAllocate(size, alignment);
+    if (!p) {
+      return nullptr;
+    }
+  }
+  auto header = reinterpret_cast<Header *>(p) - 1;
+  header->size = size;
+  header->scope = scope;
+
+  auto bytes = c.bytes.fetch_add(size, std::memory_order_relaxed) + size;
+  auto peak = c.peakBytes.load(std::memory_order_relaxed);
+  while (bytes > peak &&
+         !c.peakBytes.compare_exchange_weak(peak, bytes,
+                                            std::memory_order_relaxed)) {
+  }
+  c.allocations.fetch_add(1, std::memory_order_relaxed);
+  c.totalAllocations.fetch_add(1, std::memory_order_relaxed);
+  return p;
+}
+
+void VKAPI_PTR Free(void *, void *p) {
+  if (!p) {
+    return;
+  }
+  auto header = reinterpret_cast<Header *>(p) - 1;
+  auto &c = g_counters[header->scope];
+  c.bytes.fetch_sub(header->size, std::memory_order_relaxed);
+  c.allocations.fetch_sub(1, std::memory_order_relaxed);
+  if (header->arena) {
+    Release(static_cast<ArenaChunk *>(header->base));
+  } else {
+    free(header->base);
+  }
+}
+
+void *VKAPI_PTR Reallocate(void *userData, void *original, size_t size,
+                           size_t alignment, VkSystemAllocationScope scope) {
+  if (!original) {
+    return Allocate(userData, size, alignment, scope);
+  }
+  if (size == 0) {
+    Free(userData, original);
+    return nullptr;
+  }
+  auto p = Allocate(userData, size, alignment, scope);
+  if (!p) {
+    // original stays valid
+    return nullptr;
+  }
+  auto header = reinterpret_cast<Header *>(original) - 1;
+  memcpy(p, original, std::min(header->size, size));
+  Free(userData, original);
+  return p;
+}
+
+void VKAPI_PTR InternalAllocation(void *, size_t size,
+                                  VkInternalAllocationType,
+                                  VkSystemAllocationScope scope) {
+  g_counters[scope].internalBytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+void VKAPI_PTR InternalFree(void *, size_t size, VkInternalAllocationType,
+                            VkSystemAllocationScope scope) {
+  g_counters[scope].internalBytes.fetch_sub(size, std::memory_order_relaxed);
+}
+
+const VkAllocationCallbacks g_callbacks = {
+    nullptr, Allocate, Reallocate, Free, InternalAllocation, InternalFree,
+};
+
+} // namespace
+
+namespace Vulkan {
+
+void EnableAllocationTracking() { g_enabled = true; }
+
+const VkAllocationCallbacks *AllocationCallbacks() {
+  return g_enabled ? &g_callbacks : nullptr;
+}
+
+AllocationStats GetAllocationStats() {
+  AllocationStats stats;
+  for (size_t i = 0; i < stats.size(); ++i) {
+    auto &c = g_counters[i];
+    stats[i].bytes = c.bytes.load(std::memory_order_relaxed);
+    stats[i].allocations = c.allocations.load(std::memory_order_relaxed);
+    stats[i].peakBytes = c.peakBytes.load(std::memory_order_relaxed);
+    stats[i].totalAllocations =
+        c.totalAllocations.load(std::memory_order_relaxed);
+    stats[i].arenaAllocations =
+        c.arenaAllocations.load(std::memory_order_relaxed);
+    stats[i].internalBytes = c.internalBytes.load(std::memory_order_relaxed);
+  }
+  return stats;
+}
+
+void PrintAllocationStats(std::ostream &os) {
+  static const char *names[] = {"command", "object", "cache", "device",
+                                "instance"};
+  auto stats = GetAllocationStats();
+  for (size_t i = 0; i < stats.size(); ++i) {
+    auto &s = stats[i];
+    os << "host memory " << names[i] << ": " << s.bytes << " bytes in "
+       << s.allocations << " live, peak " << s.peakBytes << " bytes, "
+       << s.totalAllocations << " total (" << s.arenaAllocations
+       << " arena), internal " << s.internalBytes << " bytes" << std::endl;
+  }
+}
+
+} // namespace Vulkan
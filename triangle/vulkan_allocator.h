@@ -0,0 +1,42 @@
+#pragma once
+#include <array>
+#include <ostream>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+namespace Vulkan {
+
+//
+// Host memory the driver allocates through VkAllocationCallbacks.
+//
+// Every vkCreate* / vkDestroy* / vkAllocateMemory / vkFreeMemory call passes
+// AllocationCallbacks(), which stays nullptr (driver allocator) unless
+// EnableAllocationTracking() was called before the instance was created.
+// Once enabled, allocations are counted per VkSystemAllocationScope, and
+// small COMMAND scope allocations (command buffer recording, the hot path)
+// come from a per-thread bump arena instead of the heap.
+//
+struct AllocationScopeStats {
+  // live
+  uint64_t bytes = 0;
+  uint64_t allocations = 0;
+  uint64_t peakBytes = 0;
+  // since start
+  uint64_t totalAllocations = 0;
+  // served by the command arena
+  uint64_t arenaAllocations = 0;
+  // driver internal allocations it only reported
+  uint64_t internalBytes = 0;
+};
+
+using AllocationStats =
+    std::array<AllocationScopeStats, VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1>;
+
+// must precede vkCreateInstance; objects created before then would be freed
+// with mismatching callbacks
+void EnableAllocationTracking();
+const VkAllocationCallbacks *AllocationCallbacks();
+AllocationStats GetAllocationStats();
+void PrintAllocationStats(std::ostream &os);
+
+} // namespace Vulkan
@@ -0,0 +1,240 @@
+#include "vulkan_barrier.h"
+#include "vulkan_dispatch.h"
+
+static const VkAccessFlags2 WRITE_ACCESS =
+    VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT |
+    VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+    VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_HOST_WRITE_BIT |
+    VK_ACCESS_2_MEMORY_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+
+static bool IsWrite(VkAccessFlags2 access) {
+  return (access & WRITE_ACCESS) != 0;
+}
+
+// synchronization2 only bits folded back into their VkPipelineStageFlags
+// equivalents
+static VkPipelineStageFlags ToLegacyStage(VkPipelineStageFlags2 stage,
+                                          VkPipelineStageFlags none) {
+  VkPipelineStageFlags legacy =
+      static_cast<VkPipelineStageFlags>(stage & 0xFFFFFFFFull);
+  if (stage & (VK_PIPELINE_STAGE_2_COPY_BIT | VK_PIPELINE_STAGE_2_RESOLVE_BIT |
+               VK_PIPELINE_STAGE_2_BLIT_BIT | VK_PIPELINE_STAGE_2_CLEAR_BIT)) {
+    legacy |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+  }
+  if (stage & (VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT |
+               VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT)) {
+    legacy |= VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+  }
+  if (stage & VK_PIPELINE_STAGE_2_PRE_RASTERIZATION_SHADERS_BIT) {
+    legacy |= VK_PIPELINE_STAGE_VERTEX_SHADER_BIT;
+  }
+  return legacy ? legacy : none;
+}
+
+static VkAccessFlags ToLegacyAccess(VkAccessFlags2 access) {
+  VkAccessFlags legacy =
+      static_cast<VkAccessFlags>(access & 0xFFFFFFFFull);
+  if (access & (VK_ACCESS_2_SHADER_SAMPLED_READ_BIT |
+                VK_ACCESS_2_SHADER_STORAGE_READ_BIT)) {
+    legacy |= VK_ACCESS_SHADER_READ_BIT;
+  }
+  if (access & VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT) {
+    legacy |= VK_ACCESS_SHADER_WRITE_BIT;
+  }
+  return legacy;
+}
+
+namespace Vulkan {
+
+void BarrierTracker::Import(VkImage image, const ResourceState &state,
+                            VkImageAspectFlags aspect) {
+  Tracked t;
+  t.writeStage = state.stage;
+  t.writeAccess = state.access;
+  t.layout = state.layout;
+  t.aspect = aspect;
+  images_[image] = t;
+}
+
+void BarrierTracker::Import(VkBuffer buffer, const ResourceState &state) {
+  Tracked t;
+  t.writeStage = state.stage;
+  t.writeAccess = state.access;
+  buffers_[buffer] = t;
+}
+
+VkImageLayout BarrierTracker::Layout(VkImage image) const {
+  auto found = images_.find(image);
+  if (found == images_.end()) {
+    return VK_IMAGE_LAYOUT_UNDEFINED;
+  }
+  return found->second.layout;
+}
+
+// Returns true if a barrier is needed before (stage, access) and updates the
+// tracked state as if it had been recorded.
+bool BarrierTracker::Access(Tracked &t, VkPipelineStageFlags2 stage,
+                            VkAccessFlags2 access, bool layoutChange,
+                            VkPipelineStageFlags2 *srcStage,
+                            VkAccessFlags2 *srcAccess) {
+  if (IsWrite(access) || layoutChange) {
+    // WAW / WAR / layout transition: wait for the last write and every read
+    // since then
+    *srcStage = t.writeStage | t.readStage;
+    *srcAccess = t.writeAccess;
+    bool needed = layoutChange || *srcStage != VK_PIPELINE_STAGE_2_NONE;
+    if (IsWrite(access)) {
+      t.writeStage = stage;
+      t.writeAccess = access;
+      t.readStage = VK_PIPELINE_STAGE_2_NONE;
+      t.readAccess = VK_ACCESS_2_NONE;
+    } else {
+      // the transition is complete and visible once `stage` is reached;
+      // later readers only need to chain on it
+      t.writeStage = stage;
+      t.writeAccess = VK_ACCESS_2_NONE;
+      t.readStage = stage;
+      t.readAccess = access;
+    }
+    return needed;
+  }
+
+  // RAR, or RAW that an earlier barrier already made visible
+  if ((t.readStage & stage) == stage && (t.readAccess & access) == access) {
+    return false;
+  }
+  *srcStage = t.writeStage;
+  *srcAccess = t.writeAccess;
+  t.readStage |= stage;
+  t.readAccess |= access;
+  return t.writeStage != VK_PIPELINE_STAGE_2_NONE ||
+         t.writeAccess != VK_ACCESS_2_NONE;
+}
+
+void BarrierTracker::Image(VkImage image, VkPipelineStageFlags2 stage,
+                           VkAccessFlags2 access, VkImageLayout layout) {
+  auto &t = images_[image];
+
+  if (t.pending >= 0) {
+    // nothing was recorded since the queued barrier, widen it instead of
+    // adding a second one
+    auto &barrier = imageBarriers_[t.pending];
+    barrier.dstStageMask |= stage;
+    barrier.dstAccessMask |= access;
+    barrier.newLayout = layout;
+    t.layout = layout;
+    if (IsWrite(access)) {
+      t.writeStage |= stage;
+      t.writeAccess |= access;
+      t.readStage = VK_PIPELINE_STAGE_2_NONE;
+      t.readAccess = VK_ACCESS_2_NONE;
+    } else {
+      t.readStage |= stage;
+      t.readAccess |= access;
+    }
+    return;
+  }
+
+  VkPipelineStageFlags2 srcStage = VK_PIPELINE_STAGE_2_NONE;
+  VkAccessFlags2 srcAccess = VK_ACCESS_2_NONE;
+  auto oldLayout = t.layout;
+  if (!Access(t, stage, access, oldLayout != layout, &srcStage, &srcAccess)) {
+    return;
+  }
+  t.layout = layout;
+
+  VkImageMemoryBarrier2 barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+  barrier.srcStageMask = srcStage;
+  barrier.srcAccessMask = srcAccess;
+  barrier.dstStageMask = stage;
+  barrier.dstAccessMask = access;
+  barrier.oldLayout = oldLayout;
+  barrier.newLayout = layout;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = image;
+  barrier.subresourceRange.aspectMask = t.aspect;
+  barrier.subresourceRange.baseMipLevel = 0;
+  barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+  t.pending = static_cast<int>(imageBarriers_.size());
+  imageBarriers_.push_back(barrier);
+}
+
+void BarrierTracker::Buffer(VkBuffer buffer, VkPipelineStageFlags2 stage,
+                            VkAccessFlags2 access) {
+  auto &t = buffers_[buffer];
+
+  VkPipelineStageFlags2 srcStage = VK_PIPELINE_STAGE_2_NONE;
+  VkAccessFlags2 srcAccess = VK_ACCESS_2_NONE;
+  if (!Access(t, stage, access, false, &srcStage, &srcAccess)) {
+    return;
+  }
+
+  // buffer barriers buy nothing over a global memory barrier on current
+  // hardware, so all buffer hazards of a batch collapse into one
+  memoryBarrier_.srcStageMask |= srcStage;
+  memoryBarrier_.srcAccessMask |= srcAccess;
+  memoryBarrier_.dstStageMask |= stage;
+  memoryBarrier_.dstAccessMask |= access;
+}
+
+void BarrierTracker::Flush(VkCommandBuffer commandBuffer) {
+  bool hasMemoryBarrier = memoryBarrier_.dstStageMask != 0;
+  if (imageBarriers_.empty() && !hasMemoryBarrier) {
+    return;
+  }
+
+  if (synchronization2_) {
+    memoryBarrier_.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+    VkDependencyInfo dependencyInfo{};
+    dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependencyInfo.memoryBarrierCount = hasMemoryBarrier ? 1 : 0;
+    dependencyInfo.pMemoryBarriers = &memoryBarrier_;
+    dependencyInfo.imageMemoryBarrierCount =
+        static_cast<uint32_t>(imageBarriers_.size());
+    dependencyInfo.pImageMemoryBarriers = imageBarriers_.data();
+    vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+  } else {
+    // legacy barriers share one stage pair per call
+    VkPipelineStageFlags2 srcStage = memoryBarrier_.srcStageMask;
+    VkPipelineStageFlags2 dstStage = memoryBarrier_.dstStageMask;
+    std::vector<VkImageMemoryBarrier> imageBarriers;
+    imageBarriers.reserve(imageBarriers_.size());
+    for (auto &b : imageBarriers_) {
+      srcStage |= b.srcStageMask;
+      dstStage |= b.dstStageMask;
+      VkImageMemoryBarrier barrier{};
+      barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+      barrier.srcAccessMask = ToLegacyAccess(b.srcAccessMask);
+      barrier.dstAccessMask = ToLegacyAccess(b.dstAccessMask);
+      barrier.oldLayout = b.oldLayout;
+      barrier.newLayout = b.newLayout;
+      barrier.srcQueueFamilyIndex = b.srcQueueFamilyIndex;
+      barrier.dstQueueFamilyIndex = b.dstQueueFamilyIndex;
+      barrier.image = b.image;
+      barrier.subresourceRange = b.subresourceRange;
+      imageBarriers.push_back(barrier);
+    }
+    VkMemoryBarrier memoryBarrier{};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = ToLegacyAccess(memoryBarrier_.srcAccessMask);
+    memoryBarrier.dstAccessMask = ToLegacyAccess(memoryBarrier_.dstAccessMask);
+    vkCmdPipelineBarrier(
+        commandBuffer,
+        ToLegacyStage(srcStage, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT),
+        ToLegacyStage(dstStage, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT), 0,
+        hasMemoryBarrier ? 1 : 0, &memoryBarrier, 0, nullptr,
+        static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+  }
+
+  for (auto &b : imageBarriers_) {
+    images_[b.image].pending = -1;
+  }
+  imageBarriers_.clear();
+  memoryBarrier_ = {};
+}
+
+} // namespace Vulkan
@@ -0,0 +1,68 @@
+#pragma once
+#include <unordered_map>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace Vulkan {
+
+struct ResourceState {
+  VkPipelineStageFlags2 stage = VK_PIPELINE_STAGE_2_NONE;
+  VkAccessFlags2 access = VK_ACCESS_2_NONE;
+  VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+};
+
+//
+// Tracks the last write and the reads since then for each image / buffer and
+// turns requested accesses into the minimal set of barriers. Requests are
+// batched until Flush(), which emits a single vkCmdPipelineBarrier2
+// (VK_KHR_synchronization2) or, without it, a single vkCmdPipelineBarrier.
+//
+// State is tracked per whole resource, not per mip level / array layer.
+//
+class BarrierTracker {
+  struct Tracked {
+    // last write, made available by the barrier that follows it
+    VkPipelineStageFlags2 writeStage = VK_PIPELINE_STAGE_2_NONE;
+    VkAccessFlags2 writeAccess = VK_ACCESS_2_NONE;
+    // stages / accesses that already see the last write
+    VkPipelineStageFlags2 readStage = VK_PIPELINE_STAGE_2_NONE;
+    VkAccessFlags2 readAccess = VK_ACCESS_2_NONE;
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+    // index into imageBarriers_ while a barrier is pending, else -1
+    int pending = -1;
+  };
+  bool synchronization2_;
+  std::unordered_map<VkImage, Tracked> images_;
+  std::unordered_map<VkBuffer, Tracked> buffers_;
+  std::vector<VkImageMemoryBarrier2> imageBarriers_;
+  VkMemoryBarrier2 memoryBarrier_{};
+
+  bool Access(Tracked &t, VkPipelineStageFlags2 stage, VkAccessFlags2 access,
+              bool layoutChange, VkPipelineStageFlags2 *srcStage,
+              VkAccessFlags2 *srcAccess);
+
+public:
+  explicit BarrierTracker(bool synchronization2)
+      : synchronization2_(synchronization2) {}
+
+  // (re)start tracking with a known state, e.g. a freshly acquired swapchain
+  // image is {COLOR_ATTACHMENT_OUTPUT, NONE, UNDEFINED}
+  void Import(VkImage image, const ResourceState &state,
+              VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT);
+  void Import(VkBuffer buffer, const ResourceState &state);
+  void Forget(VkImage image) { images_.erase(image); }
+  void Forget(VkBuffer buffer) { buffers_.erase(buffer); }
+  VkImageLayout Layout(VkImage image) const;
+
+  // declare the next use of a resource; queues a barrier if required
+  void Image(VkImage image, VkPipelineStageFlags2 stage, VkAccessFlags2 access,
+             VkImageLayout layout);
+  void Buffer(VkBuffer buffer, VkPipelineStageFlags2 stage,
+              VkAccessFlags2 access);
+
+  // record every queued barrier in one call
+  void Flush(VkCommandBuffer commandBuffer);
+};
+
+} // namespace Vulkan
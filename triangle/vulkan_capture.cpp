@@ -0,0 +1,187 @@
+#include "vulkan_capture.h"
+#include "vulkan_allocator.h"
+#include "vulkan_dispatch.h"
+#include "vulkan_memory.h"
+
+namespace Vulkan {
+
+Capture::~Capture() {
+  // drain the writer before the mappings go away
+  writer_ = nullptr;
+  for (auto &slot : slots_) {
+    if (slot.mapped) {
+      vkUnmapMemory(device_, slot.memory);
+    }
+    vkDestroyBuffer(device_, slot.buffer, AllocationCallbacks());
+    vkFreeMemory(device_, slot.memory, AllocationCallbacks());
+  }
+}
+
+std::shared_ptr<Capture>
+Capture::Create(VkDevice device, VkPhysicalDevice physicalDevice,
+                VkFormat format, VkExtent2D extent, const std::string &path,
+                FrameWriter::Format fileFormat, uint32_t frameRate,
+                uint32_t ringSize) {
+  bool bgra;
+  switch (format) {
+  case VK_FORMAT_B8G8R8A8_UNORM:
+  case VK_FORMAT_B8G8R8A8_SRGB:
+    bgra = true;
+    break;
+  case VK_FORMAT_R8G8B8A8_UNORM:
+  case VK_FORMAT_R8G8B8A8_SRGB:
+    bgra = false;
+    break;
+  default:
+    return nullptr;
+  }
+
+  auto ptr = std::shared_ptr<Capture>(
+      new Capture(device, extent, bgra, ringSize));
+  ptr->writer_ = FrameWriter::Create(path, fileFormat, frameRate);
+  if (!ptr->writer_) {
+    return nullptr;
+  }
+
+  VkBufferCreateInfo bufferInfo{};
+  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.size = static_cast<VkDeviceSize>(extent.width) * extent.height * 4;
+  bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  for (auto &slot : ptr->slots_) {
+    if (vkCreateBuffer(device, &bufferInfo, AllocationCallbacks(),
+                       &slot.buffer) != VK_SUCCESS) {
+      // throw std::runtime_error("failed to create readback buffer!");
+      return nullptr;
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(device, slot.buffer, &memRequirements);
+    // the CPU reads every byte: cached beats coherent
+    auto memoryType = FindMemoryType(physicalDevice,
+                                     memRequirements.memoryTypeBits,
+                                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                         VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+    ptr->coherent_ = !memoryType;
+    if (!memoryType) {
+      memoryType = FindMemoryType(physicalDevice,
+                                  memRequirements.memoryTypeBits,
+                                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    }
+    if (!memoryType) {
+      return nullptr;
+    }
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = *memoryType;
+    if (vkAllocateMemory(device, &allocInfo, AllocationCallbacks(),
+                         &slot.memory) != VK_SUCCESS) {
+      // throw std::runtime_error("failed to allocate readback memory!");
+      return nullptr;
+    }
+    vkBindBufferMemory(device, slot.buffer, slot.memory, 0);
+
+    void *mapped;
+    if (vkMapMemory(device, slot.memory, 0, VK_WHOLE_SIZE, 0, &mapped) !=
+        VK_SUCCESS) {
+      return nullptr;
+    }
+    slot.mapped = static_cast<uint8_t *>(mapped);
+  }
+
+  return ptr;
+}
+
+VkBuffer Capture::Begin() {
+  current_ = nullptr;
+  for (auto &slot : slots_) {
+    if (slot.state.load(std::memory_order_acquire) == Free) {
+      current_ = &slot;
+      break;
+    }
+  }
+  if (!current_) {
+    ++dropped_;
+    return VK_NULL_HANDLE;
+  }
+  current_->frame = frames_++;
+  current_->state.store(InFlight, std::memory_order_relaxed);
+  return current_->buffer;
+}
+
+void Capture::Record(VkCommandBuffer commandBuffer, VkImage image) {
+  if (!current_) {
+    return;
+  }
+
+  VkBufferImageCopy region{};
+  region.bufferOffset = 0;
+  // tightly packed
+  region.bufferRowLength = 0;
+  region.bufferImageHeight = 0;
+  region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  region.imageSubresource.mipLevel = 0;
+  region.imageSubresource.baseArrayLayer = 0;
+  region.imageSubresource.layerCount = 1;
+  region.imageOffset = {0, 0, 0};
+  region.imageExtent = {extent_.width, extent_.height, 1};
+  vkCmdCopyImageToBuffer(commandBuffer, image,
+                         VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                         current_->buffer, 1, &region);
+}
+
+void Capture::Record(VkCommandBuffer commandBuffer, BarrierTracker &barriers,
+                     VkImage image, const ResourceState &state) {
+  if (!current_) {
+    return;
+  }
+  barriers.Import(image, state);
+  barriers.Image(image, VK_PIPELINE_STAGE_2_COPY_BIT,
+                 VK_ACCESS_2_TRANSFER_READ_BIT,
+                 VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+  barriers.Import(current_->buffer, {});
+  barriers.Buffer(current_->buffer, VK_PIPELINE_STAGE_2_COPY_BIT,
+                  VK_ACCESS_2_TRANSFER_WRITE_BIT);
+  barriers.Flush(commandBuffer);
+  Record(commandBuffer, image);
+  // the semaphore signal at submit covers the present
+  barriers.Image(image, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE,
+                 state.layout);
+  barriers.Buffer(current_->buffer, HOST_READ.stage, HOST_READ.access);
+  barriers.Flush(commandBuffer);
+}
+
+void Capture::Collect() {
+  for (auto &slot : slots_) {
+    if (slot.state.load(std::memory_order_relaxed) != InFlight) {
+      continue;
+    }
+    if (!coherent_) {
+      VkMappedMemoryRange range{};
+      range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+      range.memory = slot.memory;
+      range.offset = 0;
+      range.size = VK_WHOLE_SIZE;
+      vkInvalidateMappedMemoryRanges(device_, 1, &range);
+    }
+    slot.state.store(Writing, std::memory_order_relaxed);
+    FrameWriter::Frame frame;
+    frame.pixels = slot.mapped;
+    frame.width = extent_.width;
+    frame.height = extent_.height;
+    frame.rowPitch = extent_.width * 4;
+    frame.bgra = bgra_;
+    frame.index = slot.frame;
+    frame.release = [s = &slot] {
+      s->state.store(Free, std::memory_order_release);
+    };
+    writer_->Push(frame);
+  }
+  current_ = nullptr;
+}
+
+} // namespace Vulkan
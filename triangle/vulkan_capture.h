@@ -0,0 +1,79 @@
+#pragma once
+#include "frame_writer.h"
+#include "vulkan_barrier.h"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace Vulkan {
+
+//
+// Asynchronous frame readback.
+//
+// Every captured frame is copied into one buffer of a small ring of
+// persistently mapped, host-visible buffers. Once the frame fence has
+// signaled the buffer is handed to a FrameWriter thread as is, and comes back
+// to the ring when the writer is done with it. If the writer falls behind the
+// frame is dropped instead of stalling the render loop.
+//
+class Capture {
+  enum State { Free, InFlight, Writing };
+
+  struct Slot {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    uint8_t *mapped = nullptr;
+    // Free -> InFlight (copy recorded) -> Writing (owned by the writer)
+    std::atomic<int> state{Free};
+    uint64_t frame = 0;
+  };
+
+  VkDevice device_;
+  VkExtent2D extent_;
+  bool bgra_;
+  bool coherent_ = false;
+  std::vector<Slot> slots_;
+  // reserved by Begin() for the frame being recorded
+  Slot *current_ = nullptr;
+  uint64_t frames_ = 0;
+  uint64_t dropped_ = 0;
+  std::shared_ptr<FrameWriter> writer_;
+
+  Capture(VkDevice device, VkExtent2D extent, bool bgra, uint32_t ringSize)
+      : device_(device), extent_(extent), bgra_(bgra), slots_(ringSize) {}
+
+public:
+  // the fence only makes device writes available to the device; the host
+  // read of the readback buffer needs its own dependency
+  static constexpr ResourceState HOST_READ = {VK_PIPELINE_STAGE_2_HOST_BIT,
+                                              VK_ACCESS_2_HOST_READ_BIT};
+
+  ~Capture();
+  // nullptr if the format is not an 8 bit RGBA / BGRA one or the output can
+  // not be opened
+  static std::shared_ptr<Capture>
+  Create(VkDevice device, VkPhysicalDevice physicalDevice, VkFormat format,
+         VkExtent2D extent, const std::string &path,
+         FrameWriter::Format fileFormat, uint32_t frameRate = 60,
+         uint32_t ringSize = 3);
+
+  // reserve a readback buffer for the frame about to be recorded;
+  // VK_NULL_HANDLE when every buffer is still in use (the frame is dropped)
+  VkBuffer Begin();
+  // copy `image` (in TRANSFER_SRC_OPTIMAL) into the reserved buffer; the
+  // caller declares the buffer's HOST_READ to its BarrierTracker
+  void Record(VkCommandBuffer commandBuffer, VkImage image);
+  // Record() with the transitions from / back to `state` around it, for
+  // callers that do not declare the copy to a RenderGraph
+  void Record(VkCommandBuffer commandBuffer, BarrierTracker &barriers,
+              VkImage image, const ResourceState &state);
+  // call once the fence of the frames recorded so far has signaled
+  void Collect();
+
+  uint64_t Frames() const { return frames_; }
+  uint64_t Dropped() const { return dropped_; }
+};
+
+} // namespace Vulkan
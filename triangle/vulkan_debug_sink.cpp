@@ -0,0 +1,247 @@
+#include "vulkan_debug_sink.h"
+#include <chrono>
+#include <functional>
+#include <stdio.h>
+#include <string.h>
+#include <string_view>
+
+namespace Vulkan {
+
+static constexpr uint64_t MUTED = 1ull << 32;
+
+static const char *SeverityName(VkDebugUtilsMessageSeverityFlagBitsEXT s) {
+  switch (s) {
+  case VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT:
+    return "verbose";
+  case VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT:
+    return "info";
+  case VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT:
+    return "warning";
+  default:
+    return "error";
+  }
+}
+
+// "[name 0x1234abcd]", the ID as --debug-mute takes it
+static std::string Label(const char *name, int32_t id) {
+  char hex[16];
+  snprintf(hex, sizeof(hex), "0x%08x", static_cast<uint32_t>(id));
+  return std::string("[") + name + " " + hex + "]";
+}
+
+// strncpy that always terminates and marks what it cut off
+static void CopyTruncated(char *dst, size_t size, const char *src) {
+  if (!src) {
+    dst[0] = 0;
+    return;
+  }
+  auto length = strlen(src);
+  if (length < size) {
+    memcpy(dst, src, length + 1);
+    return;
+  }
+  memcpy(dst, src, size - 4);
+  memcpy(dst + size - 4, "...", 4);
+}
+
+DebugSink::DebugSink(std::ostream &os)
+    : os_(os),
+      severities_(VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
+                  VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT),
+      types_(VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
+             VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
+             VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT) {}
+
+DebugSink::~DebugSink() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_ = true;
+  }
+  wake_.notify_one();
+  thread_.join();
+}
+
+std::shared_ptr<DebugSink> DebugSink::Create(std::ostream &os) {
+  auto ptr = std::shared_ptr<DebugSink>(new DebugSink(os));
+  ptr->thread_ = std::thread(&DebugSink::Loop, ptr.get());
+  return ptr;
+}
+
+bool DebugSink::Accept(VkDebugUtilsMessageSeverityFlagBitsEXT severity,
+                       VkDebugUtilsMessageTypeFlagsEXT type,
+                       int32_t id) const {
+  if (!(severities_.load(std::memory_order_relaxed) & severity) ||
+      !(types_.load(std::memory_order_relaxed) & type)) {
+    return false;
+  }
+  auto key = MUTED | static_cast<uint32_t>(id);
+  for (auto &muted : muted_) {
+    if (muted.load(std::memory_order_relaxed) == key) {
+      return false;
+    }
+  }
+  return true;
+}
+
+VKAPI_ATTR VkBool32 VKAPI_CALL
+DebugSink::Callback(VkDebugUtilsMessageSeverityFlagBitsEXT severity,
+                    VkDebugUtilsMessageTypeFlagsEXT type,
+                    const VkDebugUtilsMessengerCallbackDataEXT *data,
+                    void *user) {
+  auto self = static_cast<DebugSink *>(user);
+  if (!self->Accept(severity, type, data->messageIdNumber)) {
+    return VK_FALSE;
+  }
+  Message message;
+  message.severity = severity;
+  message.type = type;
+  message.id = data->messageIdNumber;
+  CopyTruncated(message.name, sizeof(message.name), data->pMessageIdName);
+  CopyTruncated(message.text, sizeof(message.text), data->pMessage);
+  if (!self->queue_.Push(message)) {
+    self->dropped_.fetch_add(1, std::memory_order_relaxed);
+  }
+  return VK_FALSE;
+}
+
+bool DebugSink::Mute(int32_t id) {
+  auto key = MUTED | static_cast<uint32_t>(id);
+  for (auto &muted : muted_) {
+    if (muted.load(std::memory_order_relaxed) == key) {
+      return true;
+    }
+  }
+  for (auto &muted : muted_) {
+    if (muted.load(std::memory_order_relaxed) == 0) {
+      muted.store(key, std::memory_order_relaxed);
+      return true;
+    }
+  }
+  return false;
+}
+
+void DebugSink::Unmute(int32_t id) {
+  auto key = MUTED | static_cast<uint32_t>(id);
+  for (auto &muted : muted_) {
+    if (muted.load(std::memory_order_relaxed) == key) {
+      muted.store(0, std::memory_order_relaxed);
+    }
+  }
+}
+
+void DebugSink::Loop() {
+  using Clock = std::chrono::steady_clock;
+  auto lastReport = Clock::now();
+  std::string out;
+  for (;;) {
+    bool quit;
+    {
+      // the callback never signals: it would have to lock
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait_for(lock, std::chrono::milliseconds(10),
+                     [this] { return quit_; });
+      quit = quit_;
+    }
+    Drain(&out);
+    if (quit || Clock::now() - lastReport >= std::chrono::seconds(1)) {
+      Report(&out);
+      lastReport = Clock::now();
+    }
+    if (!out.empty()) {
+      os_ << out << std::flush;
+      out.clear();
+    }
+    if (quit) {
+      return;
+    }
+  }
+}
+
+// first occurrences in full, repeats only counted
+void DebugSink::Drain(std::string *out) {
+  Message message;
+  while (queue_.Pop(&message)) {
+    // messages without an ID are told apart by their text
+    uint64_t key = message.id
+                       ? static_cast<uint32_t>(message.id)
+                       : std::hash<std::string_view>{}(message.text) | MUTED;
+    auto &repeats = repeats_[key];
+    if (repeats.total++) {
+      ++repeats.pending;
+      continue;
+    }
+    repeats.name = message.id ? Label(message.name, message.id)
+                              : "\"" + std::string(message.text) + "\"";
+    *out += "validation layer ";
+    *out += SeverityName(message.severity);
+    if (message.id) {
+      *out += " " + repeats.name;
+    }
+    *out += ": ";
+    *out += message.text;
+    *out += '\n';
+  }
+}
+
+void DebugSink::Report(std::string *out) {
+  for (auto &[key, repeats] : repeats_) {
+    if (!repeats.pending) {
+      continue;
+    }
+    *out += "validation layer " + repeats.name + " repeated " +
+            std::to_string(repeats.pending) + " times, " +
+            std::to_string(repeats.total) + " in total\n";
+    repeats.pending = 0;
+  }
+  auto dropped = Dropped();
+  if (dropped != droppedReported_) {
+    *out += "validation layer: " + std::to_string(dropped - droppedReported_) +
+            " messages dropped, the ring was full\n";
+    droppedReported_ = dropped;
+  }
+}
+
+bool DebugSink::ParseSeverity(const std::string &name,
+                              VkDebugUtilsMessageSeverityFlagsEXT *severities) {
+  static const VkDebugUtilsMessageSeverityFlagBitsEXT all[] = {
+      VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT,
+      VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT,
+      VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT,
+      VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT,
+  };
+  for (size_t i = 0; i < 4; ++i) {
+    if (name == SeverityName(all[i])) {
+      *severities = 0;
+      for (; i < 4; ++i) {
+        *severities |= all[i];
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+bool DebugSink::ParseTypes(const std::string &names,
+                           VkDebugUtilsMessageTypeFlagsEXT *types) {
+  *types = 0;
+  size_t begin = 0;
+  for (;;) {
+    auto end = names.find(',', begin);
+    auto name = names.substr(begin, end - begin);
+    if (name == "general") {
+      *types |= VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT;
+    } else if (name == "validation") {
+      *types |= VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT;
+    } else if (name == "performance") {
+      *types |= VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+    } else {
+      return false;
+    }
+    if (end == std::string::npos) {
+      return true;
+    }
+    begin = end + 1;
+  }
+}
+
+} // namespace Vulkan
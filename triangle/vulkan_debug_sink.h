@@ -0,0 +1,108 @@
+#pragma once
+#include "mpsc_queue.h"
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vulkan/vulkan.h>
+
+namespace Vulkan {
+
+//
+// VK_EXT_debug_utils messages, off the calling thread.
+//
+// The callback runs inside driver and layer calls on whatever thread made
+// them. It only checks the filters, copies the message into a lock-free
+// ring and returns; nothing there allocates, locks or does I/O. A
+// background thread drains the ring, prints the first occurrence of every
+// message ID and folds the repeats into one count per ID and interval.
+// Messages arriving while the ring is full are counted as dropped.
+//
+// Filters are atomics, changeable at any time.
+//
+class DebugSink {
+public:
+  static constexpr size_t MAX_TEXT = 2048;
+  static constexpr size_t MAX_MUTED = 32;
+
+  struct Message {
+    VkDebugUtilsMessageSeverityFlagBitsEXT severity;
+    VkDebugUtilsMessageTypeFlagsEXT type;
+    int32_t id;
+    // pMessageIdName, truncated
+    char name[64];
+    // pMessage, truncated
+    char text[MAX_TEXT];
+  };
+
+private:
+  std::ostream &os_;
+  MpscQueue<Message, 256> queue_;
+  std::atomic<VkDebugUtilsMessageSeverityFlagsEXT> severities_;
+  std::atomic<VkDebugUtilsMessageTypeFlagsEXT> types_;
+  // MUTED | uint32_t id per slot, 0: free
+  std::array<std::atomic<uint64_t>, MAX_MUTED> muted_{};
+  std::atomic<uint64_t> dropped_{0};
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  bool quit_ = false;
+  std::thread thread_;
+
+  // drain thread only
+  struct Repeats {
+    std::string name;
+    uint64_t total = 0;
+    // since the last report
+    uint64_t pending = 0;
+  };
+  std::unordered_map<uint64_t, Repeats> repeats_;
+  uint64_t droppedReported_ = 0;
+
+  DebugSink(std::ostream &os);
+  bool Accept(VkDebugUtilsMessageSeverityFlagBitsEXT severity,
+              VkDebugUtilsMessageTypeFlagsEXT type, int32_t id) const;
+  void Loop();
+  void Drain(std::string *out);
+  void Report(std::string *out);
+
+public:
+  ~DebugSink();
+  DebugSink(const DebugSink &) = delete;
+  DebugSink &operator=(const DebugSink &) = delete;
+  static std::shared_ptr<DebugSink> Create(std::ostream &os);
+
+  // pfnUserCallback, with this sink as pUserData
+  static VKAPI_ATTR VkBool32 VKAPI_CALL
+  Callback(VkDebugUtilsMessageSeverityFlagBitsEXT severity,
+           VkDebugUtilsMessageTypeFlagsEXT type,
+           const VkDebugUtilsMessengerCallbackDataEXT *data, void *user);
+
+  // default: WARNING | ERROR
+  void SetSeverities(VkDebugUtilsMessageSeverityFlagsEXT severities) {
+    severities_.store(severities, std::memory_order_relaxed);
+  }
+  // default: every type
+  void SetTypes(VkDebugUtilsMessageTypeFlagsEXT types) {
+    types_.store(types, std::memory_order_relaxed);
+  }
+  // messageIdNumber; false when MAX_MUTED are muted already. Mute and
+  // Unmute from one thread at a time
+  bool Mute(int32_t id);
+  void Unmute(int32_t id);
+  uint64_t Dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+  // "verbose", "info", "warning" or "error": that severity and above
+  static bool ParseSeverity(const std::string &name,
+                            VkDebugUtilsMessageSeverityFlagsEXT *severities);
+  // comma separated "general", "validation", "performance"
+  static bool ParseTypes(const std::string &names,
+                         VkDebugUtilsMessageTypeFlagsEXT *types);
+};
+
+} // namespace Vulkan
@@ -0,0 +1,89 @@
+#include "vulkan_deletion_queue.h"
+#include "vulkan_allocator.h"
+#include "vulkan_dispatch.h"
+
+namespace Vulkan {
+
+void DeletionQueue::Push(const std::function<void()> &destroy) {
+  entries_.push_back({frame_, destroy});
+}
+
+void DeletionQueue::Destroy(VkBuffer buffer) {
+  if (buffer != VK_NULL_HANDLE) {
+    Push([d = device_, buffer] {
+      vkDestroyBuffer(d, buffer, AllocationCallbacks());
+    });
+  }
+}
+
+void DeletionQueue::Destroy(VkImage image) {
+  if (image != VK_NULL_HANDLE) {
+    Push([d = device_, image] {
+      vkDestroyImage(d, image, AllocationCallbacks());
+    });
+  }
+}
+
+void DeletionQueue::Destroy(VkImageView view) {
+  if (view != VK_NULL_HANDLE) {
+    Push([d = device_, view] {
+      vkDestroyImageView(d, view, AllocationCallbacks());
+    });
+  }
+}
+
+void DeletionQueue::Destroy(VkDeviceMemory memory) {
+  if (memory != VK_NULL_HANDLE) {
+    Push([d = device_, memory] {
+      vkFreeMemory(d, memory, AllocationCallbacks());
+    });
+  }
+}
+
+void DeletionQueue::Destroy(VkFramebuffer framebuffer) {
+  if (framebuffer != VK_NULL_HANDLE) {
+    Push([d = device_, framebuffer] {
+      vkDestroyFramebuffer(d, framebuffer, AllocationCallbacks());
+    });
+  }
+}
+
+void DeletionQueue::Destroy(VkRenderPass renderPass) {
+  if (renderPass != VK_NULL_HANDLE) {
+    Push([d = device_, renderPass] {
+      vkDestroyRenderPass(d, renderPass, AllocationCallbacks());
+    });
+  }
+}
+
+void DeletionQueue::Destroy(VkPipeline pipeline) {
+  if (pipeline != VK_NULL_HANDLE) {
+    Push([d = device_, pipeline] {
+      vkDestroyPipeline(d, pipeline, AllocationCallbacks());
+    });
+  }
+}
+
+void DeletionQueue::Destroy(VkPipelineLayout pipelineLayout) {
+  if (pipelineLayout != VK_NULL_HANDLE) {
+    Push([d = device_, pipelineLayout] {
+      vkDestroyPipelineLayout(d, pipelineLayout, AllocationCallbacks());
+    });
+  }
+}
+
+void DeletionQueue::Collect(uint64_t completed) {
+  while (!entries_.empty() && entries_.front().frame < completed) {
+    entries_.front().destroy();
+    entries_.pop_front();
+  }
+}
+
+void DeletionQueue::Flush() {
+  for (auto &entry : entries_) {
+    entry.destroy();
+  }
+  entries_.clear();
+}
+
+} // namespace Vulkan
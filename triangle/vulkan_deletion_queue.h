@@ -0,0 +1,52 @@
+#pragma once
+#include <deque>
+#include <functional>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+namespace Vulkan {
+
+//
+// Defers destruction of Vulkan objects until the GPU is done with them.
+//
+// Objects are tagged with the frame currently being recorded and freed in
+// bulk once every frame up to and including that one has completed, so a
+// resource can be replaced at runtime without vkDeviceWaitIdle.
+//
+class DeletionQueue {
+  struct Entry {
+    uint64_t frame;
+    std::function<void()> destroy;
+  };
+  VkDevice device_;
+  // ordered by frame
+  std::deque<Entry> entries_;
+  // frame being recorded == number of frames submitted so far
+  uint64_t frame_ = 0;
+
+public:
+  explicit DeletionQueue(VkDevice device) : device_(device) {}
+  // the device must be idle
+  ~DeletionQueue() { Flush(); }
+
+  uint64_t Frame() const { return frame_; }
+  // the frame being recorded was submitted
+  void NextFrame() { ++frame_; }
+
+  void Push(const std::function<void()> &destroy);
+  void Destroy(VkBuffer buffer);
+  void Destroy(VkImage image);
+  void Destroy(VkImageView view);
+  void Destroy(VkDeviceMemory memory);
+  void Destroy(VkFramebuffer framebuffer);
+  void Destroy(VkRenderPass renderPass);
+  void Destroy(VkPipeline pipeline);
+  void Destroy(VkPipelineLayout pipelineLayout);
+
+  // every frame before `completed` has finished on the GPU
+  void Collect(uint64_t completed);
+  // free everything regardless of frame
+  void Flush();
+};
+
+} // namespace Vulkan
@@ -1,20 +1,64 @@
 #include "vulkan_device.h"
+#include "vulkan_dispatch.h"
 #include "vulkan_swapchain.h"
+#include <cstring>
 #include <set>
 #include <vector>
 
 namespace Vulkan {
 
+static VkPhysicalDeviceVulkan13Features
+GetVulkan13Features(VkPhysicalDevice physicalDevice) {
+  VkPhysicalDeviceVulkan13Features features13{};
+  features13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+
+  // core 1.3 entry points need both the device and the instance at 1.3,
+  // else the renderpass path
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+  if (properties.apiVersion < VK_API_VERSION_1_3 ||
+      InstanceVersion() < VK_API_VERSION_1_3) {
+    return features13;
+  }
+
+  VkPhysicalDeviceFeatures2 features2{};
+  features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  features2.pNext = &features13;
+  vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+  features13.pNext = nullptr;
+  return features13;
+}
+
+static bool HasDeviceExtension(VkPhysicalDevice physicalDevice,
+                               const char *name) {
+  uint32_t extensionCount;
+  vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr,
+                                       &extensionCount, nullptr);
+  std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+  vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr,
+                                       &extensionCount,
+                                       availableExtensions.data());
+  for (const auto &extension : availableExtensions) {
+    if (strcmp(extension.extensionName, name) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
 std::shared_ptr<Device>
 Device::CreateLogicalDevice(VkPhysicalDevice physicalDevice_,
                             VkSurfaceKHR surface_,
-                            const std::vector<const char *> &deviceExtensions) {
+                            const std::vector<const char *> &deviceExtensions,
+                            bool enableDynamicRendering,
+                            bool enablePresentWait) {
   auto indices =
       Vulkan::QueueFamilyIndices::FindQueueFamilies(physicalDevice_, surface_);
 
   std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
   std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(),
-                                            indices.presentFamily.value()};
+                                            indices.presentFamily.value(),
+                                            indices.transferFamily.value()};
 
   float queuePriority = 1.0f;
   for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -26,7 +70,16 @@ Device::CreateLogicalDevice(VkPhysicalDevice physicalDevice_,
     queueCreateInfos.push_back(queueCreateInfo);
   }
 
+  VkPhysicalDeviceFeatures supported;
+  vkGetPhysicalDeviceFeatures(physicalDevice_, &supported);
   VkPhysicalDeviceFeatures deviceFeatures{};
+  // GPU driven draws: one vkCmdDrawIndexedIndirect for every meshlet
+  deviceFeatures.multiDrawIndirect = supported.multiDrawIndirect;
+  deviceFeatures.drawIndirectFirstInstance =
+      supported.drawIndirectFirstInstance;
+  // GpuMetrics
+  deviceFeatures.pipelineStatisticsQuery = supported.pipelineStatisticsQuery;
+  deviceFeatures.occlusionQueryPrecise = supported.occlusionQueryPrecise;
 
   VkDeviceCreateInfo createInfo{};
   createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -37,9 +90,60 @@ Device::CreateLogicalDevice(VkPhysicalDevice physicalDevice_,
 
   createInfo.pEnabledFeatures = &deviceFeatures;
 
+  auto supported13 = GetVulkan13Features(physicalDevice_);
+  VkPhysicalDeviceVulkan13Features features13{};
+  features13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+  features13.dynamicRendering =
+      enableDynamicRendering ? supported13.dynamicRendering : VK_FALSE;
+  features13.synchronization2 = supported13.synchronization2;
+  if (features13.dynamicRendering || features13.synchronization2) {
+    createInfo.pNext = &features13;
+  }
+
+  // optional
+  auto enabledExtensions = deviceExtensions;
+  // read through vkGetPhysicalDeviceMemoryProperties2: needs a 1.1 instance
+  // or get_physical_device_properties2, else MemoryBudget counts its own
+  bool memoryBudget =
+      vkGetPhysicalDeviceMemoryProperties2 &&
+      HasDeviceExtension(physicalDevice_, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+  if (memoryBudget) {
+    enabledExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+  }
+  // present timing for frame pacing, only when asked for
+  VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+  presentIdFeatures.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+  VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+  presentWaitFeatures.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+  bool presentWait =
+      enablePresentWait &&
+      HasDeviceExtension(physicalDevice_, VK_KHR_PRESENT_ID_EXTENSION_NAME) &&
+      HasDeviceExtension(physicalDevice_, VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+  if (presentWait && !vkGetPhysicalDeviceFeatures2) {
+    // no way to ask for the features on a plain 1.0 instance
+    presentWait = false;
+  }
+  if (presentWait) {
+    VkPhysicalDeviceFeatures2 features2{};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.pNext = &presentIdFeatures;
+    presentIdFeatures.pNext = &presentWaitFeatures;
+    vkGetPhysicalDeviceFeatures2(physicalDevice_, &features2);
+    presentWait =
+        presentIdFeatures.presentId && presentWaitFeatures.presentWait;
+  }
+  if (presentWait) {
+    enabledExtensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+    enabledExtensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+    presentWaitFeatures.pNext = const_cast<void *>(createInfo.pNext);
+    createInfo.pNext = &presentIdFeatures;
+  }
+
   createInfo.enabledExtensionCount =
-      static_cast<uint32_t>(deviceExtensions.size());
-  createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+      static_cast<uint32_t>(enabledExtensions.size());
+  createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
   // if (enableValidationLayers) {
   //   createInfo.enabledLayerCount =
@@ -49,17 +153,33 @@ Device::CreateLogicalDevice(VkPhysicalDevice physicalDevice_,
   { createInfo.enabledLayerCount = 0; }
 
   auto ptr = std::shared_ptr<Device>(new Device);
-  if (vkCreateDevice(physicalDevice_, &createInfo, nullptr, &ptr->device_) !=
-      VK_SUCCESS) {
+  if (vkCreateDevice(physicalDevice_, &createInfo, AllocationCallbacks(),
+                     &ptr->device_) != VK_SUCCESS) {
     // throw std::runtime_error("failed to create logical device!");
     return nullptr;
   }
+  // straight to this device's driver, without the loader's trampoline
+  LoadDevice(ptr->device_, &ptr->table_);
+  UseDevice(ptr->table_);
+  auto &vk = ptr->table_;
+  ptr->dynamicRendering_ = features13.dynamicRendering == VK_TRUE;
+  ptr->synchronization2_ = features13.synchronization2 == VK_TRUE;
+  ptr->memoryBudget_ = memoryBudget;
+  ptr->indirectDraw_ = deviceFeatures.multiDrawIndirect &&
+                      deviceFeatures.drawIndirectFirstInstance;
+  ptr->pipelineStatistics_ = deviceFeatures.pipelineStatisticsQuery;
+  ptr->occlusionQueryPrecise_ = deviceFeatures.occlusionQueryPrecise;
+  ptr->presentWait_ = presentWait;
 
-  vkGetDeviceQueue(ptr->device_, indices.graphicsFamily.value(), 0,
-                   &ptr->graphicsQueue_);
+  vk.vkGetDeviceQueue(ptr->device_, indices.graphicsFamily.value(), 0,
+                      &ptr->graphicsQueue_);
   VkQueue presentQueue_;
-  vkGetDeviceQueue(ptr->device_, indices.presentFamily.value(), 0,
-                   &ptr->presentQueue_);
+  vk.vkGetDeviceQueue(ptr->device_, indices.presentFamily.value(), 0,
+                      &ptr->presentQueue_);
+  vk.vkGetDeviceQueue(ptr->device_, indices.transferFamily.value(), 0,
+                      &ptr->transferQueue_);
+  ptr->graphicsFamily_ = indices.graphicsFamily.value();
+  ptr->transferFamily_ = indices.transferFamily.value();
 
   VkSemaphoreCreateInfo semaphoreInfo{};
   semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -68,60 +188,99 @@ Device::CreateLogicalDevice(VkPhysicalDevice physicalDevice_,
   fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
   fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-  if (vkCreateSemaphore(ptr->device_, &semaphoreInfo, nullptr,
-                        &ptr->imageAvailableSemaphore_) != VK_SUCCESS ||
-      vkCreateSemaphore(ptr->device_, &semaphoreInfo, nullptr,
-                        &ptr->renderFinishedSemaphore_) != VK_SUCCESS ||
-      vkCreateFence(ptr->device_, &fenceInfo, nullptr, &ptr->inFlightFence_) !=
-          VK_SUCCESS) {
+  if (vk.vkCreateSemaphore(ptr->device_, &semaphoreInfo,
+                           AllocationCallbacks(),
+                           &ptr->renderFinishedSemaphore_) != VK_SUCCESS ||
+      vk.vkCreateFence(ptr->device_, &fenceInfo, AllocationCallbacks(),
+                       &ptr->inFlightFence_) != VK_SUCCESS) {
     // throw std::runtime_error(
     //     "failed to create synchronization objects for a frame!");
     return nullptr;
   }
 
+  ptr->deletionQueue_ = std::make_shared<DeletionQueue>(ptr->device_);
+
   return ptr;
 }
 
 void Device::Sync() {
-  vkWaitForFences(device_, 1, &inFlightFence_, VK_TRUE, UINT64_MAX);
-  vkResetFences(device_, 1, &inFlightFence_);
+  table_.vkWaitForFences(device_, 1, &inFlightFence_, VK_TRUE, UINT64_MAX);
+  table_.vkResetFences(device_, 1, &inFlightFence_);
+  // one frame in flight: everything submitted has completed
+  deletionQueue_->Collect(deletionQueue_->Frame());
 }
 
-void Device::Submit(const VkCommandBuffer *pCommandBuffer,
-                    VkSwapchainKHR swapchain, uint32_t imageIndex) {
+void Device::Submit(const std::vector<VkCommandBuffer> &commandBuffers,
+                    const std::vector<Present> &presents) {
   VkSubmitInfo submitInfo{};
   submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-  VkSemaphore waitSemaphores[] = {imageAvailableSemaphore_};
-  VkPipelineStageFlags waitStages[] = {
-      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-  submitInfo.waitSemaphoreCount = 1;
-  submitInfo.pWaitSemaphores = waitSemaphores;
-  submitInfo.pWaitDstStageMask = waitStages;
+  // offscreen: nothing was acquired and nothing is presented
+  bool present = !presents.empty();
+  for (auto &target : presents) {
+    waitSemaphores_.push_back(target.acquired);
+    waitStages_.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+  }
+  submitInfo.waitSemaphoreCount =
+      static_cast<uint32_t>(waitSemaphores_.size());
+  submitInfo.pWaitSemaphores = waitSemaphores_.data();
+  submitInfo.pWaitDstStageMask = waitStages_.data();
 
-  submitInfo.commandBufferCount = 1;
-  submitInfo.pCommandBuffers = pCommandBuffer;
+  submitInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+  submitInfo.pCommandBuffers = commandBuffers.data();
 
   VkSemaphore signalSemaphores[] = {renderFinishedSemaphore_};
-  submitInfo.signalSemaphoreCount = 1;
+  submitInfo.signalSemaphoreCount = present ? 1 : 0;
   submitInfo.pSignalSemaphores = signalSemaphores;
 
-  if (vkQueueSubmit(graphicsQueue_, 1, &submitInfo, inFlightFence_) !=
+  if (table_.vkQueueSubmit(graphicsQueue_, 1, &submitInfo, inFlightFence_) !=
       VK_SUCCESS) {
     throw std::runtime_error("failed to submit draw command buffer!");
   }
+  waitSemaphores_.clear();
+  waitStages_.clear();
+  deletionQueue_->NextFrame();
+  if (!present) {
+    return;
+  }
+
+  // every window in one call, so they flip together
+  std::vector<VkSwapchainKHR> swapChains;
+  std::vector<uint32_t> imageIndices;
+  for (auto &target : presents) {
+    swapChains.push_back(target.swapchain);
+    imageIndices.push_back(target.imageIndex);
+  }
 
   VkPresentInfoKHR presentInfo{};
   presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 
+  // the same id for every window
+  std::vector<uint64_t> presentIds;
+  VkPresentIdKHR presentId{};
+  if (presentWait_) {
+    presentIds.assign(swapChains.size(), ++presentId_);
+    presentId.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+    presentId.swapchainCount = static_cast<uint32_t>(presentIds.size());
+    presentId.pPresentIds = presentIds.data();
+    presentInfo.pNext = &presentId;
+  }
+
   presentInfo.waitSemaphoreCount = 1;
   presentInfo.pWaitSemaphores = signalSemaphores;
 
-  VkSwapchainKHR swapChains[] = {swapchain};
-  presentInfo.swapchainCount = 1;
-  presentInfo.pSwapchains = swapChains;
-  presentInfo.pImageIndices = &imageIndex;
-  vkQueuePresentKHR(presentQueue_, &presentInfo);
+  presentInfo.swapchainCount = static_cast<uint32_t>(swapChains.size());
+  presentInfo.pSwapchains = swapChains.data();
+  presentInfo.pImageIndices = imageIndices.data();
+  table_.vkQueuePresentKHR(presentQueue_, &presentInfo);
+}
+
+bool Device::WaitPresent(VkSwapchainKHR swapchain, uint64_t timeoutNs) {
+  if (!presentWait_ || !presentId_) {
+    return false;
+  }
+  return table_.vkWaitForPresentKHR(device_, swapchain, presentId_,
+                                    timeoutNs) == VK_SUCCESS;
 }
 
 } // namespace Vulkan
@@ -1,4 +1,7 @@
 #pragma once
+#include "vulkan_allocator.h"
+#include "vulkan_deletion_queue.h"
+#include "vulkan_dispatch.h"
 #include <memory>
 #include <vector>
 #include <vulkan/vulkan.h>
@@ -6,26 +9,78 @@
 namespace Vulkan {
 struct Device {
   VkDevice device_;
+  // device level entry points. Device and Renderer call through it; the
+  // rest of the sample calls the global vk* functions, which UseDevice()
+  // points at the table of the latest device created
+  DeviceTable table_;
   VkQueue graphicsQueue_;
   VkQueue presentQueue_;
-  VkSemaphore imageAvailableSemaphore_;
+  // uploads; may be graphicsQueue_ when there is no transfer-only family
+  VkQueue transferQueue_;
+  uint32_t graphicsFamily_;
+  uint32_t transferFamily_;
+  // signaled by the submit, waited on by the present of every swapchain
   VkSemaphore renderFinishedSemaphore_;
   VkFence inFlightFence_;
+  // VK_KHR_dynamic_rendering (core in 1.3) enabled on this device
+  bool dynamicRendering_ = false;
+  // VK_KHR_synchronization2 (core in 1.3) enabled on this device
+  bool synchronization2_ = false;
+  // VK_EXT_memory_budget enabled on this device
+  bool memoryBudget_ = false;
+  // multiDrawIndirect and drawIndirectFirstInstance enabled
+  bool indirectDraw_ = false;
+  // pipelineStatisticsQuery / occlusionQueryPrecise enabled
+  bool pipelineStatistics_ = false;
+  bool occlusionQueryPrecise_ = false;
+  // VK_KHR_present_id and VK_KHR_present_wait enabled: every present gets
+  // the next id, WaitPresent() waits for it to reach the screen
+  bool presentWait_ = false;
+  uint64_t presentId_ = 0;
+  // objects replaced at runtime, freed once the frames using them completed
+  std::shared_ptr<DeletionQueue> deletionQueue_;
+  // extra semaphores the next Submit() waits on, e.g. transfer queue uploads
+  std::vector<VkSemaphore> waitSemaphores_;
+  std::vector<VkPipelineStageFlags> waitStages_;
 
   Device() {}
   ~Device() {
-    vkDestroySemaphore(device_, renderFinishedSemaphore_, nullptr);
-    vkDestroySemaphore(device_, imageAvailableSemaphore_, nullptr);
-    vkDestroyFence(device_, inFlightFence_, nullptr);
-    vkDestroyDevice(device_, nullptr);
+    deletionQueue_ = nullptr;
+    table_.vkDestroySemaphore(device_, renderFinishedSemaphore_,
+                              AllocationCallbacks());
+    table_.vkDestroyFence(device_, inFlightFence_, AllocationCallbacks());
+    table_.vkDestroyDevice(device_, AllocationCallbacks());
   }
   static std::shared_ptr<Device>
   CreateLogicalDevice(VkPhysicalDevice physicalDevice_, VkSurfaceKHR surface_,
-                      const std::vector<const char *> &deviceExtensions);
-  void Wait() { vkDeviceWaitIdle(device_); }
+                      const std::vector<const char *> &deviceExtensions,
+                      bool enableDynamicRendering,
+                      bool enablePresentWait = false);
+  void Wait() { table_.vkDeviceWaitIdle(device_); }
   void Sync();
-  void Submit(const VkCommandBuffer *pCommandBuffer, VkSwapchainKHR swapchain,
-              uint32_t imageIndex);
+  // until the frame in flight has completed, without taking its fence
+  void WaitFrame() {
+    table_.vkWaitForFences(device_, 1, &inFlightFence_, VK_TRUE, UINT64_MAX);
+  }
+  // until the latest present to swapchain is shown or timeoutNs passed;
+  // false then, before the first present or without presentWait_
+  bool WaitPresent(VkSwapchainKHR swapchain, uint64_t timeoutNs);
+  void AddWait(VkSemaphore semaphore, VkPipelineStageFlags stage) {
+    waitSemaphores_.push_back(semaphore);
+    waitStages_.push_back(stage);
+  }
+  // one acquired swapchain image
+  struct Present {
+    VkSwapchainKHR swapchain;
+    uint32_t imageIndex;
+    // signaled by the acquire
+    VkSemaphore acquired;
+  };
+  // all command buffers in one vkQueueSubmit, waiting for every acquire,
+  // then all images in one vkQueuePresentKHR. No presents: an offscreen
+  // frame, submitted only
+  void Submit(const std::vector<VkCommandBuffer> &commandBuffers,
+              const std::vector<Present> &presents);
 };
 
 } // namespace Vulkan
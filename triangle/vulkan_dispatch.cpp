@@ -0,0 +1,102 @@
+#include "vulkan_dispatch.h"
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+#define VULKAN_DEFINE_FUNCTION(name) PFN_##name name = nullptr;
+PFN_vkGetInstanceProcAddr vkGetInstanceProcAddr = nullptr;
+VULKAN_GLOBAL_FUNCTIONS(VULKAN_DEFINE_FUNCTION)
+VULKAN_INSTANCE_FUNCTIONS(VULKAN_DEFINE_FUNCTION)
+VULKAN_DEVICE_FUNCTIONS(VULKAN_DEFINE_FUNCTION)
+#undef VULKAN_DEFINE_FUNCTION
+
+namespace Vulkan {
+
+// never closed: the pointers above stay valid until exit
+static PFN_vkGetInstanceProcAddr OpenLoader() {
+#ifdef _WIN32
+  auto module = LoadLibraryA("vulkan-1.dll");
+  if (!module) {
+    return nullptr;
+  }
+  return reinterpret_cast<PFN_vkGetInstanceProcAddr>(
+      reinterpret_cast<void (*)()>(
+          GetProcAddress(module, "vkGetInstanceProcAddr")));
+#else
+#ifdef __APPLE__
+  const char *names[] = {"libvulkan.1.dylib", "libvulkan.dylib",
+                         "libMoltenVK.dylib"};
+#else
+  const char *names[] = {"libvulkan.so.1", "libvulkan.so"};
+#endif
+  for (auto name : names) {
+    if (auto module = dlopen(name, RTLD_NOW | RTLD_LOCAL)) {
+      return reinterpret_cast<PFN_vkGetInstanceProcAddr>(
+          dlsym(module, "vkGetInstanceProcAddr"));
+    }
+  }
+  return nullptr;
+#endif
+}
+
+bool LoadLoader() {
+  if (vkGetInstanceProcAddr) {
+    return true;
+  }
+  vkGetInstanceProcAddr = OpenLoader();
+  if (!vkGetInstanceProcAddr) {
+    return false;
+  }
+#define VULKAN_LOAD_FUNCTION(name)                                            \
+  name = reinterpret_cast<PFN_##name>(vkGetInstanceProcAddr(nullptr, #name));
+  VULKAN_GLOBAL_FUNCTIONS(VULKAN_LOAD_FUNCTION)
+#undef VULKAN_LOAD_FUNCTION
+  return vkCreateInstance != nullptr;
+}
+
+static uint32_t instanceVersion = VK_API_VERSION_1_0;
+
+void LoadInstance(VkInstance instance, uint32_t apiVersion, bool properties2) {
+  instanceVersion = apiVersion;
+#define VULKAN_LOAD_FUNCTION(name)                                            \
+  name = reinterpret_cast<PFN_##name>(vkGetInstanceProcAddr(instance, #name));
+  VULKAN_INSTANCE_FUNCTIONS(VULKAN_LOAD_FUNCTION)
+#undef VULKAN_LOAD_FUNCTION
+  if (apiVersion >= VK_API_VERSION_1_1) {
+    return;
+  }
+  // the loader may hand out 1.1 functions the instance can not use
+  vkGetPhysicalDeviceFeatures2 = nullptr;
+  vkGetPhysicalDeviceMemoryProperties2 = nullptr;
+  if (properties2) {
+    vkGetPhysicalDeviceFeatures2 =
+        reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2>(
+            vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2KHR"));
+    vkGetPhysicalDeviceMemoryProperties2 =
+        reinterpret_cast<PFN_vkGetPhysicalDeviceMemoryProperties2>(
+            vkGetInstanceProcAddr(instance,
+                                  "vkGetPhysicalDeviceMemoryProperties2KHR"));
+  }
+}
+
+uint32_t InstanceVersion() { return instanceVersion; }
+
+void LoadDevice(VkDevice device, DeviceTable *table) {
+#define VULKAN_LOAD_FUNCTION(name)                                            \
+  table->name =                                                               \
+      reinterpret_cast<PFN_##name>(vkGetDeviceProcAddr(device, #name));
+  VULKAN_DEVICE_FUNCTIONS(VULKAN_LOAD_FUNCTION)
+#undef VULKAN_LOAD_FUNCTION
+}
+
+void UseDevice(const DeviceTable &table) {
+#define VULKAN_USE_FUNCTION(name) name = table.name;
+  VULKAN_DEVICE_FUNCTIONS(VULKAN_USE_FUNCTION)
+#undef VULKAN_USE_FUNCTION
+}
+
+} // namespace Vulkan
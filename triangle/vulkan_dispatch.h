@@ -0,0 +1,166 @@
+#pragma once
+#ifndef VK_NO_PROTOTYPES
+#error "build with VK_NO_PROTOTYPES, see triangle/CMakeLists.txt"
+#endif
+#include <vulkan/vulkan.h>
+
+//
+// Vulkan entry points without linking the loader.
+//
+// The target is built with VK_NO_PROTOTYPES, so the headers only declare
+// PFN_ types. The globals below take the place of the loader's exported
+// symbols and call sites stay as they are (vkCmdDraw(...)). The loader
+// library is opened at runtime; instance level functions come from
+// vkGetInstanceProcAddr, device level ones from vkGetDeviceProcAddr and so
+// go straight to the driver instead of through the loader's per-call
+// dispatch trampoline.
+//
+// A function the sample starts calling has to be added to one of these
+// lists.
+//
+#define VULKAN_GLOBAL_FUNCTIONS(X)                                            \
+  X(vkCreateInstance)                                                         \
+  X(vkEnumerateInstanceExtensionProperties)                                   \
+  X(vkEnumerateInstanceLayerProperties)
+
+// the ...2 queries are core 1.1: null on a 1.0 instance unless
+// VK_KHR_get_physical_device_properties2 is enabled, callers check
+#define VULKAN_INSTANCE_FUNCTIONS(X)                                          \
+  X(vkCreateDevice)                                                           \
+  X(vkDestroyInstance)                                                        \
+  X(vkDestroySurfaceKHR)                                                      \
+  X(vkEnumerateDeviceExtensionProperties)                                     \
+  X(vkEnumeratePhysicalDevices)                                               \
+  X(vkGetDeviceProcAddr)                                                      \
+  X(vkGetPhysicalDeviceFeatures)                                              \
+  X(vkGetPhysicalDeviceFeatures2)                                             \
+  X(vkGetPhysicalDeviceFormatProperties)                                      \
+  X(vkGetPhysicalDeviceMemoryProperties)                                      \
+  X(vkGetPhysicalDeviceMemoryProperties2)                                     \
+  X(vkGetPhysicalDeviceProperties)                                            \
+  X(vkGetPhysicalDeviceQueueFamilyProperties)                                 \
+  X(vkGetPhysicalDeviceSurfaceCapabilitiesKHR)                                \
+  X(vkGetPhysicalDeviceSurfaceFormatsKHR)                                     \
+  X(vkGetPhysicalDeviceSurfacePresentModesKHR)                                \
+  X(vkGetPhysicalDeviceSurfaceSupportKHR)
+
+// core 1.3 functions stay null on older devices, which never call them
+#define VULKAN_DEVICE_FUNCTIONS(X)                                            \
+  X(vkAcquireNextImageKHR)                                                    \
+  X(vkAllocateCommandBuffers)                                                 \
+  X(vkAllocateDescriptorSets)                                                 \
+  X(vkAllocateMemory)                                                         \
+  X(vkBeginCommandBuffer)                                                     \
+  X(vkBindBufferMemory)                                                       \
+  X(vkBindImageMemory)                                                        \
+  X(vkCmdBeginQuery)                                                          \
+  X(vkCmdBeginRenderPass)                                                     \
+  X(vkCmdBeginRendering)                                                      \
+  X(vkCmdBindDescriptorSets)                                                  \
+  X(vkCmdBindIndexBuffer)                                                     \
+  X(vkCmdBindPipeline)                                                        \
+  X(vkCmdBindVertexBuffers)                                                   \
+  X(vkCmdBlitImage)                                                           \
+  X(vkCmdCopyBuffer)                                                          \
+  X(vkCmdCopyBufferToImage)                                                   \
+  X(vkCmdCopyImage)                                                           \
+  X(vkCmdCopyImageToBuffer)                                                   \
+  X(vkCmdDispatch)                                                            \
+  X(vkCmdDraw)                                                                \
+  X(vkCmdDrawIndexed)                                                         \
+  X(vkCmdDrawIndexedIndirect)                                                 \
+  X(vkCmdEndQuery)                                                            \
+  X(vkCmdEndRenderPass)                                                       \
+  X(vkCmdEndRendering)                                                        \
+  X(vkCmdPipelineBarrier)                                                     \
+  X(vkCmdPipelineBarrier2)                                                    \
+  X(vkCmdPushConstants)                                                       \
+  X(vkCmdResetQueryPool)                                                      \
+  X(vkCmdSetScissor)                                                          \
+  X(vkCmdSetViewport)                                                         \
+  X(vkCmdWriteTimestamp)                                                      \
+  X(vkCreateBuffer)                                                           \
+  X(vkCreateCommandPool)                                                      \
+  X(vkCreateComputePipelines)                                                 \
+  X(vkCreateDescriptorPool)                                                   \
+  X(vkCreateDescriptorSetLayout)                                              \
+  X(vkCreateFence)                                                            \
+  X(vkCreateFramebuffer)                                                      \
+  X(vkCreateGraphicsPipelines)                                                \
+  X(vkCreateImage)                                                            \
+  X(vkCreateImageView)                                                        \
+  X(vkCreatePipelineLayout)                                                   \
+  X(vkCreateQueryPool)                                                        \
+  X(vkCreateRenderPass)                                                       \
+  X(vkCreateSampler)                                                          \
+  X(vkCreateSemaphore)                                                        \
+  X(vkCreateShaderModule)                                                     \
+  X(vkCreateSwapchainKHR)                                                     \
+  X(vkDestroyBuffer)                                                          \
+  X(vkDestroyCommandPool)                                                     \
+  X(vkDestroyDescriptorPool)                                                  \
+  X(vkDestroyDescriptorSetLayout)                                             \
+  X(vkDestroyDevice)                                                          \
+  X(vkDestroyFence)                                                           \
+  X(vkDestroyFramebuffer)                                                     \
+  X(vkDestroyImage)                                                           \
+  X(vkDestroyImageView)                                                       \
+  X(vkDestroyPipeline)                                                        \
+  X(vkDestroyPipelineLayout)                                                  \
+  X(vkDestroyQueryPool)                                                       \
+  X(vkDestroyRenderPass)                                                      \
+  X(vkDestroySampler)                                                         \
+  X(vkDestroySemaphore)                                                       \
+  X(vkDestroyShaderModule)                                                    \
+  X(vkDestroySwapchainKHR)                                                    \
+  X(vkDeviceWaitIdle)                                                         \
+  X(vkEndCommandBuffer)                                                       \
+  X(vkFreeMemory)                                                             \
+  X(vkGetBufferMemoryRequirements)                                            \
+  X(vkGetDeviceQueue)                                                         \
+  X(vkGetFenceStatus)                                                         \
+  X(vkGetImageMemoryRequirements)                                             \
+  X(vkGetQueryPoolResults)                                                    \
+  X(vkGetSwapchainImagesKHR)                                                  \
+  X(vkInvalidateMappedMemoryRanges)                                           \
+  X(vkMapMemory)                                                              \
+  X(vkQueuePresentKHR)                                                        \
+  X(vkQueueSubmit)                                                            \
+  X(vkResetCommandBuffer)                                                     \
+  X(vkResetCommandPool)                                                       \
+  X(vkResetFences)                                                            \
+  X(vkUnmapMemory)                                                            \
+  X(vkUpdateDescriptorSets)                                                   \
+  X(vkWaitForFences)                                                          \
+  X(vkWaitForPresentKHR)
+#define VULKAN_DECLARE_FUNCTION(name) extern PFN_##name name;
+extern PFN_vkGetInstanceProcAddr vkGetInstanceProcAddr;
+VULKAN_GLOBAL_FUNCTIONS(VULKAN_DECLARE_FUNCTION)
+VULKAN_INSTANCE_FUNCTIONS(VULKAN_DECLARE_FUNCTION)
+VULKAN_DEVICE_FUNCTIONS(VULKAN_DECLARE_FUNCTION)
+#undef VULKAN_DECLARE_FUNCTION
+
+namespace Vulkan {
+
+// device level entry points of one VkDevice
+struct DeviceTable {
+#define VULKAN_TABLE_MEMBER(name) PFN_##name name = nullptr;
+  VULKAN_DEVICE_FUNCTIONS(VULKAN_TABLE_MEMBER)
+#undef VULKAN_TABLE_MEMBER
+};
+
+// opens the loader library and resolves the global functions; false when
+// there is no Vulkan loader. Does nothing once it has succeeded
+bool LoadLoader();
+// after vkCreateInstance. apiVersion: VkApplicationInfo::apiVersion;
+// properties2: VK_KHR_get_physical_device_properties2 is enabled
+void LoadInstance(VkInstance instance, uint32_t apiVersion, bool properties2);
+// the apiVersion given to LoadInstance, what core entry points may be used
+uint32_t InstanceVersion();
+// after vkCreateDevice
+void LoadDevice(VkDevice device, DeviceTable *table);
+// points the global device level functions at table, whose device is then
+// the one every global vk* call goes to; Device and Renderer use their own
+void UseDevice(const DeviceTable &table);
+
+} // namespace Vulkan
@@ -0,0 +1,243 @@
+#include "vulkan_gpu_metrics.h"
+#include "vulkan_allocator.h"
+#include "vulkan_dispatch.h"
+#include <algorithm>
+#include <chrono>
+
+namespace Vulkan {
+
+static const VkQueryPipelineStatisticFlags STATISTICS =
+    VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+
+static double NowMs() {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+static VkQueryPool CreatePool(VkDevice device, VkQueryType type,
+                              uint32_t count,
+                              VkQueryPipelineStatisticFlags statistics = 0) {
+  VkQueryPoolCreateInfo info{};
+  info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  info.queryType = type;
+  info.queryCount = count;
+  info.pipelineStatistics = statistics;
+  VkQueryPool pool;
+  if (vkCreateQueryPool(device, &info, AllocationCallbacks(), &pool) !=
+      VK_SUCCESS) {
+    return VK_NULL_HANDLE;
+  }
+  return pool;
+}
+
+GpuMetrics::~GpuMetrics() {
+  vkDestroyQueryPool(device_, statisticsPool_, AllocationCallbacks());
+  vkDestroyQueryPool(device_, timestampPool_, AllocationCallbacks());
+  vkDestroyQueryPool(device_, occlusionPool_, AllocationCallbacks());
+}
+
+std::shared_ptr<GpuMetrics>
+GpuMetrics::Create(VkDevice device, VkPhysicalDevice physicalDevice,
+                   uint32_t queueFamily, bool pipelineStatistics, bool precise,
+                   const std::vector<std::string> &groups,
+                   const std::string &csvPath) {
+  auto ptr = std::shared_ptr<GpuMetrics>(new GpuMetrics(device));
+  ptr->precise_ = precise;
+  ptr->groups_ = groups;
+
+  if (pipelineStatistics) {
+    ptr->statisticsPool_ =
+        CreatePool(device, VK_QUERY_TYPE_PIPELINE_STATISTICS, FRAMES,
+                   STATISTICS);
+    if (!ptr->statisticsPool_) {
+      return nullptr;
+    }
+  }
+
+  uint32_t familyCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount,
+                                           nullptr);
+  std::vector<VkQueueFamilyProperties> families(familyCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount,
+                                           families.data());
+  auto validBits = families[queueFamily].timestampValidBits;
+  if (validBits) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    ptr->timestampPeriod_ = properties.limits.timestampPeriod;
+    ptr->timestampMask_ =
+        validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+    ptr->timestampPool_ =
+        CreatePool(device, VK_QUERY_TYPE_TIMESTAMP, FRAMES * 2);
+    if (!ptr->timestampPool_) {
+      return nullptr;
+    }
+  }
+
+  if (!groups.empty()) {
+    ptr->occlusionPool_ = CreatePool(
+        device, VK_QUERY_TYPE_OCCLUSION,
+        FRAMES * static_cast<uint32_t>(groups.size()));
+    if (!ptr->occlusionPool_) {
+      return nullptr;
+    }
+  }
+
+  if (csvPath.empty()) {
+    return ptr;
+  }
+  ptr->csv_.open(csvPath);
+  if (!ptr->csv_) {
+    return nullptr;
+  }
+  ptr->csv_ << "frame,cpu_ms,gpu_ms,input_vertices,input_primitives,"
+               "vertex_invocations,clipping_invocations,clipping_primitives,"
+               "fragment_invocations,compute_invocations";
+  for (auto &group : groups) {
+    ptr->csv_ << "," << group << "_samples";
+  }
+  ptr->csv_ << "\n";
+  return ptr;
+}
+
+void GpuMetrics::Begin(VkCommandBuffer commandBuffer) {
+  Collect();
+  auto &slot = Current();
+  auto index = static_cast<uint32_t>(frame_ % FRAMES);
+  if (slot.pending) {
+    // FRAMES frames behind: the only place that waits
+    Read(slot, index, VK_QUERY_RESULT_WAIT_BIT);
+    Export(slot.frame);
+    slot.pending = false;
+    ++collected_;
+  }
+
+  auto now = NowMs();
+  slot.frame = {};
+  slot.frame.index = frame_;
+  slot.frame.cpuMs = lastBegin_ < 0 ? 0 : now - lastBegin_;
+  lastBegin_ = now;
+  slot.drawn.assign(groups_.size(), false);
+
+  if (statisticsPool_) {
+    vkCmdResetQueryPool(commandBuffer, statisticsPool_, index, 1);
+  }
+  if (timestampPool_) {
+    vkCmdResetQueryPool(commandBuffer, timestampPool_, index * 2, 2);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                        timestampPool_, index * 2);
+  }
+  if (occlusionPool_) {
+    auto count = static_cast<uint32_t>(groups_.size());
+    vkCmdResetQueryPool(commandBuffer, occlusionPool_, index * count, count);
+  }
+  if (statisticsPool_) {
+    vkCmdBeginQuery(commandBuffer, statisticsPool_, index, 0);
+  }
+}
+
+void GpuMetrics::End(VkCommandBuffer commandBuffer) {
+  auto index = static_cast<uint32_t>(frame_ % FRAMES);
+  if (statisticsPool_) {
+    vkCmdEndQuery(commandBuffer, statisticsPool_, index);
+  }
+  if (timestampPool_) {
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                        timestampPool_, index * 2 + 1);
+  }
+  Current().pending = true;
+  ++frame_;
+}
+
+void GpuMetrics::BeginGroup(VkCommandBuffer commandBuffer, uint32_t group) {
+  auto index = static_cast<uint32_t>(frame_ % FRAMES);
+  auto count = static_cast<uint32_t>(groups_.size());
+  Current().drawn[group] = true;
+  vkCmdBeginQuery(commandBuffer, occlusionPool_, index * count + group,
+                  precise_ ? VK_QUERY_CONTROL_PRECISE_BIT : 0);
+}
+
+void GpuMetrics::EndGroup(VkCommandBuffer commandBuffer, uint32_t group) {
+  auto index = static_cast<uint32_t>(frame_ % FRAMES);
+  auto count = static_cast<uint32_t>(groups_.size());
+  vkCmdEndQuery(commandBuffer, occlusionPool_, index * count + group);
+}
+
+// value and availability per query; a group that was not drawn has a reset
+// query that never becomes available and is skipped
+bool GpuMetrics::Read(Slot &slot, uint32_t index, VkQueryResultFlags wait) {
+  auto flags =
+      VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT | wait;
+  auto &frame = slot.frame;
+  if (statisticsPool_) {
+    uint64_t data[STATISTIC_COUNT + 1];
+    vkGetQueryPoolResults(device_, statisticsPool_, index, 1, sizeof(data),
+                          data, sizeof(data), flags);
+    if (!data[STATISTIC_COUNT]) {
+      return false;
+    }
+    std::copy(data, data + STATISTIC_COUNT, frame.statistics);
+  }
+  if (timestampPool_) {
+    uint64_t data[4];
+    vkGetQueryPoolResults(device_, timestampPool_, index * 2, 2, sizeof(data),
+                          data, sizeof(uint64_t) * 2, flags);
+    if (!data[1] || !data[3]) {
+      return false;
+    }
+    auto ticks = (data[2] - data[0]) & timestampMask_;
+    frame.gpuMs = ticks * timestampPeriod_ * 1e-6;
+  }
+  auto count = static_cast<uint32_t>(groups_.size());
+  frame.samples.assign(count, 0);
+  for (uint32_t group = 0; group < count; ++group) {
+    if (!slot.drawn[group]) {
+      continue;
+    }
+    uint64_t data[2];
+    vkGetQueryPoolResults(device_, occlusionPool_, index * count + group, 1,
+                          sizeof(data), data, sizeof(data), flags);
+    if (!data[1]) {
+      return false;
+    }
+    frame.samples[group] = data[0];
+  }
+  return true;
+}
+
+void GpuMetrics::Collect() {
+  while (collected_ < frame_) {
+    auto index = static_cast<uint32_t>(collected_ % FRAMES);
+    auto &slot = slots_[index];
+    if (!Read(slot, index, 0)) {
+      return;
+    }
+    Export(slot.frame);
+    slot.pending = false;
+    ++collected_;
+  }
+}
+
+void GpuMetrics::Export(const Frame &frame) {
+  latest_ = frame;
+  if (!csv_.is_open()) {
+    return;
+  }
+  csv_ << frame.index << "," << frame.cpuMs << "," << frame.gpuMs;
+  for (auto value : frame.statistics) {
+    csv_ << "," << value;
+  }
+  for (auto samples : frame.samples) {
+    csv_ << "," << samples;
+  }
+  csv_ << "\n";
+}
+
+} // namespace Vulkan
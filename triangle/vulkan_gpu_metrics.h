@@ -0,0 +1,115 @@
+#pragma once
+#include <fstream>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace Vulkan {
+
+//
+// Per frame GPU counters, opt in.
+//
+// Every frame records into its own slot of three query pools: a pipeline
+// statistics query and two timestamps around the whole command buffer, and
+// one occlusion query per draw group. Results are read back frames later
+// with WITH_AVAILABILITY and never waited for; a slot whose results are not
+// there yet is tried again on the next Collect(). Collected frames go to a
+// CSV file, one line each, if there is one.
+//
+// Vertex / clipping / fragment invocations against the frame's GPU time
+// tell vertex bound from fill bound; fragment invocations or occlusion
+// samples over the pixel count give the overdraw.
+//
+class GpuMetrics {
+public:
+  // slots: frames that can be recorded before the oldest is collected
+  static constexpr uint32_t FRAMES = 4;
+
+  enum Statistic {
+    INPUT_VERTICES,
+    INPUT_PRIMITIVES,
+    VERTEX_INVOCATIONS,
+    CLIPPING_INVOCATIONS,
+    CLIPPING_PRIMITIVES,
+    FRAGMENT_INVOCATIONS,
+    COMPUTE_INVOCATIONS,
+    STATISTIC_COUNT,
+  };
+
+  struct Frame {
+    uint64_t index = 0;
+    // between the starts of this frame's recording and the previous one's
+    double cpuMs = 0;
+    // top to bottom of the command buffer; 0 without timestamps
+    double gpuMs = 0;
+    // 0 without pipelineStatisticsQuery
+    uint64_t statistics[STATISTIC_COUNT] = {};
+    // per group; 0 for a group not drawn that frame
+    std::vector<uint64_t> samples;
+  };
+
+private:
+  VkDevice device_;
+  VkQueryPool statisticsPool_ = VK_NULL_HANDLE;
+  VkQueryPool timestampPool_ = VK_NULL_HANDLE;
+  VkQueryPool occlusionPool_ = VK_NULL_HANDLE;
+  // ns per tick, ticks masked to timestampValidBits
+  double timestampPeriod_ = 0;
+  uint64_t timestampMask_ = 0;
+  bool precise_ = false;
+  std::vector<std::string> groups_;
+  std::ofstream csv_;
+
+  struct Slot {
+    bool pending = false;
+    Frame frame;
+    std::vector<bool> drawn;
+  };
+  Slot slots_[FRAMES];
+  uint64_t frame_ = 0;
+  // oldest frame not collected yet
+  uint64_t collected_ = 0;
+  double lastBegin_ = -1;
+  Frame latest_;
+
+  GpuMetrics(VkDevice device) : device_(device) {}
+  Slot &Current() { return slots_[frame_ % FRAMES]; }
+  bool Read(Slot &slot, uint32_t index, VkQueryResultFlags wait);
+  void Export(const Frame &frame);
+
+public:
+  ~GpuMetrics();
+  GpuMetrics(const GpuMetrics &) = delete;
+  GpuMetrics &operator=(const GpuMetrics &) = delete;
+  // queueFamily: the family the command buffers are submitted to.
+  // pipelineStatistics / precise: the device features are enabled.
+  // csvPath: empty to only keep Latest()
+  static std::shared_ptr<GpuMetrics>
+  Create(VkDevice device, VkPhysicalDevice physicalDevice,
+         uint32_t queueFamily, bool pipelineStatistics, bool precise,
+         const std::vector<std::string> &groups, const std::string &csvPath);
+
+  // first and last thing in the frame's command buffer, outside any render
+  // pass
+  void Begin(VkCommandBuffer commandBuffer);
+  void End(VkCommandBuffer commandBuffer);
+  // around one group's draws, inside a render pass or rendering scope
+  void BeginGroup(VkCommandBuffer commandBuffer, uint32_t group);
+  void EndGroup(VkCommandBuffer commandBuffer, uint32_t group);
+
+  // every frame whose results have arrived, oldest first; never blocks
+  void Collect();
+  // the newest collected frame
+  const Frame &Latest() const { return latest_; }
+  // false when the queue family has no timestamps: gpuMs stays 0
+  bool Timed() const { return timestampPool_ != VK_NULL_HANDLE; }
+  // any sample of group passed in Latest(), true while nothing is known
+  // yet: feeds visibility decisions of the next frame
+  bool Visible(uint32_t group) const {
+    return group >= latest_.samples.size() || latest_.samples[group] > 0;
+  }
+};
+
+} // namespace Vulkan
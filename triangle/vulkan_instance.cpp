@@ -1,4 +1,8 @@
 #include "vulkan_instance.h"
+#include "vulkan_allocator.h"
+#include "vulkan_dispatch.h"
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <stdexcept>
 #include <vector>
@@ -44,16 +48,6 @@ static VkResult CreateDebugUtilsMessengerEXT(
   }
 }
 
-static VKAPI_ATTR VkBool32 VKAPI_CALL
-debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
-              VkDebugUtilsMessageTypeFlagsEXT messageType,
-              const VkDebugUtilsMessengerCallbackDataEXT *pCallbackData,
-              void *pUserData) {
-  std::cerr << "validation layer: " << pCallbackData->pMessage << std::endl;
-
-  return VK_FALSE;
-}
-
 static void
 DestroyDebugUtilsMessengerEXT(VkInstance instance,
                               VkDebugUtilsMessengerEXT debugMessenger,
@@ -65,62 +59,109 @@ DestroyDebugUtilsMessengerEXT(VkInstance instance,
   }
 }
 
+// everything: the sink filters, so that its filters can change later
 static void populateDebugMessengerCreateInfo(
-    VkDebugUtilsMessengerCreateInfoEXT &createInfo) {
+    VkDebugUtilsMessengerCreateInfoEXT &createInfo, Vulkan::DebugSink *sink) {
   createInfo = {
       .sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT,
       .messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT |
+                         VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT |
                          VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
                          VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT,
       .messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
                      VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
                      VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT,
-      .pfnUserCallback = debugCallback,
+      .pfnUserCallback = Vulkan::DebugSink::Callback,
+      .pUserData = sink,
   };
 }
 
+// 1.3 for dynamic rendering, capped by what the loader can do
+static uint32_t InstanceApiVersion() {
+  auto func = (PFN_vkEnumerateInstanceVersion)vkGetInstanceProcAddr(
+      nullptr, "vkEnumerateInstanceVersion");
+  if (func == nullptr) {
+    return VK_API_VERSION_1_0;
+  }
+  uint32_t version = VK_API_VERSION_1_0;
+  func(&version);
+  return std::min(version, VK_API_VERSION_1_3);
+}
+
+static bool HasInstanceExtension(const char *name) {
+  uint32_t count;
+  vkEnumerateInstanceExtensionProperties(nullptr, &count, nullptr);
+  std::vector<VkExtensionProperties> extensions(count);
+  vkEnumerateInstanceExtensionProperties(nullptr, &count, extensions.data());
+  for (const auto &extension : extensions) {
+    if (strcmp(extension.extensionName, name) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
 namespace Vulkan {
 
 Instance::~Instance() {
 
   if (enableValidationLayers) {
-    DestroyDebugUtilsMessengerEXT(handle, debugMessenger, nullptr);
+    DestroyDebugUtilsMessengerEXT(handle, debugMessenger,
+                                  AllocationCallbacks());
   }
 
-  vkDestroyInstance(handle, nullptr);
+  vkDestroyInstance(handle, AllocationCallbacks());
 }
 
 std::shared_ptr<Instance> Instance::Create(const char **extensions, size_t size,
                                            bool enableValidationLayers) {
+  if (!LoadLoader()) {
+    // throw std::runtime_error("failed to load the Vulkan loader!");
+    return nullptr;
+  }
   if (enableValidationLayers && !checkValidationLayerSupport()) {
     // throw std::runtime_error("validation layers requested, but not
     // available!");
     return nullptr;
   }
 
+  auto apiVersion = InstanceApiVersion();
+  // a 1.0 instance gets the ...2 queries from the extension, if there is one
+  std::vector<const char *> enabledExtensions(extensions, extensions + size);
+  bool properties2 =
+      apiVersion < VK_API_VERSION_1_1 &&
+      HasInstanceExtension(
+          VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+  if (properties2) {
+    enabledExtensions.push_back(
+        VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+  }
+
   VkApplicationInfo appInfo{
       .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
       .pApplicationName = "Hello Triangle",
       .applicationVersion = VK_MAKE_VERSION(1, 0, 0),
       .pEngineName = "No Engine",
       .engineVersion = VK_MAKE_VERSION(1, 0, 0),
-      .apiVersion = VK_API_VERSION_1_0,
+      .apiVersion = apiVersion,
   };
 
   VkInstanceCreateInfo createInfo{
       .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
       .pApplicationInfo = &appInfo,
-      .enabledExtensionCount = static_cast<uint32_t>(size),
-      .ppEnabledExtensionNames = extensions,
+      .enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size()),
+      .ppEnabledExtensionNames = enabledExtensions.data(),
   };
 
   VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo{};
+  std::shared_ptr<DebugSink> debugSink;
   if (enableValidationLayers) {
     createInfo.enabledLayerCount =
         static_cast<uint32_t>(validationLayers.size());
     createInfo.ppEnabledLayerNames = validationLayers.data();
 
-    populateDebugMessengerCreateInfo(debugCreateInfo);
+    debugSink = DebugSink::Create(std::cerr);
+    populateDebugMessengerCreateInfo(debugCreateInfo, debugSink.get());
     createInfo.pNext = (VkDebugUtilsMessengerCreateInfoEXT *)&debugCreateInfo;
   } else {
     createInfo.enabledLayerCount = 0;
@@ -128,19 +169,24 @@ std::shared_ptr<Instance> Instance::Create(const char **extensions, size_t size,
   }
 
   VkInstance instance;
-  if (vkCreateInstance(&createInfo, nullptr, &instance) != VK_SUCCESS) {
+  if (vkCreateInstance(&createInfo, AllocationCallbacks(), &instance) !=
+      VK_SUCCESS) {
     // throw std::runtime_error("failed to create instance!");
     return nullptr;
   }
 
+  LoadInstance(instance, apiVersion, properties2);
+
   auto ptr = std::shared_ptr<Instance>(new Instance);
   ptr->handle = instance;
+  ptr->debugSink = debugSink;
 
   if (enableValidationLayers) {
     ptr->enableValidationLayers = true;
     VkDebugUtilsMessengerCreateInfoEXT createInfo;
-    populateDebugMessengerCreateInfo(createInfo);
-    if (::CreateDebugUtilsMessengerEXT(ptr->handle, &createInfo, nullptr,
+    populateDebugMessengerCreateInfo(createInfo, debugSink.get());
+    if (::CreateDebugUtilsMessengerEXT(ptr->handle, &createInfo,
+                                       AllocationCallbacks(),
                                        &ptr->debugMessenger) != VK_SUCCESS) {
       throw std::runtime_error("failed to set up debug messenger!");
     }
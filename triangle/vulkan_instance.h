@@ -1,4 +1,5 @@
 #pragma once
+#include "vulkan_debug_sink.h"
 #include <memory>
 #include <vulkan/vulkan.h>
 
@@ -9,6 +10,8 @@ class Instance {
 
 public:
   VkInstance handle = nullptr;
+  // validation messages; null without validation layers. Outlives handle
+  std::shared_ptr<DebugSink> debugSink;
   ~Instance();
   static std::shared_ptr<Instance> Create(const char **extensions, size_t size,
                                           bool enableValidationLayers);
@@ -0,0 +1,121 @@
+#include "vulkan_memory.h"
+#include "vulkan_allocator.h"
+#include "vulkan_dispatch.h"
+
+namespace Vulkan {
+
+std::optional<uint32_t> FindMemoryType(VkPhysicalDevice physicalDevice,
+                                       uint32_t typeFilter,
+                                       VkMemoryPropertyFlags properties) {
+  VkPhysicalDeviceMemoryProperties memProperties;
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+  for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+    if ((typeFilter & (1 << i)) &&
+        (memProperties.memoryTypes[i].propertyFlags & properties) ==
+            properties) {
+      return i;
+    }
+  }
+
+  return std::nullopt;
+}
+
+std::optional<uint32_t>
+FindAttachmentMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFilter,
+                         bool transient) {
+  if (transient) {
+    if (auto lazy =
+            FindMemoryType(physicalDevice, typeFilter,
+                           VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
+                               VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)) {
+      return lazy;
+    }
+  }
+  return FindMemoryType(physicalDevice, typeFilter,
+                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+}
+
+bool CreateBuffer(VkDevice device, VkPhysicalDevice physicalDevice,
+                  VkDeviceSize size, VkBufferUsageFlags usage,
+                  VkMemoryPropertyFlags properties, VkBuffer *buffer,
+                  VkDeviceMemory *memory, uint32_t family,
+                  uint32_t otherFamily) {
+  VkBufferCreateInfo bufferInfo{};
+  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.size = size;
+  bufferInfo.usage = usage;
+  uint32_t families[] = {family, otherFamily};
+  if (family != otherFamily) {
+    bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+    bufferInfo.queueFamilyIndexCount = 2;
+    bufferInfo.pQueueFamilyIndices = families;
+  } else {
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  }
+  if (vkCreateBuffer(device, &bufferInfo, AllocationCallbacks(), buffer) !=
+      VK_SUCCESS) {
+    return false;
+  }
+
+  VkMemoryRequirements memRequirements;
+  vkGetBufferMemoryRequirements(device, *buffer, &memRequirements);
+  auto memoryType = FindMemoryType(physicalDevice,
+                                   memRequirements.memoryTypeBits, properties);
+  VkMemoryAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocInfo.allocationSize = memRequirements.size;
+  allocInfo.memoryTypeIndex = memoryType.value_or(0);
+  if (!memoryType || vkAllocateMemory(device, &allocInfo,
+                                      AllocationCallbacks(),
+                                      memory) != VK_SUCCESS) {
+    vkDestroyBuffer(device, *buffer, AllocationCallbacks());
+    *buffer = VK_NULL_HANDLE;
+    return false;
+  }
+  vkBindBufferMemory(device, *buffer, *memory, 0);
+  return true;
+}
+
+MemoryBudget::MemoryBudget(VkPhysicalDevice physicalDevice, bool extension)
+    : physicalDevice_(physicalDevice), extension_(extension) {
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &properties_);
+  heaps_.resize(properties_.memoryHeapCount);
+  reported_.resize(properties_.memoryHeapCount);
+  for (uint32_t i = 0; i < properties_.memoryHeapCount; ++i) {
+    heaps_[i].size = properties_.memoryHeaps[i].size;
+    heaps_[i].budget = heaps_[i].size;
+    heaps_[i].deviceLocal =
+        (properties_.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) !=
+        0;
+  }
+  Update();
+}
+
+void MemoryBudget::Update() {
+  if (!extension_ || !vkGetPhysicalDeviceMemoryProperties2) {
+    for (size_t i = 0; i < heaps_.size(); ++i) {
+      heaps_[i].usage = reported_[i];
+    }
+    return;
+  }
+
+  VkPhysicalDeviceMemoryBudgetPropertiesEXT budget{};
+  budget.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+  VkPhysicalDeviceMemoryProperties2 properties{};
+  properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+  properties.pNext = &budget;
+  vkGetPhysicalDeviceMemoryProperties2(physicalDevice_, &properties);
+  for (size_t i = 0; i < heaps_.size(); ++i) {
+    heaps_[i].usage = budget.heapUsage[i];
+    heaps_[i].budget = budget.heapBudget[i];
+  }
+}
+
+void MemoryBudget::Release(uint32_t heap, VkDeviceSize bytes) {
+  auto &usage = heaps_[heap].usage;
+  usage = bytes < usage ? usage - bytes : 0;
+}
+
+} // namespace Vulkan
@@ -0,0 +1,63 @@
+#pragma once
+#include <optional>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace Vulkan {
+
+// index of a memory type allowed by typeFilter that has all of properties
+std::optional<uint32_t> FindMemoryType(VkPhysicalDevice physicalDevice,
+                                       uint32_t typeFilter,
+                                       VkMemoryPropertyFlags properties);
+
+// attachments that never leave the render pass (transient) get
+// LAZILY_ALLOCATED memory where the device has it, so tilers never back them
+std::optional<uint32_t>
+FindAttachmentMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFilter,
+                         bool transient);
+
+// buffer with its own allocation; sharing is CONCURRENT when the queue
+// families differ. Nothing is left behind on failure
+bool CreateBuffer(VkDevice device, VkPhysicalDevice physicalDevice,
+                  VkDeviceSize size, VkBufferUsageFlags usage,
+                  VkMemoryPropertyFlags properties, VkBuffer *buffer,
+                  VkDeviceMemory *memory, uint32_t family = 0,
+                  uint32_t otherFamily = 0);
+
+struct HeapBudget {
+  VkDeviceSize size = 0;
+  // bytes in use by this process and its budget, from VK_EXT_memory_budget;
+  // without it usage is what the caller reported and budget the heap size
+  VkDeviceSize usage = 0;
+  VkDeviceSize budget = 0;
+  bool deviceLocal = false;
+};
+
+//
+// Per-heap usage / budget, polled once per frame. The budget accounts for
+// other processes sharing the GPU, so it can shrink at any time.
+//
+class MemoryBudget {
+  VkPhysicalDevice physicalDevice_;
+  bool extension_;
+  VkPhysicalDeviceMemoryProperties properties_;
+  std::vector<HeapBudget> heaps_;
+  // fallback usage
+  std::vector<VkDeviceSize> reported_;
+
+public:
+  // extension: VK_EXT_memory_budget is enabled on the device
+  MemoryBudget(VkPhysicalDevice physicalDevice, bool extension);
+  void Update();
+  bool HasExtension() const { return extension_; }
+  const std::vector<HeapBudget> &Heaps() const { return heaps_; }
+  uint32_t HeapIndex(uint32_t memoryTypeIndex) const {
+    return properties_.memoryTypes[memoryTypeIndex].heapIndex;
+  }
+  // usage estimate when the extension is missing
+  void Report(uint32_t heap, VkDeviceSize bytes) { reported_[heap] = bytes; }
+  // account for a release before the next poll sees it
+  void Release(uint32_t heap, VkDeviceSize bytes);
+};
+
+} // namespace Vulkan
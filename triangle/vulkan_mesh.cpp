@@ -0,0 +1,170 @@
+#include "vulkan_mesh.h"
+#include "vulkan_allocator.h"
+#include "vulkan_device.h"
+#include "vulkan_dispatch.h"
+#include "vulkan_memory.h"
+#include "vulkan_pipeline.h"
+#include <stddef.h>
+#include <string.h>
+
+namespace Vulkan {
+
+MeshBuffer::~MeshBuffer() {
+  auto device = device_->device_;
+  vkDestroyBuffer(device, vertexBuffer_, AllocationCallbacks());
+  vkFreeMemory(device, vertexMemory_, AllocationCallbacks());
+  vkDestroyBuffer(device, indexBuffer_, AllocationCallbacks());
+  vkFreeMemory(device, indexMemory_, AllocationCallbacks());
+  vkDestroyBuffer(device, meshletBuffer_, AllocationCallbacks());
+  vkFreeMemory(device, meshletMemory_, AllocationCallbacks());
+}
+
+std::shared_ptr<MeshBuffer>
+MeshBuffer::Load(const std::shared_ptr<Device> &device,
+                 VkPhysicalDevice physicalDevice, const std::string &path,
+                 std::string *error) {
+  auto ptr = std::shared_ptr<MeshBuffer>(new MeshBuffer(device));
+  ptr->file_ = MappedFile::Open(path);
+  if (!ptr->file_) {
+    *error = "can not open " + path;
+    return nullptr;
+  }
+  if (!MeshFile::Parse(ptr->file_->Data(), ptr->file_->Size(), &ptr->mesh_,
+                       error)) {
+    return nullptr;
+  }
+  if (!ptr->Upload(physicalDevice)) {
+    *error = "failed to upload mesh";
+    return nullptr;
+  }
+  return ptr;
+}
+
+bool MeshBuffer::Upload(VkPhysicalDevice physicalDevice) {
+  auto device = device_->device_;
+  auto &header = *mesh_.header;
+  VkDeviceSize vertexBytes = header.vertexCount * sizeof(MeshFile::Vertex);
+  VkDeviceSize indexBytes = header.indexCount * sizeof(uint32_t);
+  VkDeviceSize meshletBytes = header.meshletCount * sizeof(MeshFile::Meshlet);
+
+  if (!CreateBuffer(device, physicalDevice, vertexBytes,
+                    VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+                        VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &vertexBuffer_,
+                    &vertexMemory_, device_->graphicsFamily_,
+                    device_->transferFamily_) ||
+      !CreateBuffer(device, physicalDevice, indexBytes,
+                    VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+                        VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &indexBuffer_,
+                    &indexMemory_, device_->graphicsFamily_,
+                    device_->transferFamily_) ||
+      (meshletBytes &&
+       !CreateBuffer(device, physicalDevice, meshletBytes,
+                     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                         VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &meshletBuffer_,
+                     &meshletMemory_, device_->graphicsFamily_,
+                     device_->transferFamily_))) {
+    return false;
+  }
+
+  // the sections go to staging byte for byte
+  VkBuffer staging;
+  VkDeviceMemory stagingMemory;
+  if (!CreateBuffer(device, physicalDevice,
+                    vertexBytes + indexBytes + meshletBytes,
+                    VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                    &staging, &stagingMemory)) {
+    return false;
+  }
+  void *mapped;
+  vkMapMemory(device, stagingMemory, 0, VK_WHOLE_SIZE, 0, &mapped);
+  memcpy(mapped, mesh_.vertices, vertexBytes);
+  memcpy(static_cast<uint8_t *>(mapped) + vertexBytes, mesh_.indices,
+         indexBytes);
+  memcpy(static_cast<uint8_t *>(mapped) + vertexBytes + indexBytes,
+         mesh_.meshlets, meshletBytes);
+  vkUnmapMemory(device, stagingMemory);
+
+  VkCommandPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+  poolInfo.queueFamilyIndex = device_->transferFamily_;
+  VkCommandPool commandPool;
+  if (vkCreateCommandPool(device, &poolInfo, AllocationCallbacks(),
+                          &commandPool) != VK_SUCCESS) {
+    return false;
+  }
+  VkCommandBufferAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  allocInfo.commandPool = commandPool;
+  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocInfo.commandBufferCount = 1;
+  VkCommandBuffer commandBuffer;
+  vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
+
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  vkBeginCommandBuffer(commandBuffer, &beginInfo);
+  VkBufferCopy region{};
+  region.size = vertexBytes;
+  vkCmdCopyBuffer(commandBuffer, staging, vertexBuffer_, 1, &region);
+  region.srcOffset = vertexBytes;
+  region.size = indexBytes;
+  vkCmdCopyBuffer(commandBuffer, staging, indexBuffer_, 1, &region);
+  if (meshletBytes) {
+    region.srcOffset = vertexBytes + indexBytes;
+    region.size = meshletBytes;
+    vkCmdCopyBuffer(commandBuffer, staging, meshletBuffer_, 1, &region);
+  }
+  vkEndCommandBuffer(commandBuffer);
+
+  // startup only: the frame loop has not begun, waiting here is fine
+  VkFenceCreateInfo fenceInfo{};
+  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  VkFence fence;
+  vkCreateFence(device, &fenceInfo, AllocationCallbacks(), &fence);
+  VkSubmitInfo submitInfo{};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &commandBuffer;
+  auto result =
+      vkQueueSubmit(device_->transferQueue_, 1, &submitInfo, fence);
+  if (result == VK_SUCCESS) {
+    result = vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
+  }
+
+  vkDestroyFence(device, fence, AllocationCallbacks());
+  vkDestroyCommandPool(device, commandPool, AllocationCallbacks());
+  vkDestroyBuffer(device, staging, AllocationCallbacks());
+  vkFreeMemory(device, stagingMemory, AllocationCallbacks());
+  return result == VK_SUCCESS;
+}
+
+void MeshBuffer::VertexInput(GraphicsPipelineDesc *desc) {
+  desc->vertexStride = sizeof(MeshFile::Vertex);
+  desc->attributes = {
+      {0, 0, VK_FORMAT_R16G16B16A16_UNORM,
+       offsetof(MeshFile::Vertex, position)},
+      {1, 0, VK_FORMAT_R16G16_SNORM, offsetof(MeshFile::Vertex, normal)},
+      {2, 0, VK_FORMAT_R16G16_SFLOAT, offsetof(MeshFile::Vertex, uv)},
+  };
+}
+
+void MeshBuffer::Bind(VkCommandBuffer commandBuffer) const {
+  VkDeviceSize offset = 0;
+  vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer_, &offset);
+  vkCmdBindIndexBuffer(commandBuffer, indexBuffer_, 0, VK_INDEX_TYPE_UINT32);
+}
+
+void MeshBuffer::Draw(VkCommandBuffer commandBuffer, uint32_t lod,
+                      uint32_t instance) const {
+  auto &l = mesh_.lods[lod];
+  vkCmdDrawIndexed(commandBuffer, l.indexCount, 1, l.indexOffset, 0, instance);
+}
+
+} // namespace Vulkan
@@ -0,0 +1,52 @@
+#pragma once
+#include "mapped_file.h"
+#include "mesh_file.h"
+#include <memory>
+#include <string>
+#include <vulkan/vulkan.h>
+
+namespace Vulkan {
+
+struct Device;
+struct GraphicsPipelineDesc;
+
+//
+// A .mesh file in device local vertex / index buffers.
+//
+// The file is memory mapped and its vertex, index and meshlet sections are
+// copied into staging memory as they are, then into the buffers on the
+// transfer queue. The LOD table is only read by the CPU, in the mapping.
+//
+class MeshBuffer {
+  std::shared_ptr<Device> device_;
+  std::shared_ptr<MappedFile> file_;
+  MeshFile mesh_;
+
+  MeshBuffer(const std::shared_ptr<Device> &device) : device_(device) {}
+  bool Upload(VkPhysicalDevice physicalDevice);
+
+public:
+  VkBuffer vertexBuffer_ = VK_NULL_HANDLE;
+  VkDeviceMemory vertexMemory_ = VK_NULL_HANDLE;
+  VkBuffer indexBuffer_ = VK_NULL_HANDLE;
+  VkDeviceMemory indexMemory_ = VK_NULL_HANDLE;
+  // MeshFile::Meshlet[], storage buffer for culling
+  VkBuffer meshletBuffer_ = VK_NULL_HANDLE;
+  VkDeviceMemory meshletMemory_ = VK_NULL_HANDLE;
+
+  ~MeshBuffer();
+  // blocks until the upload has completed; nullptr on failure
+  static std::shared_ptr<MeshBuffer> Load(const std::shared_ptr<Device> &device,
+                                          VkPhysicalDevice physicalDevice,
+                                          const std::string &path,
+                                          std::string *error);
+  const MeshFile &File() const { return mesh_; }
+  // binding 0 / locations 0-2 of MeshFile::Vertex
+  static void VertexInput(GraphicsPipelineDesc *desc);
+  void Bind(VkCommandBuffer commandBuffer) const;
+  // one LOD of one instance, after Bind()
+  void Draw(VkCommandBuffer commandBuffer, uint32_t lod,
+            uint32_t instance = 0) const;
+};
+
+} // namespace Vulkan
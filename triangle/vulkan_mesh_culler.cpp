@@ -0,0 +1,252 @@
+#include "vulkan_mesh_culler.h"
+#include "vulkan_allocator.h"
+#include "vulkan_device.h"
+#include "vulkan_dispatch.h"
+#include "vulkan_memory.h"
+#include "vulkan_mesh.h"
+#include "vulkan_pipeline.h"
+#include <algorithm>
+#include <math.h>
+
+namespace Vulkan {
+
+MeshCuller::~MeshCuller() {
+  auto device = device_->device_;
+  pipeline_ = nullptr;
+  vkDestroyDescriptorPool(device, descriptorPool_, AllocationCallbacks());
+  vkDestroyDescriptorSetLayout(device, descriptorSetLayout_,
+                               AllocationCallbacks());
+  vkDestroyBuffer(device, instanceBuffer_, AllocationCallbacks());
+  vkFreeMemory(device, instanceMemory_, AllocationCallbacks());
+  vkDestroyBuffer(device, taskBuffer_, AllocationCallbacks());
+  vkFreeMemory(device, taskMemory_, AllocationCallbacks());
+  vkDestroyBuffer(device, commandBuffer_, AllocationCallbacks());
+  vkFreeMemory(device, commandMemory_, AllocationCallbacks());
+}
+
+std::shared_ptr<MeshCuller>
+MeshCuller::Create(const std::shared_ptr<Device> &device,
+                   VkPhysicalDevice physicalDevice,
+                   const std::shared_ptr<MeshBuffer> &mesh,
+                   uint32_t maxInstances) {
+  auto ptr = std::shared_ptr<MeshCuller>(
+      new MeshCuller(device, mesh, maxInstances));
+  auto &file = mesh->File();
+  uint32_t maxMeshlets = 0;
+  for (uint32_t i = 0; i < file.header->lodCount; ++i) {
+    maxMeshlets = std::max(maxMeshlets, file.lods[i].meshletCount);
+  }
+  ptr->maxTasks_ = maxInstances * maxMeshlets;
+  ptr->indirect_ = device->indirectDraw_;
+
+  auto vkDevice = device->device_;
+  auto hostVisible = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  if (!CreateBuffer(vkDevice, physicalDevice,
+                    maxInstances * sizeof(Instance),
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostVisible,
+                    &ptr->instanceBuffer_, &ptr->instanceMemory_) ||
+      !CreateBuffer(vkDevice, physicalDevice, ptr->maxTasks_ * sizeof(Task),
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostVisible,
+                    &ptr->taskBuffer_, &ptr->taskMemory_) ||
+      !CreateBuffer(vkDevice, physicalDevice,
+                    ptr->maxTasks_ * sizeof(VkDrawIndexedIndirectCommand),
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                        VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &ptr->commandBuffer_,
+                    &ptr->commandMemory_)) {
+    return nullptr;
+  }
+  void *mapped;
+  vkMapMemory(vkDevice, ptr->instanceMemory_, 0, VK_WHOLE_SIZE, 0, &mapped);
+  ptr->instances_ = static_cast<Instance *>(mapped);
+  vkMapMemory(vkDevice, ptr->taskMemory_, 0, VK_WHOLE_SIZE, 0, &mapped);
+  ptr->tasks_ = static_cast<Task *>(mapped);
+
+  VkDescriptorSetLayoutBinding bindings[4]{};
+  for (uint32_t i = 0; i < 4; ++i) {
+    bindings[i].binding = i;
+    bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[i].descriptorCount = 1;
+    bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  }
+  bindings[1].stageFlags |= VK_SHADER_STAGE_VERTEX_BIT;
+  VkDescriptorSetLayoutCreateInfo layoutInfo{};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.bindingCount = 4;
+  layoutInfo.pBindings = bindings;
+  if (vkCreateDescriptorSetLayout(vkDevice, &layoutInfo, AllocationCallbacks(),
+                                  &ptr->descriptorSetLayout_) != VK_SUCCESS) {
+    return nullptr;
+  }
+
+  VkDescriptorPoolSize poolSize{};
+  poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  poolSize.descriptorCount = 4;
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.maxSets = 1;
+  poolInfo.poolSizeCount = 1;
+  poolInfo.pPoolSizes = &poolSize;
+  if (vkCreateDescriptorPool(vkDevice, &poolInfo, AllocationCallbacks(),
+                             &ptr->descriptorPool_) != VK_SUCCESS) {
+    return nullptr;
+  }
+  VkDescriptorSetAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool = ptr->descriptorPool_;
+  allocInfo.descriptorSetCount = 1;
+  allocInfo.pSetLayouts = &ptr->descriptorSetLayout_;
+  if (vkAllocateDescriptorSets(vkDevice, &allocInfo, &ptr->descriptorSet_) !=
+      VK_SUCCESS) {
+    return nullptr;
+  }
+
+  VkDescriptorBufferInfo bufferInfos[4] = {
+      {mesh->meshletBuffer_, 0, VK_WHOLE_SIZE},
+      {ptr->instanceBuffer_, 0, VK_WHOLE_SIZE},
+      {ptr->taskBuffer_, 0, VK_WHOLE_SIZE},
+      {ptr->commandBuffer_, 0, VK_WHOLE_SIZE},
+  };
+  VkWriteDescriptorSet writes[4]{};
+  for (uint32_t i = 0; i < 4; ++i) {
+    writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[i].dstSet = ptr->descriptorSet_;
+    writes[i].dstBinding = i;
+    writes[i].descriptorCount = 1;
+    writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writes[i].pBufferInfo = &bufferInfos[i];
+  }
+  vkUpdateDescriptorSets(vkDevice, 4, writes, 0, nullptr);
+
+  if (ptr->indirect_) {
+    ptr->pipeline_ = ComputePipeline::Create(vkDevice, "shaders/cull_comp.spv",
+                                             ptr->descriptorSetLayout_,
+                                             sizeof(Push));
+    if (!ptr->pipeline_) {
+      return nullptr;
+    }
+  }
+  return ptr;
+}
+
+void MeshCuller::Begin(uint32_t instanceCount) {
+  instanceCount_ = std::min(instanceCount, maxInstances_);
+  taskCount_ = 0;
+  triangles_ = 0;
+}
+
+uint32_t MeshCuller::Select(uint32_t index, const Instance &instance,
+                            const float eye[3], float pixelsPerUnit,
+                            float threshold) {
+  if (index >= instanceCount_) {
+    return 0;
+  }
+  auto &file = mesh_->File();
+  auto &header = *file.header;
+
+  // bounding sphere of the whole mesh, in world space
+  auto &m = instance.world;
+  auto scale = sqrtf(m[0] * m[0] + m[4] * m[4] + m[8] * m[8]);
+  float distance = 0;
+  float radius = 0;
+  for (int k = 0; k < 3; ++k) {
+    auto extent = header.boundsMax[k] - header.boundsMin[k];
+    radius += extent * extent * 0.25f;
+  }
+  for (int r = 0; r < 3; ++r) {
+    auto center = m[r * 4 + 3];
+    for (int k = 0; k < 3; ++k) {
+      center += m[r * 4 + k] * (header.boundsMin[k] + header.boundsMax[k]) *
+                0.5f;
+    }
+    distance += (center - eye[r]) * (center - eye[r]);
+  }
+  radius = sqrtf(radius) * scale;
+  // nearest point of the sphere; inside it every LOD is too close to call
+  distance = std::max(sqrtf(distance) - radius, radius * 1e-3f + 1e-6f);
+
+  auto lod =
+      file.SelectLod(lods_[index], pixelsPerUnit * scale / distance, threshold);
+  lods_[index] = lod;
+  instances_[index] = instance;
+  return lod;
+}
+
+void MeshCuller::Set(uint32_t index, const Instance &instance, uint32_t lod) {
+  if (index >= instanceCount_) {
+    return;
+  }
+  lods_[index] = std::min(lod, mesh_->File().header->lodCount - 1);
+  instances_[index] = instance;
+}
+
+void MeshCuller::End() {
+  auto &file = mesh_->File();
+  for (uint32_t index = 0; index < instanceCount_; ++index) {
+    auto &l = file.lods[lods_[index]];
+    triangles_ += l.indexCount / 3;
+    if (indirect_) {
+      for (uint32_t i = 0; i < l.meshletCount; ++i) {
+        tasks_[taskCount_++] = {l.meshletOffset + i, index};
+      }
+    }
+  }
+}
+
+void MeshCuller::Dispatch(VkCommandBuffer commandBuffer,
+                          const float planes[6][4], const float eye[3]) {
+  if (!indirect_ || taskCount_ == 0) {
+    return;
+  }
+  Push push{};
+  std::copy(&planes[0][0], &planes[0][0] + 24, &push.planes[0][0]);
+  std::copy(eye, eye + 3, push.eye);
+  push.taskCount = taskCount_;
+
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                    pipeline_->pipeline_);
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                          pipeline_->pipelineLayout_, 0, 1, &descriptorSet_, 0,
+                          nullptr);
+  vkCmdPushConstants(commandBuffer, pipeline_->pipelineLayout_,
+                     VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+  // local_size_x = 64
+  vkCmdDispatch(commandBuffer, (taskCount_ + 63) / 64, 1, 1);
+}
+
+void MeshCuller::Barrier(VkCommandBuffer commandBuffer) {
+  if (!indirect_ || taskCount_ == 0) {
+    return;
+  }
+  VkBufferMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.buffer = commandBuffer_;
+  barrier.offset = 0;
+  barrier.size = VK_WHOLE_SIZE;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 0, nullptr, 1,
+                       &barrier, 0, nullptr);
+}
+
+void MeshCuller::Draw(VkCommandBuffer commandBuffer, VkPipelineLayout layout) {
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                          layout, 0, 1, &descriptorSet_, 0, nullptr);
+  mesh_->Bind(commandBuffer);
+  if (indirect_) {
+    if (taskCount_) {
+      vkCmdDrawIndexedIndirect(commandBuffer, commandBuffer_, 0, taskCount_,
+                               sizeof(VkDrawIndexedIndirectCommand));
+    }
+  } else {
+    for (uint32_t i = 0; i < instanceCount_; ++i) {
+      mesh_->Draw(commandBuffer, lods_[i], i);
+    }
+  }
+}
+
+} // namespace Vulkan
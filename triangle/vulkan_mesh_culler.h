@@ -0,0 +1,116 @@
+#pragma once
+#include <memory>
+#include <stdint.h>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace Vulkan {
+
+struct Device;
+class MeshBuffer;
+class ComputePipeline;
+
+//
+// Per-instance LOD selection and GPU meshlet culling for one MeshBuffer.
+//
+// Every frame the CPU picks a LOD for each instance from its projected error
+// (MeshFile::SelectLod, with hysteresis) and lists the meshlets of that LOD.
+// A compute pre-pass tests each meshlet's bounding sphere against the
+// frustum and its normal cone against the eye, and writes one
+// VkDrawIndexedIndirectCommand per meshlet with instanceCount 0 when it is
+// culled. The draw is then a single vkCmdDrawIndexedIndirect.
+//
+// Without multiDrawIndirect / drawIndirectFirstInstance the compute pass is
+// skipped and every selected LOD is drawn whole.
+//
+class MeshCuller {
+public:
+  // row major 3x4 world transform (Scene::Affine), three std430 vec4s also
+  // read by the vertex shader through gl_InstanceIndex. Scale is uniform
+  struct Instance {
+    float world[12];
+  };
+
+private:
+  struct Task {
+    uint32_t meshlet;
+    uint32_t instance;
+  };
+  struct Push {
+    float planes[6][4];
+    float eye[4];
+    uint32_t taskCount;
+  };
+
+  std::shared_ptr<Device> device_;
+  std::shared_ptr<MeshBuffer> mesh_;
+  bool indirect_ = false;
+  uint32_t maxInstances_;
+  uint32_t maxTasks_ = 0;
+  // persistently mapped, written by the host every frame
+  VkBuffer instanceBuffer_ = VK_NULL_HANDLE;
+  VkDeviceMemory instanceMemory_ = VK_NULL_HANDLE;
+  Instance *instances_ = nullptr;
+  VkBuffer taskBuffer_ = VK_NULL_HANDLE;
+  VkDeviceMemory taskMemory_ = VK_NULL_HANDLE;
+  Task *tasks_ = nullptr;
+  VkBuffer commandBuffer_ = VK_NULL_HANDLE;
+  VkDeviceMemory commandMemory_ = VK_NULL_HANDLE;
+  VkDescriptorPool descriptorPool_ = VK_NULL_HANDLE;
+  VkDescriptorSet descriptorSet_ = VK_NULL_HANDLE;
+  std::shared_ptr<ComputePipeline> pipeline_;
+
+  // LOD each instance had last frame
+  std::vector<uint32_t> lods_;
+  uint32_t instanceCount_ = 0;
+  uint32_t taskCount_ = 0;
+  uint64_t triangles_ = 0;
+
+  MeshCuller(const std::shared_ptr<Device> &device,
+             const std::shared_ptr<MeshBuffer> &mesh, uint32_t maxInstances)
+      : device_(device), mesh_(mesh), maxInstances_(maxInstances),
+        lods_(maxInstances) {}
+
+public:
+  // binding 0 meshlets, 1 instances, 2 tasks, 3 draw commands
+  VkDescriptorSetLayout descriptorSetLayout_ = VK_NULL_HANDLE;
+
+  ~MeshCuller();
+  static std::shared_ptr<MeshCuller>
+  Create(const std::shared_ptr<Device> &device,
+         VkPhysicalDevice physicalDevice,
+         const std::shared_ptr<MeshBuffer> &mesh, uint32_t maxInstances);
+
+  // after the frame fence; instanceCount is clamped to maxInstances
+  void Begin(uint32_t instanceCount);
+  // any order and from any thread, once per index < instanceCount.
+  // pixelsPerUnit: viewport height / (2 tan(fovY / 2)), the projected size
+  // of one unit at distance 1. Returns the selected LOD
+  uint32_t Select(uint32_t index, const Instance &instance, const float eye[3],
+                  float pixelsPerUnit, float threshold = 1.0f);
+  // a LOD chosen elsewhere (a replayed frame) instead of Select()
+  void Set(uint32_t index, const Instance &instance, uint32_t lod);
+  // lists the meshlets of the selected LODs, after every Select()
+  void End();
+
+  // compute pre-pass, outside any render pass
+  void Dispatch(VkCommandBuffer commandBuffer, const float planes[6][4],
+                const float eye[3]);
+  // make the commands visible to the indirect draw, for callers that do not
+  // declare the access to a RenderGraph
+  void Barrier(VkCommandBuffer commandBuffer);
+  // with the graphics pipeline (set 0 = descriptorSetLayout_) bound
+  void Draw(VkCommandBuffer commandBuffer, VkPipelineLayout layout);
+
+  VkBuffer CommandBuffer() const { return commandBuffer_; }
+  // this frame's instances and their LODs, after End()
+  uint32_t InstanceCount() const { return instanceCount_; }
+  const Instance *Instances() const { return instances_; }
+  const uint32_t *Lods() const { return lods_.data(); }
+  bool Indirect() const { return indirect_; }
+  // meshlets / triangles of the selected LODs, before culling
+  uint32_t Tasks() const { return taskCount_; }
+  uint64_t Triangles() const { return triangles_; }
+};
+
+} // namespace Vulkan
@@ -0,0 +1,158 @@
+#include "vulkan_particles.h"
+#include "vulkan_allocator.h"
+#include "vulkan_dispatch.h"
+#include "vulkan_memory.h"
+#include "vulkan_pipeline.h"
+#include "vulkan_renderer.h"
+#include <iomanip>
+#include <stddef.h>
+#include <vector>
+
+namespace Vulkan {
+
+ParticleSystem::~ParticleSystem() {
+  pipeline_ = nullptr;
+  vkDestroyQueryPool(device_, timestampPool_, AllocationCallbacks());
+  vkDestroyBuffer(device_, buffer_, AllocationCallbacks());
+  vkFreeMemory(device_, memory_, AllocationCallbacks());
+}
+
+std::shared_ptr<ParticleSystem>
+ParticleSystem::Create(VkDevice device, VkPhysicalDevice physicalDevice,
+                       uint32_t queueFamily, uint32_t count) {
+  // the whole buffer is one storage buffer binding, stepped by one
+  // one-dimensional dispatch
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+  auto size = static_cast<VkDeviceSize>(count) * sizeof(Particle);
+  auto groups = (static_cast<uint64_t>(count) + GROUP_SIZE - 1) / GROUP_SIZE;
+  if (size > properties.limits.maxStorageBufferRange ||
+      groups > properties.limits.maxComputeWorkGroupCount[0]) {
+    return nullptr;
+  }
+
+  auto ptr = std::shared_ptr<ParticleSystem>(new ParticleSystem(device, count));
+  if (!CreateBuffer(device, physicalDevice, size,
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &ptr->buffer_,
+                    &ptr->memory_)) {
+    return nullptr;
+  }
+
+  ptr->pipeline_ = ComputePipeline::CreateStorage(
+      device, "shaders/particles_comp.spv", 1, sizeof(Push));
+  if (!ptr->pipeline_) {
+    return nullptr;
+  }
+  ptr->pipeline_->SetBuffer(0, ptr->buffer_);
+
+  uint32_t familyCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount,
+                                           nullptr);
+  std::vector<VkQueueFamilyProperties> families(familyCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount,
+                                           families.data());
+  auto validBits = families[queueFamily].timestampValidBits;
+  if (validBits) {
+    ptr->timestampPeriod_ = properties.limits.timestampPeriod;
+    ptr->timestampMask_ =
+        validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+    VkQueryPoolCreateInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    info.queryCount = 2;
+    if (vkCreateQueryPool(device, &info, AllocationCallbacks(),
+                          &ptr->timestampPool_) != VK_SUCCESS) {
+      return nullptr;
+    }
+  }
+  return ptr;
+}
+
+// the previous dispatch, complete after the frame fence
+void ParticleSystem::Collect() {
+  if (!pending_) {
+    return;
+  }
+  pending_ = false;
+  uint64_t data[4];
+  vkGetQueryPoolResults(device_, timestampPool_, 0, 2, sizeof(data), data,
+                        sizeof(uint64_t) * 2,
+                        VK_QUERY_RESULT_64_BIT |
+                            VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+  if (!data[1] || !data[3]) {
+    return;
+  }
+  auto ticks = (data[2] - data[0]) & timestampMask_;
+  stepMs_ += ticks * timestampPeriod_ * 1e-6;
+  ++steps_;
+}
+
+void ParticleSystem::Dispatch(VkCommandBuffer commandBuffer, float dt) {
+  Push push{};
+  push.dt = dt;
+  push.time = time_;
+  push.count = count_;
+  push.seed = seeded_ ? 0 : 1;
+  if (seeded_) {
+    time_ += dt;
+  }
+  seeded_ = true;
+
+  if (timestampPool_) {
+    Collect();
+    vkCmdResetQueryPool(commandBuffer, timestampPool_, 0, 2);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                        timestampPool_, 0);
+  }
+  Renderer::Dispatch(commandBuffer, *pipeline_, count_, GROUP_SIZE, &push,
+                     sizeof(push));
+  if (timestampPool_) {
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                        timestampPool_, 1);
+    // the seeding pass is not a step
+    pending_ = push.seed == 0;
+  }
+}
+
+void ParticleSystem::Barrier(VkCommandBuffer commandBuffer) {
+  Renderer::ComputeBarrier(commandBuffer, buffer_,
+                           VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                           VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+}
+
+void ParticleSystem::Draw(VkCommandBuffer commandBuffer) {
+  VkDeviceSize offset = 0;
+  vkCmdBindVertexBuffers(commandBuffer, 0, 1, &buffer_, &offset);
+  vkCmdDraw(commandBuffer, count_, 1, 0, 0);
+}
+
+void ParticleSystem::VertexInput(GraphicsPipelineDesc *desc) {
+  desc->vertexStride = sizeof(Particle);
+  desc->attributes = {
+      {0, 0, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(Particle, position)},
+      {1, 0, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(Particle, velocity)},
+  };
+  desc->topology = VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+}
+
+void ParticleSystem::Report(std::ostream &os) {
+  auto now = std::chrono::steady_clock::now();
+  if (now - lastReport_ < std::chrono::seconds(1) || !steps_) {
+    return;
+  }
+  lastReport_ = now;
+  auto ms = stepMs_ / steps_;
+  auto flags = os.flags();
+  auto precision = os.precision();
+  os << std::fixed << std::setprecision(2) << "particles: " << count_
+     << ", step " << ms << " ms, "
+     << (ms > 0 ? count_ / (ms * 1e6) : 0) << " G particles/s" << std::endl;
+  os.flags(flags);
+  os.precision(precision);
+  steps_ = 0;
+  stepMs_ = 0;
+}
+
+} // namespace Vulkan
@@ -0,0 +1,90 @@
+#pragma once
+#include <chrono>
+#include <memory>
+#include <ostream>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+namespace Vulkan {
+
+class ComputePipeline;
+struct GraphicsPipelineDesc;
+
+//
+// GPU particle simulation (--particles), the reference compute workload.
+//
+// One device local buffer of Particles, only ever touched by the GPU: the
+// first Dispatch() places them on a disc, every following one integrates
+// one step of two circling attractors. The same buffer is then the vertex
+// buffer of a point list, one vertex per particle. Timestamps around every
+// dispatch measure the simulation alone; Report() prints its throughput.
+//
+class ParticleSystem {
+public:
+  // std430, also the vertex layout; w unused
+  struct Particle {
+    float position[4];
+    float velocity[4];
+  };
+  // local_size_x of particles.comp
+  static constexpr uint32_t GROUP_SIZE = 256;
+
+private:
+  struct Push {
+    float dt;
+    float time;
+    uint32_t count;
+    // 1: place the particles instead of moving them
+    uint32_t seed;
+  };
+
+  VkDevice device_;
+  uint32_t count_;
+  VkBuffer buffer_ = VK_NULL_HANDLE;
+  VkDeviceMemory memory_ = VK_NULL_HANDLE;
+  std::shared_ptr<ComputePipeline> pipeline_;
+  bool seeded_ = false;
+  float time_ = 0;
+  // a pair per dispatch; null when the queue family has no timestamps
+  VkQueryPool timestampPool_ = VK_NULL_HANDLE;
+  // ns per tick, ticks masked to timestampValidBits
+  double timestampPeriod_ = 0;
+  uint64_t timestampMask_ = 0;
+  bool pending_ = false;
+  // since the last report
+  std::chrono::steady_clock::time_point lastReport_ =
+      std::chrono::steady_clock::now();
+  uint32_t steps_ = 0;
+  double stepMs_ = 0;
+
+  ParticleSystem(VkDevice device, uint32_t count)
+      : device_(device), count_(count) {}
+  void Collect();
+
+public:
+  ~ParticleSystem();
+  ParticleSystem(const ParticleSystem &) = delete;
+  ParticleSystem &operator=(const ParticleSystem &) = delete;
+  // queueFamily: the family Dispatch() is recorded for
+  static std::shared_ptr<ParticleSystem>
+  Create(VkDevice device, VkPhysicalDevice physicalDevice,
+         uint32_t queueFamily, uint32_t count);
+
+  // after the frame fence, outside any render pass: one step of dt
+  // seconds, or the initial placement the first time
+  void Dispatch(VkCommandBuffer commandBuffer, float dt);
+  // make the step visible to the vertex input, for callers that do not
+  // declare the access to a RenderGraph
+  void Barrier(VkCommandBuffer commandBuffer);
+  // with a pipeline built from VertexInput() bound
+  void Draw(VkCommandBuffer commandBuffer);
+  static void VertexInput(GraphicsPipelineDesc *desc);
+
+  VkBuffer Buffer() const { return buffer_; }
+  uint32_t Count() const { return count_; }
+  // once a second: GPU time per step and particles per second since the
+  // last report
+  void Report(std::ostream &os);
+};
+
+} // namespace Vulkan
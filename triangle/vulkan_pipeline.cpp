@@ -1,4 +1,6 @@
 #include "vulkan_pipeline.h"
+#include "vulkan_allocator.h"
+#include "vulkan_dispatch.h"
 #include <fstream>
 #include <vector>
 
@@ -28,8 +30,8 @@ static VkShaderModule createShaderModule(VkDevice device,
   createInfo.pCode = reinterpret_cast<const uint32_t *>(code.data());
 
   VkShaderModule shaderModule;
-  if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) !=
-      VK_SUCCESS) {
+  if (vkCreateShaderModule(device, &createInfo, Vulkan::AllocationCallbacks(),
+                           &shaderModule) != VK_SUCCESS) {
     throw std::runtime_error("failed to create shader module!");
   }
 
@@ -38,13 +40,16 @@ static VkShaderModule createShaderModule(VkDevice device,
 
 namespace Vulkan {
 Pipeline::~Pipeline() {
-  vkDestroyPipeline(device_, graphicsPipeline_, nullptr);
-  vkDestroyPipelineLayout(device_, pipelineLayout_, nullptr);
+  vkDestroyPipeline(device_, graphicsPipeline_, AllocationCallbacks());
+  vkDestroyPipelineLayout(device_, pipelineLayout_, AllocationCallbacks());
 }
 std::shared_ptr<Pipeline>
-Pipeline::CreateGraphicsPipeline(VkDevice device, VkRenderPass renderPass) {
-  auto vertShaderCode = readFile("shaders/vert.spv");
-  auto fragShaderCode = readFile("shaders/frag.spv");
+Pipeline::CreateGraphicsPipeline(VkDevice device, VkRenderPass renderPass,
+                                 VkFormat colorFormat,
+                                 VkSampleCountFlagBits samples,
+                                 const GraphicsPipelineDesc &desc) {
+  auto vertShaderCode = readFile(desc.vert);
+  auto fragShaderCode = readFile(desc.frag);
 
   VkShaderModule vertShaderModule = createShaderModule(device, vertShaderCode);
   VkShaderModule fragShaderModule = createShaderModule(device, fragShaderCode);
@@ -69,13 +74,22 @@ Pipeline::CreateGraphicsPipeline(VkDevice device, VkRenderPass renderPass) {
   VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
   vertexInputInfo.sType =
       VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-  vertexInputInfo.vertexBindingDescriptionCount = 0;
-  vertexInputInfo.vertexAttributeDescriptionCount = 0;
+  VkVertexInputBindingDescription binding{};
+  binding.binding = 0;
+  binding.stride = desc.vertexStride;
+  binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+  if (desc.vertexStride) {
+    vertexInputInfo.vertexBindingDescriptionCount = 1;
+    vertexInputInfo.pVertexBindingDescriptions = &binding;
+    vertexInputInfo.vertexAttributeDescriptionCount =
+        static_cast<uint32_t>(desc.attributes.size());
+    vertexInputInfo.pVertexAttributeDescriptions = desc.attributes.data();
+  }
 
   VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
   inputAssembly.sType =
       VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-  inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+  inputAssembly.topology = desc.topology;
   inputAssembly.primitiveRestartEnable = VK_FALSE;
 
   VkPipelineViewportStateCreateInfo viewportState{};
@@ -97,7 +111,7 @@ Pipeline::CreateGraphicsPipeline(VkDevice device, VkRenderPass renderPass) {
   multisampling.sType =
       VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
   multisampling.sampleShadingEnable = VK_FALSE;
-  multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+  multisampling.rasterizationSamples = samples;
 
   VkPipelineColorBlendAttachmentState colorBlendAttachment{};
   colorBlendAttachment.colorWriteMask =
@@ -126,11 +140,16 @@ Pipeline::CreateGraphicsPipeline(VkDevice device, VkRenderPass renderPass) {
 
   VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
   pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-  pipelineLayoutInfo.setLayoutCount = 0;
-  pipelineLayoutInfo.pushConstantRangeCount = 0;
+  pipelineLayoutInfo.setLayoutCount = desc.setLayout ? 1 : 0;
+  pipelineLayoutInfo.pSetLayouts = &desc.setLayout;
+  VkPushConstantRange pushConstants{};
+  pushConstants.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+  pushConstants.size = desc.pushConstantSize;
+  pipelineLayoutInfo.pushConstantRangeCount = desc.pushConstantSize ? 1 : 0;
+  pipelineLayoutInfo.pPushConstantRanges = &pushConstants;
 
   auto ptr = std::shared_ptr<Pipeline>(new Pipeline(device));
-  if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr,
+  if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, AllocationCallbacks(),
                              &ptr->pipelineLayout_) != VK_SUCCESS) {
     // throw std::runtime_error("failed to create pipeline layout!");
     return nullptr;
@@ -152,16 +171,137 @@ Pipeline::CreateGraphicsPipeline(VkDevice device, VkRenderPass renderPass) {
   pipelineInfo.subpass = 0;
   pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
+  VkPipelineRenderingCreateInfo renderingInfo{};
+  renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+  renderingInfo.colorAttachmentCount = 1;
+  renderingInfo.pColorAttachmentFormats = &colorFormat;
+  if (renderPass == VK_NULL_HANDLE) {
+    pipelineInfo.pNext = &renderingInfo;
+  }
+
   if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo,
-                                nullptr,
+                                AllocationCallbacks(),
                                 &ptr->graphicsPipeline_) != VK_SUCCESS) {
     // throw std::runtime_error("failed to create graphics pipeline!");
     return nullptr;
   }
 
-  vkDestroyShaderModule(device, fragShaderModule, nullptr);
-  vkDestroyShaderModule(device, vertShaderModule, nullptr);
+  vkDestroyShaderModule(device, fragShaderModule, AllocationCallbacks());
+  vkDestroyShaderModule(device, vertShaderModule, AllocationCallbacks());
+  return ptr;
+}
+
+ComputePipeline::~ComputePipeline() {
+  vkDestroyPipeline(device_, pipeline_, AllocationCallbacks());
+  vkDestroyPipelineLayout(device_, pipelineLayout_, AllocationCallbacks());
+  vkDestroyDescriptorPool(device_, descriptorPool_, AllocationCallbacks());
+  vkDestroyDescriptorSetLayout(device_, setLayout_, AllocationCallbacks());
+}
+
+std::shared_ptr<ComputePipeline>
+ComputePipeline::Create(VkDevice device, const char *comp,
+                        VkDescriptorSetLayout setLayout,
+                        uint32_t pushConstantSize) {
+  auto compShaderModule = createShaderModule(device, readFile(comp));
+
+  VkPushConstantRange pushConstants{};
+  pushConstants.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  pushConstants.size = pushConstantSize;
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipelineLayoutInfo.setLayoutCount = setLayout ? 1 : 0;
+  pipelineLayoutInfo.pSetLayouts = &setLayout;
+  pipelineLayoutInfo.pushConstantRangeCount = pushConstantSize ? 1 : 0;
+  pipelineLayoutInfo.pPushConstantRanges = &pushConstants;
+
+  auto ptr = std::shared_ptr<ComputePipeline>(new ComputePipeline(device));
+  if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, AllocationCallbacks(),
+                             &ptr->pipelineLayout_) != VK_SUCCESS) {
+    vkDestroyShaderModule(device, compShaderModule, AllocationCallbacks());
+    // throw std::runtime_error("failed to create pipeline layout!");
+    return nullptr;
+  }
+
+  VkComputePipelineCreateInfo pipelineInfo{};
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipelineInfo.stage.sType =
+      VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  pipelineInfo.stage.module = compShaderModule;
+  pipelineInfo.stage.pName = "main";
+  pipelineInfo.layout = ptr->pipelineLayout_;
+  auto result =
+      vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo,
+                               AllocationCallbacks(), &ptr->pipeline_);
+  vkDestroyShaderModule(device, compShaderModule, AllocationCallbacks());
+  if (result != VK_SUCCESS) {
+    // throw std::runtime_error("failed to create compute pipeline!");
+    return nullptr;
+  }
+  return ptr;
+}
+
+std::shared_ptr<ComputePipeline>
+ComputePipeline::CreateStorage(VkDevice device, const char *comp,
+                               uint32_t storageBuffers,
+                               uint32_t pushConstantSize) {
+  std::vector<VkDescriptorSetLayoutBinding> bindings(storageBuffers);
+  for (uint32_t i = 0; i < storageBuffers; ++i) {
+    bindings[i].binding = i;
+    bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[i].descriptorCount = 1;
+    bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  }
+  VkDescriptorSetLayoutCreateInfo layoutInfo{};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.bindingCount = storageBuffers;
+  layoutInfo.pBindings = bindings.data();
+  VkDescriptorSetLayout setLayout;
+  if (vkCreateDescriptorSetLayout(device, &layoutInfo, AllocationCallbacks(),
+                                  &setLayout) != VK_SUCCESS) {
+    return nullptr;
+  }
+  auto ptr = Create(device, comp, setLayout, pushConstantSize);
+  if (!ptr) {
+    vkDestroyDescriptorSetLayout(device, setLayout, AllocationCallbacks());
+    return nullptr;
+  }
+  ptr->setLayout_ = setLayout;
+
+  VkDescriptorPoolSize poolSize{};
+  poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  poolSize.descriptorCount = storageBuffers;
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.maxSets = 1;
+  poolInfo.poolSizeCount = 1;
+  poolInfo.pPoolSizes = &poolSize;
+  if (vkCreateDescriptorPool(device, &poolInfo, AllocationCallbacks(),
+                             &ptr->descriptorPool_) != VK_SUCCESS) {
+    return nullptr;
+  }
+  VkDescriptorSetAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool = ptr->descriptorPool_;
+  allocInfo.descriptorSetCount = 1;
+  allocInfo.pSetLayouts = &ptr->setLayout_;
+  if (vkAllocateDescriptorSets(device, &allocInfo, &ptr->descriptorSet_) !=
+      VK_SUCCESS) {
+    return nullptr;
+  }
   return ptr;
 }
 
+void ComputePipeline::SetBuffer(uint32_t binding, VkBuffer buffer) {
+  VkDescriptorBufferInfo bufferInfo{buffer, 0, VK_WHOLE_SIZE};
+  VkWriteDescriptorSet write{};
+  write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write.dstSet = descriptorSet_;
+  write.dstBinding = binding;
+  write.descriptorCount = 1;
+  write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  write.pBufferInfo = &bufferInfo;
+  vkUpdateDescriptorSets(device_, 1, &write, 0, nullptr);
+}
+
 } // namespace Vulkan
@@ -1,19 +1,65 @@
 #pragma once
 #include <memory>
+#include <vector>
 #include <vulkan/vulkan.h>
 
 namespace Vulkan {
+struct GraphicsPipelineDesc {
+  const char *vert = "shaders/vert.spv";
+  const char *frag = "shaders/frag.spv";
+  // set 0, if any
+  VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+  // vertex buffer binding 0; no vertex input when 0
+  uint32_t vertexStride = 0;
+  std::vector<VkVertexInputAttributeDescription> attributes;
+  // vertex stage push constants
+  uint32_t pushConstantSize = 0;
+  VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+};
+
 class Pipeline {
   VkDevice device_;
-  VkPipelineLayout pipelineLayout_;
 
   Pipeline(VkDevice device) : device_(device) {}
 
 public:
+  VkPipelineLayout pipelineLayout_;
   VkPipeline graphicsPipeline_;
   ~Pipeline();
+  // renderPass == VK_NULL_HANDLE builds the pipeline for dynamic rendering
+  // against colorFormat
   static std::shared_ptr<Pipeline>
-  CreateGraphicsPipeline(VkDevice device, VkRenderPass renderPass);
+  CreateGraphicsPipeline(VkDevice device, VkRenderPass renderPass,
+                         VkFormat colorFormat,
+                         VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT,
+                         const GraphicsPipelineDesc &desc = {});
+};
+
+class ComputePipeline {
+  VkDevice device_;
+  // CreateStorage() only
+  VkDescriptorSetLayout setLayout_ = VK_NULL_HANDLE;
+  VkDescriptorPool descriptorPool_ = VK_NULL_HANDLE;
+
+  ComputePipeline(VkDevice device) : device_(device) {}
+
+public:
+  VkPipelineLayout pipelineLayout_ = VK_NULL_HANDLE;
+  VkPipeline pipeline_ = VK_NULL_HANDLE;
+  // CreateStorage(): set 0, bound by Renderer::Dispatch()
+  VkDescriptorSet descriptorSet_ = VK_NULL_HANDLE;
+  ~ComputePipeline();
+  // setLayout is set 0, push constants are for the compute stage
+  static std::shared_ptr<ComputePipeline>
+  Create(VkDevice device, const char *comp, VkDescriptorSetLayout setLayout,
+         uint32_t pushConstantSize = 0);
+  // with its own set 0 of storageBuffers storage buffers, bindings
+  // 0 .. storageBuffers - 1, filled by SetBuffer()
+  static std::shared_ptr<ComputePipeline>
+  CreateStorage(VkDevice device, const char *comp, uint32_t storageBuffers,
+                uint32_t pushConstantSize = 0);
+  // before the first dispatch that uses binding
+  void SetBuffer(uint32_t binding, VkBuffer buffer);
 };
 
 } // namespace Vulkan
\ No newline at end of file
@@ -0,0 +1,562 @@
+#include "vulkan_render_graph.h"
+#include "vulkan_allocator.h"
+#include "vulkan_dispatch.h"
+#include "vulkan_memory.h"
+#include <algorithm>
+#include <set>
+#include <stdexcept>
+
+static VkImageUsageFlags UsageFor(VkImageLayout layout) {
+  switch (layout) {
+  case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
+    return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+  case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
+    return VK_IMAGE_USAGE_SAMPLED_BIT;
+  case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
+    return VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+  case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
+    return VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+  case VK_IMAGE_LAYOUT_GENERAL:
+    return VK_IMAGE_USAGE_STORAGE_BIT;
+  default:
+    return 0;
+  }
+}
+
+namespace Vulkan {
+
+///
+/// PassBuilder
+///
+RenderGraph::PassBuilder &
+RenderGraph::PassBuilder::Color(Resource resource,
+                                std::optional<VkClearColorValue> clear,
+                                Resource resolve) {
+  Access a{};
+  a.resource = resource;
+  a.stage = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+  a.access = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+  if (!clear) {
+    a.access |= VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT;
+  }
+  a.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  a.write = true;
+  a.discards = clear.has_value();
+  a.color = true;
+  a.clear = clear;
+  a.resolve = resolve;
+  graph_->passes_[pass_].accesses.push_back(a);
+  if (resolve != NONE) {
+    Access r{};
+    r.resource = resolve;
+    r.stage = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+    r.access = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+    r.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    r.write = true;
+    r.discards = true;
+    graph_->passes_[pass_].accesses.push_back(r);
+  }
+  return *this;
+}
+
+RenderGraph::PassBuilder &
+RenderGraph::PassBuilder::Sampled(Resource resource,
+                                  VkPipelineStageFlags2 stage) {
+  return Read(resource, stage, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+              VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+}
+
+RenderGraph::PassBuilder &
+RenderGraph::PassBuilder::TransferSrc(Resource resource) {
+  return Read(resource, VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+              VK_ACCESS_2_TRANSFER_READ_BIT,
+              VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+}
+
+RenderGraph::PassBuilder &
+RenderGraph::PassBuilder::TransferDst(Resource resource) {
+  return Write(resource, VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+               VK_ACCESS_2_TRANSFER_WRITE_BIT,
+               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+}
+
+RenderGraph::PassBuilder &
+RenderGraph::PassBuilder::Read(Resource resource, VkPipelineStageFlags2 stage,
+                               VkAccessFlags2 access, VkImageLayout layout) {
+  Access a{};
+  a.resource = resource;
+  a.stage = stage;
+  a.access = access;
+  a.layout = layout;
+  a.write = false;
+  graph_->passes_[pass_].accesses.push_back(a);
+  return *this;
+}
+
+RenderGraph::PassBuilder &
+RenderGraph::PassBuilder::Write(Resource resource, VkPipelineStageFlags2 stage,
+                                VkAccessFlags2 access, VkImageLayout layout) {
+  Access a{};
+  a.resource = resource;
+  a.stage = stage;
+  a.access = access;
+  a.layout = layout;
+  a.write = true;
+  graph_->passes_[pass_].accesses.push_back(a);
+  return *this;
+}
+
+///
+/// RenderGraph
+///
+RenderGraph::~RenderGraph() { DestroyTransients(); }
+
+std::shared_ptr<RenderGraph>
+RenderGraph::Create(VkDevice device, VkPhysicalDevice physicalDevice,
+                    DeletionQueue *deletionQueue) {
+  return std::shared_ptr<RenderGraph>(
+      new RenderGraph(device, physicalDevice, deletionQueue));
+}
+
+RenderGraph::Resource RenderGraph::ImportImage(const char *name,
+                                               VkFormat format,
+                                               VkImageLayout finalLayout) {
+  ResourceEntry r;
+  r.name = name;
+  r.imported = true;
+  r.desc.format = format;
+  r.finalLayout = finalLayout;
+  resources_.push_back(r);
+  compiled_ = false;
+  return static_cast<Resource>(resources_.size() - 1);
+}
+
+RenderGraph::Resource
+RenderGraph::ImportBuffer(const char *name, const ResourceState &finalState) {
+  ResourceEntry r;
+  r.name = name;
+  r.imported = true;
+  r.isBuffer = true;
+  r.finalState = finalState;
+  resources_.push_back(r);
+  compiled_ = false;
+  return static_cast<Resource>(resources_.size() - 1);
+}
+
+RenderGraph::Resource RenderGraph::CreateImage(const char *name,
+                                               const ImageDesc &desc) {
+  ResourceEntry r;
+  r.name = name;
+  r.desc = desc;
+  resources_.push_back(r);
+  compiled_ = false;
+  return static_cast<Resource>(resources_.size() - 1);
+}
+
+RenderGraph::PassBuilder RenderGraph::AddPass(const char *name,
+                                              const Callback &callback) {
+  passes_.push_back(Pass{name, callback, {}});
+  compiled_ = false;
+  return PassBuilder(this, passes_.size() - 1);
+}
+
+void RenderGraph::Output(Resource resource) {
+  resources_[resource].output = true;
+  compiled_ = false;
+}
+
+void RenderGraph::Reset() {
+  DestroyTransients();
+  passes_.clear();
+  resources_.clear();
+  compiled_ = false;
+}
+
+void RenderGraph::DestroyTransients() {
+  for (auto &r : resources_) {
+    if (r.imported) {
+      continue;
+    }
+    if (deletionQueue_) {
+      deletionQueue_->Destroy(r.view);
+      deletionQueue_->Destroy(r.image);
+    } else {
+      vkDestroyImageView(device_, r.view, AllocationCallbacks());
+      vkDestroyImage(device_, r.image, AllocationCallbacks());
+    }
+    r.view = VK_NULL_HANDLE;
+    r.image = VK_NULL_HANDLE;
+  }
+  for (auto memory : memory_) {
+    if (deletionQueue_) {
+      deletionQueue_->Destroy(memory);
+    } else {
+      vkFreeMemory(device_, memory, AllocationCallbacks());
+    }
+  }
+  memory_.clear();
+  compiled_ = false;
+}
+
+// Walk backwards from the outputs; a pass survives if it writes something a
+// later surviving pass (or the output) needs.
+void RenderGraph::Cull() {
+  std::set<Resource> needed;
+  for (Resource i = 0; i < resources_.size(); ++i) {
+    if (resources_[i].output) {
+      needed.insert(i);
+    }
+  }
+
+  for (auto pass = passes_.rbegin(); pass != passes_.rend(); ++pass) {
+    pass->alive = false;
+    for (auto &a : pass->accesses) {
+      if (a.write && needed.count(a.resource)) {
+        pass->alive = true;
+        break;
+      }
+    }
+    if (!pass->alive) {
+      continue;
+    }
+    for (auto &a : pass->accesses) {
+      if (a.discards && !resources_[a.resource].output) {
+        needed.erase(a.resource);
+      }
+    }
+    for (auto &a : pass->accesses) {
+      if (!a.discards) {
+        needed.insert(a.resource);
+      }
+    }
+  }
+}
+
+void RenderGraph::ComputeLifetimes() {
+  for (auto &r : resources_) {
+    r.first = -1;
+    r.last = -1;
+    r.usage = 0;
+    r.aliasOf = NONE;
+  }
+  for (int i = 0; i < static_cast<int>(passes_.size()); ++i) {
+    auto &pass = passes_[i];
+    if (!pass.alive) {
+      continue;
+    }
+    for (auto &a : pass.accesses) {
+      auto &r = resources_[a.resource];
+      if (r.first < 0) {
+        r.first = i;
+      }
+      if (r.last != i) {
+        r.lastStage = VK_PIPELINE_STAGE_2_NONE;
+        r.lastAccess = VK_ACCESS_2_NONE;
+      }
+      r.last = i;
+      r.lastStage |= a.stage;
+      if (a.write) {
+        r.lastAccess |= a.access;
+      }
+      r.usage |= UsageFor(a.layout);
+    }
+  }
+}
+
+bool RenderGraph::ReadLater(Resource resource, int passIndex) const {
+  for (int i = passIndex + 1; i < static_cast<int>(passes_.size()); ++i) {
+    if (!passes_[i].alive) {
+      continue;
+    }
+    for (auto &a : passes_[i].accesses) {
+      if (a.resource == resource && !a.discards) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// Greedy interval packing: the biggest transients pick memory first, each
+// memory block is shared by transients whose pass ranges do not overlap.
+bool RenderGraph::Allocate() {
+  struct Slot {
+    VkDeviceSize size = 0;
+    VkDeviceSize alignment = 1;
+    uint32_t memoryTypeBits = ~0u;
+    bool transientAttachment = false;
+    std::vector<Resource> users;
+  };
+  std::vector<Slot> slots;
+  std::vector<std::pair<Resource, VkMemoryRequirements>> transients;
+
+  for (Resource i = 0; i < resources_.size(); ++i) {
+    auto &r = resources_[i];
+    if (r.imported || r.first < 0) {
+      continue;
+    }
+
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = r.desc.format;
+    imageInfo.extent = {r.desc.extent.width, r.desc.extent.height, 1};
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = r.desc.samples;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = r.usage;
+    if (r.desc.transientAttachment) {
+      imageInfo.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+    }
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    if (vkCreateImage(device_, &imageInfo, AllocationCallbacks(),
+                      &r.image) != VK_SUCCESS) {
+      return false;
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(device_, r.image, &requirements);
+    if (r.desc.transientAttachment) {
+      // lazily allocated memory has no size to share, give it its own block
+      Slot slot;
+      slot.size = requirements.size;
+      slot.memoryTypeBits = requirements.memoryTypeBits;
+      slot.transientAttachment = true;
+      slot.users.push_back(i);
+      slots.push_back(slot);
+      continue;
+    }
+    transients.push_back({i, requirements});
+  }
+
+  std::sort(transients.begin(), transients.end(),
+            [](auto &a, auto &b) { return a.second.size > b.second.size; });
+
+  for (auto &[resource, requirements] : transients) {
+    auto &r = resources_[resource];
+    Slot *found = nullptr;
+    for (auto &slot : slots) {
+      if (slot.transientAttachment ||
+          !(slot.memoryTypeBits & requirements.memoryTypeBits)) {
+        continue;
+      }
+      bool overlaps = false;
+      for (auto user : slot.users) {
+        auto &u = resources_[user];
+        if (!(u.last < r.first || r.last < u.first)) {
+          overlaps = true;
+          break;
+        }
+      }
+      if (!overlaps) {
+        found = &slot;
+        break;
+      }
+    }
+    if (!found) {
+      slots.push_back({});
+      found = &slots.back();
+    }
+    found->size = std::max(found->size, requirements.size);
+    found->alignment = std::max(found->alignment, requirements.alignment);
+    found->memoryTypeBits &= requirements.memoryTypeBits;
+    found->users.push_back(resource);
+  }
+
+  for (auto &slot : slots) {
+    auto memoryType = FindAttachmentMemoryType(
+        physicalDevice_, slot.memoryTypeBits, slot.transientAttachment);
+    if (!memoryType) {
+      return false;
+    }
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = slot.size;
+    allocInfo.memoryTypeIndex = *memoryType;
+    VkDeviceMemory memory;
+    if (vkAllocateMemory(device_, &allocInfo, AllocationCallbacks(), &memory) !=
+        VK_SUCCESS) {
+      return false;
+    }
+    memory_.push_back(memory);
+
+    std::sort(slot.users.begin(), slot.users.end(), [this](auto a, auto b) {
+      return resources_[a].first < resources_[b].first;
+    });
+    Resource previous = NONE;
+    for (auto user : slot.users) {
+      auto &r = resources_[user];
+      r.aliasOf = previous;
+      previous = user;
+      vkBindImageMemory(device_, r.image, memory, 0);
+
+      VkImageViewCreateInfo viewInfo{};
+      viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+      viewInfo.image = r.image;
+      viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+      viewInfo.format = r.desc.format;
+      viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+      viewInfo.subresourceRange.levelCount = 1;
+      viewInfo.subresourceRange.layerCount = 1;
+      if (vkCreateImageView(device_, &viewInfo, AllocationCallbacks(),
+                            &r.view) != VK_SUCCESS) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+bool RenderGraph::Compile() {
+  DestroyTransients();
+  Cull();
+  ComputeLifetimes();
+  if (!Allocate()) {
+    DestroyTransients();
+    return false;
+  }
+  compiled_ = true;
+  return true;
+}
+
+void RenderGraph::BindImage(Resource resource, VkImage image,
+                            VkImageView view, VkExtent2D extent,
+                            const ResourceState &initialState) {
+  auto &r = resources_[resource];
+  r.image = image;
+  r.view = view;
+  r.desc.extent = extent;
+  r.initialState = initialState;
+}
+
+void RenderGraph::SetRenderArea(Resource resource, VkExtent2D area) {
+  resources_[resource].area = area;
+}
+
+void RenderGraph::BindBuffer(Resource resource, VkBuffer buffer,
+                             const ResourceState &initialState) {
+  auto &r = resources_[resource];
+  r.buffer = buffer;
+  r.initialState = initialState;
+}
+
+bool RenderGraph::IsAlive(const char *pass) const {
+  for (auto &p : passes_) {
+    if (p.name == pass) {
+      return p.alive;
+    }
+  }
+  return false;
+}
+
+void RenderGraph::Execute(VkCommandBuffer commandBuffer,
+                          BarrierTracker &barriers) {
+  if (!compiled_) {
+    throw std::runtime_error("render graph is not compiled!");
+  }
+
+  for (auto &r : resources_) {
+    if (!r.imported || r.first < 0) {
+      continue;
+    }
+    if (r.isBuffer) {
+      barriers.Import(r.buffer, r.initialState);
+    } else {
+      barriers.Import(r.image, r.initialState);
+    }
+  }
+
+  std::vector<VkRenderingAttachmentInfo> colorAttachments;
+  for (int i = 0; i < static_cast<int>(passes_.size()); ++i) {
+    auto &pass = passes_[i];
+    if (!pass.alive) {
+      continue;
+    }
+
+    colorAttachments.clear();
+    VkExtent2D renderArea = {0, 0};
+    for (auto &a : pass.accesses) {
+      auto &r = resources_[a.resource];
+      if (r.isBuffer) {
+        barriers.Buffer(r.buffer, a.stage, a.access);
+        continue;
+      }
+      if (!r.imported && r.first == i) {
+        // contents of a transient are undefined on first use; when it
+        // reuses memory the previous occupant has to be done with it
+        ResourceState discard;
+        if (r.aliasOf != NONE) {
+          discard.stage = resources_[r.aliasOf].lastStage;
+          discard.access = resources_[r.aliasOf].lastAccess;
+        }
+        barriers.Import(r.image, discard);
+      }
+      barriers.Image(r.image, a.stage, a.access, a.layout);
+
+      if (a.color) {
+        VkRenderingAttachmentInfo attachment{};
+        attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+        attachment.imageView = r.view;
+        attachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        attachment.loadOp =
+            a.clear ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
+        if (a.clear) {
+          attachment.clearValue.color = *a.clear;
+        }
+        attachment.storeOp =
+            (r.imported || r.output || ReadLater(a.resource, i))
+                ? VK_ATTACHMENT_STORE_OP_STORE
+                : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        if (a.resolve != NONE) {
+          attachment.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
+          attachment.resolveImageView = resources_[a.resolve].view;
+          attachment.resolveImageLayout =
+              VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        }
+        colorAttachments.push_back(attachment);
+        if (renderArea.width == 0) {
+          renderArea = Extent(a.resource);
+        }
+      }
+    }
+    barriers.Flush(commandBuffer);
+
+    if (colorAttachments.empty()) {
+      pass.callback(commandBuffer, *this);
+      continue;
+    }
+
+    VkRenderingInfo renderingInfo{};
+    renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+    renderingInfo.renderArea.offset = {0, 0};
+    renderingInfo.renderArea.extent = renderArea;
+    renderingInfo.layerCount = 1;
+    renderingInfo.colorAttachmentCount =
+        static_cast<uint32_t>(colorAttachments.size());
+    renderingInfo.pColorAttachments = colorAttachments.data();
+
+    vkCmdBeginRendering(commandBuffer, &renderingInfo);
+    pass.callback(commandBuffer, *this);
+    vkCmdEndRendering(commandBuffer);
+  }
+
+  for (auto &r : resources_) {
+    if (!r.imported || r.first < 0) {
+      continue;
+    }
+    if (r.isBuffer) {
+      if (r.finalState.stage != VK_PIPELINE_STAGE_2_NONE) {
+        barriers.Buffer(r.buffer, r.finalState.stage, r.finalState.access);
+      }
+    } else if (r.finalLayout != VK_IMAGE_LAYOUT_UNDEFINED) {
+      barriers.Image(r.image, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE,
+                     r.finalLayout);
+    }
+  }
+  barriers.Flush(commandBuffer);
+}
+
+} // namespace Vulkan
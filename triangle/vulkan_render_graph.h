@@ -0,0 +1,181 @@
+#pragma once
+#include "vulkan_barrier.h"
+#include "vulkan_deletion_queue.h"
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace Vulkan {
+
+//
+// Frame graph on top of dynamic rendering.
+//
+// Passes declare which virtual resources they read and write. Compile()
+// culls passes that do not contribute to an output, computes the lifetime of
+// every transient image and lets transients with disjoint lifetimes share one
+// VkDeviceMemory. Execute() derives the barriers from the declared accesses
+// through a BarrierTracker and wraps passes with color attachments in
+// vkCmdBeginRendering / vkCmdEndRendering.
+//
+// The graph only has to be compiled again when passes or transient
+// descriptions change; imported resources are rebound every frame.
+//
+class RenderGraph {
+public:
+  using Resource = uint32_t;
+  static constexpr Resource NONE = ~0u;
+  using Callback =
+      std::function<void(VkCommandBuffer commandBuffer, const RenderGraph &)>;
+
+  struct ImageDesc {
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkExtent2D extent = {0, 0};
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+    // only ever used as an attachment inside one pass (e.g. an MSAA target
+    // resolved in-pass): TRANSIENT_ATTACHMENT usage, LAZILY_ALLOCATED memory
+    // where available and never aliased
+    bool transientAttachment = false;
+  };
+
+private:
+  struct Access {
+    Resource resource;
+    VkPipelineStageFlags2 stage;
+    VkAccessFlags2 access;
+    VkImageLayout layout;
+    bool write;
+    // color attachment cleared on load: earlier contents are dead
+    bool discards = false;
+    bool color = false;
+    std::optional<VkClearColorValue> clear;
+    Resource resolve = NONE;
+  };
+
+  struct Pass {
+    std::string name;
+    Callback callback;
+    std::vector<Access> accesses;
+    bool alive = false;
+  };
+
+  struct ResourceEntry {
+    std::string name;
+    bool imported = false;
+    bool isBuffer = false;
+    ImageDesc desc;
+    VkImageUsageFlags usage = 0;
+    // imported: bound per frame
+    VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    // imported buffer: made visible to this after the last pass
+    ResourceState finalState;
+    ResourceState initialState;
+    VkBuffer buffer = VK_NULL_HANDLE;
+    // image, transient or bound
+    VkImage image = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+    // per frame part that is rendered to, from the origin; {0, 0}: all of it
+    VkExtent2D area = {0, 0};
+    // lifetime in alive pass indices
+    int first = -1;
+    int last = -1;
+    bool output = false;
+    // previous transient in the same memory, its last use must finish first
+    Resource aliasOf = NONE;
+    VkPipelineStageFlags2 lastStage = VK_PIPELINE_STAGE_2_NONE;
+    VkAccessFlags2 lastAccess = VK_ACCESS_2_NONE;
+  };
+
+  VkDevice device_;
+  VkPhysicalDevice physicalDevice_;
+  // transients of a previous compile may still be in use by a frame in
+  // flight; destroyed immediately when null
+  DeletionQueue *deletionQueue_;
+  std::vector<Pass> passes_;
+  std::vector<ResourceEntry> resources_;
+  std::vector<VkDeviceMemory> memory_;
+  bool compiled_ = false;
+
+  RenderGraph(VkDevice device, VkPhysicalDevice physicalDevice,
+              DeletionQueue *deletionQueue)
+      : device_(device), physicalDevice_(physicalDevice),
+        deletionQueue_(deletionQueue) {}
+  void DestroyTransients();
+  void Cull();
+  void ComputeLifetimes();
+  bool Allocate();
+  bool ReadLater(Resource resource, int passIndex) const;
+
+public:
+  class PassBuilder {
+    RenderGraph *graph_;
+    size_t pass_;
+
+  public:
+    PassBuilder(RenderGraph *graph, size_t pass) : graph_(graph), pass_(pass) {}
+    // color attachment; cleared when clear is set, loaded otherwise. A
+    // multisampled attachment can resolve into `resolve`.
+    PassBuilder &Color(Resource resource,
+                       std::optional<VkClearColorValue> clear = std::nullopt,
+                       Resource resolve = NONE);
+    PassBuilder &Sampled(Resource resource,
+                         VkPipelineStageFlags2 stage =
+                             VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT);
+    PassBuilder &TransferSrc(Resource resource);
+    PassBuilder &TransferDst(Resource resource);
+    // anything else, e.g. storage buffers of a compute pass
+    PassBuilder &Read(Resource resource, VkPipelineStageFlags2 stage,
+                      VkAccessFlags2 access,
+                      VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED);
+    PassBuilder &Write(Resource resource, VkPipelineStageFlags2 stage,
+                       VkAccessFlags2 access,
+                       VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED);
+  };
+
+  ~RenderGraph();
+  static std::shared_ptr<RenderGraph>
+  Create(VkDevice device, VkPhysicalDevice physicalDevice,
+         DeletionQueue *deletionQueue = nullptr);
+
+  // topology
+  Resource ImportImage(const char *name, VkFormat format,
+                       VkImageLayout finalLayout);
+  // finalState: what reads the buffer after the graph, e.g. the host
+  Resource ImportBuffer(const char *name,
+                        const ResourceState &finalState = {});
+  Resource CreateImage(const char *name, const ImageDesc &desc);
+  PassBuilder AddPass(const char *name, const Callback &callback);
+  void Output(Resource resource);
+  // drop every pass and resource
+  void Reset();
+  bool Compile();
+  bool IsCompiled() const { return compiled_; }
+
+  // per frame
+  void BindImage(Resource resource, VkImage image, VkImageView view,
+                 VkExtent2D extent, const ResourceState &initialState);
+  void BindBuffer(Resource resource, VkBuffer buffer,
+                  const ResourceState &initialState = {});
+  // render into the top left `area` of an image only: the render area of
+  // the passes it is the first color attachment of and what Extent()
+  // returns. At most the size it was created or bound with; {0, 0}: all
+  void SetRenderArea(Resource resource, VkExtent2D area);
+  void Execute(VkCommandBuffer commandBuffer, BarrierTracker &barriers);
+
+  VkImage Image(Resource resource) const { return resources_[resource].image; }
+  VkImageView View(Resource resource) const {
+    return resources_[resource].view;
+  }
+  VkBuffer Buffer(Resource resource) const {
+    return resources_[resource].buffer;
+  }
+  VkExtent2D Extent(Resource resource) const {
+    auto &r = resources_[resource];
+    return r.area.width ? r.area : r.desc.extent;
+  }
+  bool IsAlive(const char *pass) const;
+};
+
+} // namespace Vulkan
@@ -1,10 +1,13 @@
 #include "vulkan_renderer.h"
+#include "vulkan_dispatch.h"
+#include "vulkan_pipeline.h"
 #include "vulkan_swapchain.h"
 
 namespace Vulkan {
 
 std::shared_ptr<Renderer>
-Renderer::CreateCommandPool(VkDevice device, VkPhysicalDevice physicalDevice,
+Renderer::CreateCommandPool(const std::shared_ptr<Device> &device,
+                            VkPhysicalDevice physicalDevice,
                             VkSurfaceKHR surface) {
   auto queueFamilyIndices =
       Vulkan::QueueFamilyIndices::FindQueueFamilies(physicalDevice, surface);
@@ -15,8 +18,9 @@ Renderer::CreateCommandPool(VkDevice device, VkPhysicalDevice physicalDevice,
   poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
 
   auto ptr = std::shared_ptr<Renderer>(new Renderer(device));
-  if (vkCreateCommandPool(device, &poolInfo, nullptr, &ptr->commandPool_) !=
-      VK_SUCCESS) {
+  auto &vk = device->table_;
+  if (vk.vkCreateCommandPool(device->device_, &poolInfo, AllocationCallbacks(),
+                             &ptr->commandPool_) != VK_SUCCESS) {
     // throw std::runtime_error("failed to create command pool!");
     return nullptr;
   }
@@ -28,8 +32,8 @@ Renderer::CreateCommandPool(VkDevice device, VkPhysicalDevice physicalDevice,
   allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
   allocInfo.commandBufferCount = 1;
 
-  if (vkAllocateCommandBuffers(device, &allocInfo, &ptr->commandBuffer_) !=
-      VK_SUCCESS) {
+  if (vk.vkAllocateCommandBuffers(device->device_, &allocInfo,
+                                  &ptr->commandBuffer_) != VK_SUCCESS) {
     // throw std::runtime_error("failed to allocate command buffers!");
     return nullptr;
   }
@@ -37,17 +41,97 @@ Renderer::CreateCommandPool(VkDevice device, VkPhysicalDevice physicalDevice,
   return ptr;
 }
 
-const VkCommandBuffer *Renderer::Render(VkRenderPass renderPass,
-                                        VkFramebuffer framebuffer,
-                                        VkExtent2D extent,
-                                        VkPipeline pipeline) {
-  vkResetCommandBuffer(commandBuffer_, /*VkCommandBufferResetFlagBits*/ 0);
+void Renderer::Begin() {
+  auto &vk = device_->table_;
+  vk.vkResetCommandBuffer(commandBuffer_, /*VkCommandBufferResetFlagBits*/ 0);
   VkCommandBufferBeginInfo beginInfo{};
   beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 
-  if (vkBeginCommandBuffer(commandBuffer_, &beginInfo) != VK_SUCCESS) {
+  if (vk.vkBeginCommandBuffer(commandBuffer_, &beginInfo) != VK_SUCCESS) {
     throw std::runtime_error("failed to begin recording command buffer!");
   }
+  if (metrics_) {
+    metrics_->Begin(commandBuffer_);
+  }
+}
+
+void Renderer::SetViewport(VkCommandBuffer commandBuffer, VkExtent2D extent) {
+  VkViewport viewport{};
+  viewport.x = 0.0f;
+  viewport.y = 0.0f;
+  viewport.width = (float)extent.width;
+  viewport.height = (float)extent.height;
+  viewport.minDepth = 0.0f;
+  viewport.maxDepth = 1.0f;
+  vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+  VkRect2D scissor{};
+  scissor.offset = {0, 0};
+  scissor.extent = extent;
+  vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+}
+
+void Renderer::Draw(VkCommandBuffer commandBuffer, VkExtent2D extent,
+                    VkPipeline pipeline) {
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+  SetViewport(commandBuffer, extent);
+  vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+}
+
+void Renderer::Dispatch(VkCommandBuffer commandBuffer,
+                        const ComputePipeline &pipeline, uint32_t count,
+                        uint32_t groupSize, const void *push,
+                        uint32_t pushSize) {
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                    pipeline.pipeline_);
+  if (pipeline.descriptorSet_) {
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            pipeline.pipelineLayout_, 0, 1,
+                            &pipeline.descriptorSet_, 0, nullptr);
+  }
+  if (pushSize) {
+    vkCmdPushConstants(commandBuffer, pipeline.pipelineLayout_,
+                       VK_SHADER_STAGE_COMPUTE_BIT, 0, pushSize, push);
+  }
+  vkCmdDispatch(commandBuffer, (count + groupSize - 1) / groupSize, 1, 1);
+}
+
+void Renderer::ComputeBarrier(VkCommandBuffer commandBuffer, VkBuffer buffer,
+                              VkPipelineStageFlags dstStage,
+                              VkAccessFlags dstAccess) {
+  VkBufferMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = dstAccess;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.buffer = buffer;
+  barrier.offset = 0;
+  barrier.size = VK_WHOLE_SIZE;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       dstStage, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+void Renderer::End() {
+  if (metrics_) {
+    metrics_->End(commandBuffer_);
+  }
+  if (device_->table_.vkEndCommandBuffer(commandBuffer_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to record command buffer!");
+  }
+}
+
+const VkCommandBuffer *Renderer::Render(
+    VkRenderPass renderPass, VkFramebuffer framebuffer, VkExtent2D extent,
+    const std::function<void(VkCommandBuffer)> &draw,
+    const std::function<void(VkCommandBuffer, BarrierTracker &)>
+        &afterRenderPass,
+    const std::function<void(VkCommandBuffer)> &beforeRenderPass) {
+  Begin();
+
+  if (beforeRenderPass) {
+    beforeRenderPass(commandBuffer_);
+  }
 
   VkRenderPassBeginInfo renderPassInfo{};
   renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
@@ -56,37 +140,41 @@ const VkCommandBuffer *Renderer::Render(VkRenderPass renderPass,
   renderPassInfo.renderArea.offset = {0, 0};
   renderPassInfo.renderArea.extent = extent;
 
-  VkClearValue clearColor = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
+  VkClearValue clearColor;
+  clearColor.color = clearColor_;
   renderPassInfo.clearValueCount = 1;
   renderPassInfo.pClearValues = &clearColor;
 
-  vkCmdBeginRenderPass(commandBuffer_, &renderPassInfo,
-                       VK_SUBPASS_CONTENTS_INLINE);
+  auto &vk = device_->table_;
+  vk.vkCmdBeginRenderPass(commandBuffer_, &renderPassInfo,
+                          VK_SUBPASS_CONTENTS_INLINE);
 
-  vkCmdBindPipeline(commandBuffer_, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+  draw(commandBuffer_);
 
-  VkViewport viewport{};
-  viewport.x = 0.0f;
-  viewport.y = 0.0f;
-  viewport.width = (float)extent.width;
-  viewport.height = (float)extent.height;
-  viewport.minDepth = 0.0f;
-  viewport.maxDepth = 1.0f;
-  vkCmdSetViewport(commandBuffer_, 0, 1, &viewport);
+  vk.vkCmdEndRenderPass(commandBuffer_);
 
-  VkRect2D scissor{};
-  scissor.offset = {0, 0};
-  scissor.extent = extent;
-  vkCmdSetScissor(commandBuffer_, 0, 1, &scissor);
+  if (afterRenderPass) {
+    afterRenderPass(commandBuffer_, barriers_);
+  }
 
-  vkCmdDraw(commandBuffer_, 3, 1, 0, 0);
+  End();
 
-  vkCmdEndRenderPass(commandBuffer_);
+  return &commandBuffer_;
+}
 
-  if (vkEndCommandBuffer(commandBuffer_) != VK_SUCCESS) {
-    throw std::runtime_error("failed to record command buffer!");
+const VkCommandBuffer *
+Renderer::Render(RenderGraph &graph,
+                 const std::function<void(VkCommandBuffer)> &beforeGraph) {
+  Begin();
+
+  if (beforeGraph) {
+    beforeGraph(commandBuffer_);
   }
 
+  graph.Execute(commandBuffer_, barriers_);
+
+  End();
+
   return &commandBuffer_;
 }
 
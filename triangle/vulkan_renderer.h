@@ -1,23 +1,74 @@
 #pragma once
+#include "vulkan_allocator.h"
+#include "vulkan_barrier.h"
+#include "vulkan_device.h"
+#include "vulkan_gpu_metrics.h"
+#include "vulkan_render_graph.h"
+#include <functional>
 #include <memory>
 #include <vulkan/vulkan.h>
 
 namespace Vulkan {
 
+class ComputePipeline;
+
+// Records through the device's own DeviceTable; the static helpers below have
+// no device and use the global entry points.
 class Renderer {
-  VkDevice device_;
+  std::shared_ptr<Device> device_;
   VkCommandPool commandPool_;
-  Renderer(VkDevice device) : device_(device) {}
+  BarrierTracker barriers_;
+  std::shared_ptr<GpuMetrics> metrics_;
+  VkClearColorValue clearColor_ = {{0.0f, 0.0f, 0.0f, 1.0f}};
+  Renderer(const std::shared_ptr<Device> &device)
+      : device_(device), barriers_(device->synchronization2_) {}
+  void Begin();
+  void End();
 
 public:
   VkCommandBuffer commandBuffer_;
-  ~Renderer() { vkDestroyCommandPool(device_, commandPool_, nullptr); }
+  ~Renderer() {
+    device_->table_.vkDestroyCommandPool(device_->device_, commandPool_,
+                                         AllocationCallbacks());
+  }
   static std::shared_ptr<Renderer>
-  CreateCommandPool(VkDevice device, VkPhysicalDevice physicalDevice,
-                    VkSurfaceKHR surface);
-  const VkCommandBuffer *Render(VkRenderPass renderPass,
-                                VkFramebuffer framebuffer, VkExtent2D extent,
-                                VkPipeline pipeline);
+  CreateCommandPool(const std::shared_ptr<Device> &device,
+                    VkPhysicalDevice physicalDevice, VkSurfaceKHR surface);
+  // draw is called inside the render pass; beforeRenderPass records
+  // transfers and barriers the pass depends on
+  const VkCommandBuffer *
+  Render(VkRenderPass renderPass, VkFramebuffer framebuffer, VkExtent2D extent,
+         const std::function<void(VkCommandBuffer)> &draw,
+         const std::function<void(VkCommandBuffer, BarrierTracker &)>
+             &afterRenderPass = {},
+         const std::function<void(VkCommandBuffer)> &beforeRenderPass = {});
+  // VK_KHR_dynamic_rendering path: no VkRenderPass / VkFramebuffer, the
+  // graph renders straight into its bound image views
+  const VkCommandBuffer *
+  Render(RenderGraph &graph,
+         const std::function<void(VkCommandBuffer)> &beforeGraph = {});
+  // queries around every command buffer recorded from here on; null: off
+  void SetMetrics(const std::shared_ptr<GpuMetrics> &metrics) {
+    metrics_ = metrics;
+  }
+  // render pass path; the graph's passes carry their own clear
+  void SetClearColor(const VkClearColorValue &clear) { clearColor_ = clear; }
+  static void SetViewport(VkCommandBuffer commandBuffer, VkExtent2D extent);
+  // the triangle, inside a render pass or dynamic rendering scope
+  static void Draw(VkCommandBuffer commandBuffer, VkExtent2D extent,
+                   VkPipeline pipeline);
+  // binds pipeline with its storage buffers and push constants and
+  // dispatches enough groups of groupSize (its local_size_x) for count
+  // invocations, outside any render pass
+  static void Dispatch(VkCommandBuffer commandBuffer,
+                       const ComputePipeline &pipeline, uint32_t count,
+                       uint32_t groupSize, const void *push = nullptr,
+                       uint32_t pushSize = 0);
+  // compute shader writes to buffer visible to dstStage / dstAccess, for
+  // callers that do not declare the access to a RenderGraph
+  static void ComputeBarrier(VkCommandBuffer commandBuffer, VkBuffer buffer,
+                             VkPipelineStageFlags dstStage,
+                             VkAccessFlags dstAccess);
 };
 
 } // namespace Vulkan
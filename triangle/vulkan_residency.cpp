@@ -0,0 +1,115 @@
+#include "vulkan_residency.h"
+#include <algorithm>
+
+namespace Vulkan {
+
+std::shared_ptr<ResidencyManager>
+ResidencyManager::Create(VkPhysicalDevice physicalDevice, bool memoryBudget) {
+  return std::shared_ptr<ResidencyManager>(
+      new ResidencyManager(physicalDevice, memoryBudget));
+}
+
+ResidencyManager::Handle ResidencyManager::Register(uint32_t memoryTypeIndex,
+                                                    VkDeviceSize size,
+                                                    uint32_t priority,
+                                                    const Evict &evict) {
+  Handle handle;
+  if (free_.empty()) {
+    handle = static_cast<Handle>(entries_.size());
+    entries_.push_back({});
+  } else {
+    handle = free_.back();
+    free_.pop_back();
+  }
+  auto &e = entries_[handle];
+  e.heap = budget_.HeapIndex(memoryTypeIndex);
+  e.size = size;
+  e.priority = priority;
+  e.lastUsed = frame_;
+  e.evict = evict;
+  e.registered = true;
+  return handle;
+}
+
+void ResidencyManager::Unregister(Handle handle) {
+  entries_[handle] = {};
+  free_.push_back(handle);
+}
+
+void ResidencyManager::Resize(Handle handle, VkDeviceSize size) {
+  entries_[handle].size = size;
+}
+
+bool ResidencyManager::HasHeadroom(uint32_t memoryTypeIndex,
+                                   VkDeviceSize size) const {
+  auto &heap = budget_.Heaps()[budget_.HeapIndex(memoryTypeIndex)];
+  return heap.usage + size <= static_cast<VkDeviceSize>(heap.budget * low_);
+}
+
+// without VK_EXT_memory_budget what is registered is all we know about
+void ResidencyManager::ReportRegistered() {
+  std::vector<VkDeviceSize> bytes(budget_.Heaps().size());
+  for (auto &e : entries_) {
+    if (e.registered) {
+      bytes[e.heap] += e.size;
+    }
+  }
+  for (uint32_t i = 0; i < bytes.size(); ++i) {
+    budget_.Report(i, bytes[i]);
+  }
+}
+
+void ResidencyManager::Update() {
+  ++frame_;
+  if (!budget_.HasExtension()) {
+    ReportRegistered();
+  }
+  budget_.Update();
+
+  for (uint32_t heap = 0; heap < budget_.Heaps().size(); ++heap) {
+    auto &h = budget_.Heaps()[heap];
+    if (h.usage <= static_cast<VkDeviceSize>(h.budget * high_)) {
+      continue;
+    }
+    auto target = static_cast<VkDeviceSize>(h.budget * low_);
+
+    // lowest priority, then least recently used; nothing the previous frame
+    // used, it would only stream straight back in
+    std::vector<Handle> candidates;
+    for (Handle i = 0; i < entries_.size(); ++i) {
+      auto &e = entries_[i];
+      if (e.registered && e.heap == heap && e.size > 0 &&
+          e.lastUsed + 1 < frame_) {
+        candidates.push_back(i);
+      }
+    }
+    std::sort(candidates.begin(), candidates.end(), [this](Handle a, Handle b) {
+      auto &ea = entries_[a];
+      auto &eb = entries_[b];
+      if (ea.priority != eb.priority) {
+        return ea.priority < eb.priority;
+      }
+      return ea.lastUsed < eb.lastUsed;
+    });
+
+    for (auto i : candidates) {
+      if (h.usage <= target) {
+        break;
+      }
+      // shrink one step at a time so a resource with coarser levels left
+      // keeps them
+      auto &e = entries_[i];
+      while (h.usage > target && e.size > 0) {
+        auto released = std::min(e.evict(), e.size);
+        if (released == 0) {
+          break;
+        }
+        e.size -= released;
+        budget_.Release(heap, released);
+        ++evictions_;
+      }
+    }
+  }
+}
+
+} // namespace Vulkan
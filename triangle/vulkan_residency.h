@@ -0,0 +1,76 @@
+#pragma once
+#include "vulkan_memory.h"
+#include <functional>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace Vulkan {
+
+//
+// Keeps streamed resources inside the device memory budget.
+//
+// Streamers register what they allocate together with an eviction callback.
+// Update() polls the budget once per frame; when a heap goes above the high
+// watermark, resources are shrunk (a mip level dropped, a LOD released ...) or
+// evicted, lowest priority and least recently used first, until usage is back
+// under the low watermark. Callbacks must hand their handles to the
+// DeletionQueue rather than destroy them while a frame may still use them.
+//
+class ResidencyManager {
+public:
+  using Handle = uint32_t;
+  // give back memory, returns the bytes released; 0 if it can not shrink
+  using Evict = std::function<VkDeviceSize()>;
+
+private:
+  struct Entry {
+    uint32_t heap = 0;
+    VkDeviceSize size = 0;
+    uint32_t priority = 0;
+    uint64_t lastUsed = 0;
+    Evict evict;
+    bool registered = false;
+  };
+  MemoryBudget budget_;
+  std::vector<Entry> entries_;
+  std::vector<Handle> free_;
+  uint64_t frame_ = 0;
+  uint64_t evictions_ = 0;
+  float high_ = 0.9f;
+  float low_ = 0.8f;
+
+  ResidencyManager(VkPhysicalDevice physicalDevice, bool memoryBudget)
+      : budget_(physicalDevice, memoryBudget) {}
+  void ReportRegistered();
+
+public:
+  static std::shared_ptr<ResidencyManager>
+  Create(VkPhysicalDevice physicalDevice, bool memoryBudget);
+
+  // fractions of the budget
+  void SetWatermarks(float high, float low) {
+    high_ = high;
+    low_ = low;
+  }
+  Handle Register(uint32_t memoryTypeIndex, VkDeviceSize size,
+                  uint32_t priority, const Evict &evict);
+  void Unregister(Handle handle);
+  // the resource is used by the frame being recorded
+  void Touch(Handle handle) { entries_[handle].lastUsed = frame_; }
+  // the resource grew or shrank on its own (e.g. a finer mip streamed in)
+  void Resize(Handle handle, VkDeviceSize size);
+  // would `size` more bytes in this memory type stay under the low
+  // watermark; streamers skip upgrades otherwise (checking against the high
+  // one would evict what was just streamed in)
+  bool HasHeadroom(uint32_t memoryTypeIndex, VkDeviceSize size) const;
+
+  // once per frame
+  void Update();
+
+  const MemoryBudget &Budget() const { return budget_; }
+  uint64_t Evictions() const { return evictions_; }
+};
+
+} // namespace Vulkan
@@ -1,4 +1,5 @@
 #include "vulkan_swapchain.h"
+#include "vulkan_dispatch.h"
 #include <set>
 #include <string>
 
@@ -51,7 +52,13 @@ QueueFamilyIndices::FindQueueFamilies(VkPhysicalDevice device,
     }
 
     VkBool32 presentSupport = false;
-    vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+    if (surface) {
+      vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface,
+                                           &presentSupport);
+    } else {
+      // headless: nothing is presented, the graphics queue stands in
+      presentSupport = indices.graphicsFamily == static_cast<uint32_t>(i);
+    }
 
     if (presentSupport) {
       indices.presentFamily = i;
@@ -64,6 +71,16 @@ QueueFamilyIndices::FindQueueFamilies(VkPhysicalDevice device,
     i++;
   }
 
+  indices.transferFamily = indices.graphicsFamily;
+  for (uint32_t j = 0; j < queueFamilyCount; ++j) {
+    auto flags = queueFamilies[j].queueFlags;
+    if ((flags & VK_QUEUE_TRANSFER_BIT) &&
+        !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+      indices.transferFamily = j;
+      break;
+    }
+  }
+
   return indices;
 }
 
@@ -88,40 +105,40 @@ CheckDeviceExtensionSupport(VkPhysicalDevice device,
   return requiredExtensions.empty();
 }
 
-static bool
-IsDeviceSuitable(VkPhysicalDevice device, VkSurfaceKHR surface,
-                 const std::vector<const char *> &deviceExtensions) {
+static bool IsDeviceSuitable(VkPhysicalDevice device, VkSurfaceKHR surface) {
   auto indices = QueueFamilyIndices::FindQueueFamilies(device, surface);
-
-  bool extensionsSupported =
-      CheckDeviceExtensionSupport(device, deviceExtensions);
-
-  bool swapChainAdequate = false;
-  if (extensionsSupported) {
-    auto swapChainSupport =
-        Vulkan::SwapChainSupportDetails::QuerySwapChainSupport(device, surface);
-    swapChainAdequate = !swapChainSupport.formats.empty() &&
-                        !swapChainSupport.presentModes.empty();
+  if (!surface) {
+    return indices.isComplete();
   }
-
-  return indices.isComplete() && extensionsSupported && swapChainAdequate;
+  auto swapChainSupport =
+      Vulkan::SwapChainSupportDetails::QuerySwapChainSupport(device, surface);
+  bool swapChainAdequate = !swapChainSupport.formats.empty() &&
+                           !swapChainSupport.presentModes.empty();
+  return indices.isComplete() && swapChainAdequate;
 }
 
-VkPhysicalDevice
-PickPhysicalDevice(VkInstance instance, VkSurfaceKHR surface,
-                   const std::vector<const char *> &deviceExtensions) {
+std::vector<VkPhysicalDevice>
+EnumeratePhysicalDevices(VkInstance instance,
+                         const std::vector<const char *> &deviceExtensions) {
   uint32_t deviceCount = 0;
   vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
-  if (deviceCount == 0) {
-    // throw std::runtime_error("failed to find GPUs with Vulkan support!");
-    return VK_NULL_HANDLE;
-  }
-
   std::vector<VkPhysicalDevice> devices(deviceCount);
   vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
 
+  std::vector<VkPhysicalDevice> candidates;
   for (const auto &device : devices) {
-    if (IsDeviceSuitable(device, surface, deviceExtensions)) {
+    if (CheckDeviceExtensionSupport(device, deviceExtensions)) {
+      candidates.push_back(device);
+    }
+  }
+  return candidates;
+}
+
+VkPhysicalDevice
+PickPhysicalDevice(const std::vector<VkPhysicalDevice> &candidates,
+                   VkSurfaceKHR surface) {
+  for (const auto &device : candidates) {
+    if (IsDeviceSuitable(device, surface)) {
       return device;
     }
   }
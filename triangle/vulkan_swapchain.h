@@ -1,5 +1,9 @@
 #pragma once
+#include "vulkan_allocator.h"
+#include "vulkan_dispatch.h"
+#include "vulkan_memory.h"
 #include <algorithm>
+#include <limits>
 #include <memory>
 #include <optional>
 #include <stdexcept>
@@ -17,6 +21,8 @@ struct SwapChainSupportDetails {
 struct QueueFamilyIndices {
   std::optional<uint32_t> graphicsFamily;
   std::optional<uint32_t> presentFamily;
+  // a transfer-only family (DMA engine) if there is one, else graphics
+  std::optional<uint32_t> transferFamily;
   static QueueFamilyIndices FindQueueFamilies(VkPhysicalDevice device,
                                               VkSurfaceKHR surface);
   bool isComplete() {
@@ -24,37 +30,76 @@ struct QueueFamilyIndices {
   }
 };
 
+// devices that have every one of deviceExtensions. Needs no surface, so it
+// can run while the window is still being created
+std::vector<VkPhysicalDevice>
+EnumeratePhysicalDevices(VkInstance instance,
+                         const std::vector<const char *> &deviceExtensions);
+// the first of candidates that can present to surface; with VK_NULL_HANDLE
+// the first that can render
 VkPhysicalDevice
-PickPhysicalDevice(VkInstance instance, VkSurfaceKHR surface,
-                   const std::vector<const char *> &deviceExtensions);
+PickPhysicalDevice(const std::vector<VkPhysicalDevice> &candidates,
+                   VkSurfaceKHR surface);
 
 struct SwapChain {
   VkDevice device_;
-  VkSwapchainKHR swapChain_;
+  // VK_NULL_HANDLE for an offscreen target
+  VkSwapchainKHR swapChain_ = VK_NULL_HANDLE;
+  // signaled by AcquireNextImageIndex()
+  VkSemaphore imageAvailable_ = VK_NULL_HANDLE;
   std::vector<VkImage> swapChainImages_;
   VkFormat swapChainImageFormat_;
   VkExtent2D swapChainExtent_;
   std::vector<VkImageView> swapChainImageViews_;
-  VkRenderPass renderPass_;
+  // VK_NULL_HANDLE when rendering with VK_KHR_dynamic_rendering
+  VkRenderPass renderPass_ = VK_NULL_HANDLE;
   std::vector<VkFramebuffer> swapChainFramebuffers_;
+  // multisampled color target resolved into the swapchain image, render pass
+  // path only (the render graph owns its own)
+  VkSampleCountFlagBits samples_ = VK_SAMPLE_COUNT_1_BIT;
+  VkImage colorImage_ = VK_NULL_HANDLE;
+  VkDeviceMemory colorImageMemory_ = VK_NULL_HANDLE;
+  VkImageView colorImageView_ = VK_NULL_HANDLE;
+  // images can be copied from (frame capture)
+  bool transferSrc_ = false;
+  // images can be blitted to (dynamic resolution)
+  bool transferDst_ = false;
+  // layout the render pass leaves the images in
+  VkImageLayout finalLayout_ = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  // CreateOffscreen(): the one image is owned
+  VkDeviceMemory offscreenMemory_ = VK_NULL_HANDLE;
 
   SwapChain(VkDevice device) : device_(device) {}
 
 public:
   ~SwapChain() {
     for (auto framebuffer : swapChainFramebuffers_) {
-      vkDestroyFramebuffer(device_, framebuffer, nullptr);
+      vkDestroyFramebuffer(device_, framebuffer, AllocationCallbacks());
     }
-    vkDestroyRenderPass(device_, renderPass_, nullptr);
+    vkDestroyRenderPass(device_, renderPass_, AllocationCallbacks());
+    vkDestroyImageView(device_, colorImageView_, AllocationCallbacks());
+    vkDestroyImage(device_, colorImage_, AllocationCallbacks());
+    vkFreeMemory(device_, colorImageMemory_, AllocationCallbacks());
     for (auto imageView : swapChainImageViews_) {
-      vkDestroyImageView(device_, imageView, nullptr);
+      vkDestroyImageView(device_, imageView, AllocationCallbacks());
     }
-    vkDestroySwapchainKHR(device_, swapChain_, nullptr);
+    if (offscreenMemory_) {
+      vkDestroyImage(device_, swapChainImages_[0], AllocationCallbacks());
+      vkFreeMemory(device_, offscreenMemory_, AllocationCallbacks());
+    }
+    // offscreen: VK_KHR_swapchain may not even be enabled
+    if (swapChain_) {
+      vkDestroySwapchainKHR(device_, swapChain_, AllocationCallbacks());
+    }
+    vkDestroySemaphore(device_, imageAvailable_, AllocationCallbacks());
   }
 
   static std::shared_ptr<SwapChain>
   CreateSwapChain(VkDevice device, VkPhysicalDevice physicalDevice,
-                  VkSurfaceKHR surface, int width, int height) {
+                  VkSurfaceKHR surface, int width, int height,
+                  bool dynamicRendering,
+                  VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT,
+                  bool transferSrc = false, bool transferDst = false) {
     auto swapChainSupport =
         Vulkan::SwapChainSupportDetails::QuerySwapChainSupport(physicalDevice,
                                                                surface);
@@ -81,6 +126,18 @@ public:
     createInfo.imageExtent = extent;
     createInfo.imageArrayLayers = 1;
     createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    transferSrc = transferSrc &&
+                  (swapChainSupport.capabilities.supportedUsageFlags &
+                   VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+    if (transferSrc) {
+      createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    }
+    transferDst = transferDst &&
+                  (swapChainSupport.capabilities.supportedUsageFlags &
+                   VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+    if (transferDst) {
+      createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    }
 
     auto indices =
         Vulkan::QueueFamilyIndices::FindQueueFamilies(physicalDevice, surface);
@@ -103,12 +160,19 @@ public:
     createInfo.oldSwapchain = VK_NULL_HANDLE;
 
     auto ptr = std::shared_ptr<SwapChain>(new SwapChain(device));
-    if (vkCreateSwapchainKHR(device, &createInfo, nullptr, &ptr->swapChain_) !=
-        VK_SUCCESS) {
+    if (vkCreateSwapchainKHR(device, &createInfo, AllocationCallbacks(),
+                             &ptr->swapChain_) != VK_SUCCESS) {
       // throw std::runtime_error("failed to create swap chain!");
       return nullptr;
     }
 
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    if (vkCreateSemaphore(device, &semaphoreInfo, AllocationCallbacks(),
+                          &ptr->imageAvailable_) != VK_SUCCESS) {
+      return nullptr;
+    }
+
     vkGetSwapchainImagesKHR(device, ptr->swapChain_, &imageCount, nullptr);
     ptr->swapChainImages_.resize(imageCount);
     vkGetSwapchainImagesKHR(device, ptr->swapChain_, &imageCount,
@@ -116,11 +180,80 @@ public:
 
     ptr->swapChainImageFormat_ = surfaceFormat.format;
     ptr->swapChainExtent_ = extent;
+    ptr->transferSrc_ = transferSrc;
+    ptr->transferDst_ = transferDst;
 
     ptr->CreateImageViews();
-    ptr->CreateRenderPass();
-    ptr->CreateFramebuffers();
+    if (!dynamicRendering) {
+      ptr->samples_ = samples;
+      if (samples != VK_SAMPLE_COUNT_1_BIT) {
+        ptr->CreateColorResources(physicalDevice);
+      }
+      ptr->CreateRenderPass();
+      ptr->CreateFramebuffers();
+    }
+
+    return ptr;
+  }
 
+  // headless stand-in with a single image that is never presented and ends
+  // every frame in TRANSFER_SRC_OPTIMAL. Needs no surface and no
+  // VK_KHR_swapchain
+  static std::shared_ptr<SwapChain>
+  CreateOffscreen(VkDevice device, VkPhysicalDevice physicalDevice,
+                  VkFormat format, VkExtent2D extent, bool dynamicRendering,
+                  VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT) {
+    auto ptr = std::shared_ptr<SwapChain>(new SwapChain(device));
+    ptr->swapChainImageFormat_ = format;
+    ptr->swapChainExtent_ = extent;
+    ptr->finalLayout_ = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = format;
+    imageInfo.extent = {extent.width, extent.height, 1};
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage =
+        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkImage image;
+    if (vkCreateImage(device, &imageInfo, AllocationCallbacks(), &image) !=
+        VK_SUCCESS) {
+      // throw std::runtime_error("failed to create offscreen image!");
+      return nullptr;
+    }
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(device, image, &memRequirements);
+    auto memoryType = FindAttachmentMemoryType(
+        physicalDevice, memRequirements.memoryTypeBits, false);
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = memoryType.value_or(0);
+    if (!memoryType ||
+        vkAllocateMemory(device, &allocInfo, AllocationCallbacks(),
+                         &ptr->offscreenMemory_) != VK_SUCCESS) {
+      vkDestroyImage(device, image, AllocationCallbacks());
+      return nullptr;
+    }
+    vkBindImageMemory(device, image, ptr->offscreenMemory_, 0);
+    ptr->swapChainImages_.push_back(image);
+    ptr->transferSrc_ = true;
+
+    ptr->CreateImageViews();
+    if (!dynamicRendering) {
+      ptr->samples_ = samples;
+      if (samples != VK_SAMPLE_COUNT_1_BIT) {
+        ptr->CreateColorResources(physicalDevice);
+      }
+      ptr->CreateRenderPass();
+      ptr->CreateFramebuffers();
+    }
     return ptr;
   }
 
@@ -143,52 +276,168 @@ public:
       createInfo.subresourceRange.baseArrayLayer = 0;
       createInfo.subresourceRange.layerCount = 1;
 
-      if (vkCreateImageView(device_, &createInfo, nullptr,
+      if (vkCreateImageView(device_, &createInfo, AllocationCallbacks(),
                             &swapChainImageViews_[i]) != VK_SUCCESS) {
         throw std::runtime_error("failed to create image views!");
       }
     }
   }
 
+  // the format CreateSwapChain() picks, known before it has run
+  static VkFormat ChooseFormat(VkPhysicalDevice physicalDevice,
+                               VkSurfaceKHR surface) {
+    auto swapChainSupport =
+        Vulkan::SwapChainSupportDetails::QuerySwapChainSupport(physicalDevice,
+                                                               surface);
+    return chooseSwapSurfaceFormat(swapChainSupport.formats).format;
+  }
+
+  // highest count up to requested that color attachments support
+  static VkSampleCountFlagBits
+  ChooseSampleCount(VkPhysicalDevice physicalDevice, uint32_t requested) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    auto counts = properties.limits.framebufferColorSampleCounts;
+    for (uint32_t bit = VK_SAMPLE_COUNT_64_BIT; bit > VK_SAMPLE_COUNT_1_BIT;
+         bit >>= 1) {
+      if (bit <= requested && (counts & bit)) {
+        return static_cast<VkSampleCountFlagBits>(bit);
+      }
+    }
+    return VK_SAMPLE_COUNT_1_BIT;
+  }
+
+  void CreateColorResources(VkPhysicalDevice physicalDevice) {
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = swapChainImageFormat_;
+    imageInfo.extent = {swapChainExtent_.width, swapChainExtent_.height, 1};
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = samples_;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT |
+                      VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    if (vkCreateImage(device_, &imageInfo, AllocationCallbacks(),
+                      &colorImage_) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create multisampled color image!");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(device_, colorImage_, &memRequirements);
+    auto memoryType = FindAttachmentMemoryType(
+        physicalDevice, memRequirements.memoryTypeBits, true);
+    if (!memoryType) {
+      throw std::runtime_error("failed to find suitable memory type!");
+    }
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = *memoryType;
+    if (vkAllocateMemory(device_, &allocInfo, AllocationCallbacks(),
+                         &colorImageMemory_) != VK_SUCCESS) {
+      throw std::runtime_error("failed to allocate color image memory!");
+    }
+    vkBindImageMemory(device_, colorImage_, colorImageMemory_, 0);
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = colorImage_;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = swapChainImageFormat_;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.layerCount = 1;
+    if (vkCreateImageView(device_, &viewInfo, AllocationCallbacks(),
+                          &colorImageView_) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create image views!");
+    }
+  }
+
   void CreateRenderPass() {
+    bool msaa = samples_ != VK_SAMPLE_COUNT_1_BIT;
+
     VkAttachmentDescription colorAttachment{};
     colorAttachment.format = swapChainImageFormat_;
-    colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    colorAttachment.samples = samples_;
     colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    // the multisampled image is resolved in-subpass and never written back
+    colorAttachment.storeOp =
+        msaa ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
     colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    colorAttachment.finalLayout =
+        msaa ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : finalLayout_;
+
+    VkAttachmentDescription resolveAttachment{};
+    resolveAttachment.format = swapChainImageFormat_;
+    resolveAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    resolveAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    resolveAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    resolveAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    resolveAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    resolveAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    resolveAttachment.finalLayout = finalLayout_;
 
     VkAttachmentReference colorAttachmentRef{};
     colorAttachmentRef.attachment = 0;
     colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
+    VkAttachmentReference resolveAttachmentRef{};
+    resolveAttachmentRef.attachment = 1;
+    resolveAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
     VkSubpassDescription subpass{};
     subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
     subpass.colorAttachmentCount = 1;
     subpass.pColorAttachments = &colorAttachmentRef;
+    if (msaa) {
+      subpass.pResolveAttachments = &resolveAttachmentRef;
+    }
 
     VkSubpassDependency dependency{};
     dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
     dependency.dstSubpass = 0;
     dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.srcAccessMask = 0;
+    // the multisampled image is shared by every frame: order against the
+    // previous frame's writes to it
+    dependency.srcAccessMask = msaa ? VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT : 0;
     dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
     dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
 
+    // frame capture copies the presented image after the pass; the final
+    // layout transition has to happen before that copy
+    VkSubpassDependency captureDependency{};
+    captureDependency.srcSubpass = 0;
+    captureDependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+    captureDependency.srcStageMask =
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    captureDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    captureDependency.dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    captureDependency.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+    VkSubpassDependency dependencies[] = {dependency, captureDependency};
+
+    VkAttachmentDescription attachments[] = {colorAttachment,
+                                             resolveAttachment};
+
     VkRenderPassCreateInfo renderPassInfo{};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    renderPassInfo.attachmentCount = 1;
-    renderPassInfo.pAttachments = &colorAttachment;
+    renderPassInfo.attachmentCount = msaa ? 2 : 1;
+    renderPassInfo.pAttachments = attachments;
     renderPassInfo.subpassCount = 1;
     renderPassInfo.pSubpasses = &subpass;
-    renderPassInfo.dependencyCount = 1;
-    renderPassInfo.pDependencies = &dependency;
+    renderPassInfo.dependencyCount = transferSrc_ ? 2 : 1;
+    renderPassInfo.pDependencies = dependencies;
 
-    if (vkCreateRenderPass(device_, &renderPassInfo, nullptr, &renderPass_) !=
-        VK_SUCCESS) {
+    if (vkCreateRenderPass(device_, &renderPassInfo, AllocationCallbacks(),
+                           &renderPass_) != VK_SUCCESS) {
       throw std::runtime_error("failed to create render pass!");
     }
   }
@@ -197,29 +446,35 @@ public:
     swapChainFramebuffers_.resize(swapChainImageViews_.size());
 
     for (size_t i = 0; i < swapChainImageViews_.size(); i++) {
-      VkImageView attachments[] = {swapChainImageViews_[i]};
+      bool msaa = samples_ != VK_SAMPLE_COUNT_1_BIT;
+      VkImageView attachments[] = {
+          msaa ? colorImageView_ : swapChainImageViews_[i],
+          swapChainImageViews_[i]};
 
       VkFramebufferCreateInfo framebufferInfo{};
       framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
       framebufferInfo.renderPass = renderPass_;
-      framebufferInfo.attachmentCount = 1;
+      framebufferInfo.attachmentCount = msaa ? 2 : 1;
       framebufferInfo.pAttachments = attachments;
       framebufferInfo.width = swapChainExtent_.width;
       framebufferInfo.height = swapChainExtent_.height;
       framebufferInfo.layers = 1;
 
-      if (vkCreateFramebuffer(device_, &framebufferInfo, nullptr,
+      if (vkCreateFramebuffer(device_, &framebufferInfo, AllocationCallbacks(),
                               &swapChainFramebuffers_[i]) != VK_SUCCESS) {
         throw std::runtime_error("failed to create framebuffer!");
       }
     }
   }
 
-  uint32_t AcquireNextImageIndex(VkSemaphore imageAvailableSemaphore_) {
+  // signals imageAvailable_; always 0 offscreen, where nothing is signaled
+  uint32_t AcquireNextImageIndex() {
+    if (!swapChain_) {
+      return 0;
+    }
     uint32_t imageIndex;
-    vkAcquireNextImageKHR(device_, swapChain_, UINT64_MAX,
-                          imageAvailableSemaphore_, VK_NULL_HANDLE,
-                          &imageIndex);
+    vkAcquireNextImageKHR(device_, swapChain_, UINT64_MAX, imageAvailable_,
+                          VK_NULL_HANDLE, &imageIndex);
     return imageIndex;
   }
 
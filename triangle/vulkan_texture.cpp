@@ -0,0 +1,774 @@
+#include "vulkan_texture.h"
+#include "vulkan_allocator.h"
+#include "vulkan_device.h"
+#include "vulkan_dispatch.h"
+#include "vulkan_memory.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string.h>
+
+namespace Vulkan {
+
+// bytes per block and block size in texels
+static bool FormatBlock(VkFormat format, uint32_t *bytes, uint32_t *width,
+                        uint32_t *height) {
+  *width = 1;
+  *height = 1;
+  switch (format) {
+  case VK_FORMAT_R8_UNORM:
+  case VK_FORMAT_R8_SRGB:
+    *bytes = 1;
+    return true;
+  case VK_FORMAT_R8G8_UNORM:
+  case VK_FORMAT_R8G8_SRGB:
+    *bytes = 2;
+    return true;
+  case VK_FORMAT_R8G8B8A8_UNORM:
+  case VK_FORMAT_R8G8B8A8_SRGB:
+  case VK_FORMAT_B8G8R8A8_UNORM:
+  case VK_FORMAT_B8G8R8A8_SRGB:
+    *bytes = 4;
+    return true;
+  case VK_FORMAT_R16G16B16A16_SFLOAT:
+    *bytes = 8;
+    return true;
+  case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+  case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+  case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+  case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+  case VK_FORMAT_BC4_UNORM_BLOCK:
+    *bytes = 8;
+    *width = *height = 4;
+    return true;
+  case VK_FORMAT_BC3_UNORM_BLOCK:
+  case VK_FORMAT_BC3_SRGB_BLOCK:
+  case VK_FORMAT_BC5_UNORM_BLOCK:
+  case VK_FORMAT_BC7_UNORM_BLOCK:
+  case VK_FORMAT_BC7_SRGB_BLOCK:
+    *bytes = 16;
+    *width = *height = 4;
+    return true;
+  default:
+    return false;
+  }
+}
+
+static uint32_t LevelExtent(uint32_t extent, uint32_t level) {
+  return std::max(1u, extent >> level);
+}
+
+static void ImageBarrier(VkCommandBuffer commandBuffer, VkImage image,
+                         uint32_t baseLevel, uint32_t levelCount,
+                         VkImageLayout oldLayout, VkImageLayout newLayout,
+                         VkPipelineStageFlags srcStage,
+                         VkAccessFlags srcAccess,
+                         VkPipelineStageFlags dstStage,
+                         VkAccessFlags dstAccess) {
+  VkImageMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.srcAccessMask = srcAccess;
+  barrier.dstAccessMask = dstAccess;
+  barrier.oldLayout = oldLayout;
+  barrier.newLayout = newLayout;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = image;
+  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.baseMipLevel = baseLevel;
+  barrier.subresourceRange.levelCount = levelCount;
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.layerCount = 1;
+  vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, nullptr, 0,
+                       nullptr, 1, &barrier);
+}
+
+TextureStreamer::~TextureStreamer() {
+  auto device = device_->device_;
+  for (auto &t : textures_) {
+    DestroyImage(t.resident, false);
+    DestroyImage(t.pending, false);
+  }
+  for (auto &batch : batches_) {
+    if (batch.mapped) {
+      vkUnmapMemory(device, batch.stagingMemory);
+    }
+    vkDestroyBuffer(device, batch.staging, AllocationCallbacks());
+    vkFreeMemory(device, batch.stagingMemory, AllocationCallbacks());
+    vkDestroyCommandPool(device, batch.commandPool, AllocationCallbacks());
+    vkDestroyFence(device, batch.fence, AllocationCallbacks());
+    vkDestroySemaphore(device, batch.semaphore, AllocationCallbacks());
+  }
+  vkDestroyDescriptorPool(device, descriptorPool_, AllocationCallbacks());
+  vkDestroyDescriptorSetLayout(device, descriptorSetLayout_,
+                               AllocationCallbacks());
+  vkDestroySampler(device, sampler_, AllocationCallbacks());
+}
+
+std::shared_ptr<TextureStreamer>
+TextureStreamer::Create(const std::shared_ptr<Device> &device,
+                        VkPhysicalDevice physicalDevice,
+                        const std::shared_ptr<ResidencyManager> &residency,
+                        const Options &options) {
+  auto ptr = std::shared_ptr<TextureStreamer>(
+      new TextureStreamer(device, physicalDevice, residency, options));
+  ptr->textures_.reserve(options.maxTextures);
+
+  VkDescriptorSetLayoutBinding binding{};
+  binding.binding = 0;
+  binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  binding.descriptorCount = 1;
+  binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+  VkDescriptorSetLayoutCreateInfo layoutInfo{};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.bindingCount = 1;
+  layoutInfo.pBindings = &binding;
+  if (vkCreateDescriptorSetLayout(device->device_, &layoutInfo,
+                                  AllocationCallbacks(),
+                                  &ptr->descriptorSetLayout_) != VK_SUCCESS) {
+    return nullptr;
+  }
+
+  VkDescriptorPoolSize poolSize{};
+  poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  poolSize.descriptorCount = options.maxTextures;
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.maxSets = options.maxTextures;
+  poolInfo.poolSizeCount = 1;
+  poolInfo.pPoolSizes = &poolSize;
+  if (vkCreateDescriptorPool(device->device_, &poolInfo, AllocationCallbacks(),
+                             &ptr->descriptorPool_) != VK_SUCCESS) {
+    return nullptr;
+  }
+
+  VkSamplerCreateInfo samplerInfo{};
+  samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+  samplerInfo.magFilter = VK_FILTER_LINEAR;
+  samplerInfo.minFilter = VK_FILTER_LINEAR;
+  samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+  samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  samplerInfo.minLod = 0.0f;
+  samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+  if (vkCreateSampler(device->device_, &samplerInfo, AllocationCallbacks(),
+                      &ptr->sampler_) != VK_SUCCESS) {
+    return nullptr;
+  }
+
+  // one being filled while the previous one may still be on the GPU
+  ptr->batches_.resize(2);
+  for (auto &batch : ptr->batches_) {
+    if (!ptr->CreateBatch(&batch)) {
+      return nullptr;
+    }
+  }
+  return ptr;
+}
+
+bool TextureStreamer::CreateBatch(Batch *batch) {
+  auto device = device_->device_;
+
+  VkBufferCreateInfo bufferInfo{};
+  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.size = options_.uploadBudget;
+  bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  if (vkCreateBuffer(device, &bufferInfo, AllocationCallbacks(),
+                     &batch->staging) != VK_SUCCESS) {
+    return false;
+  }
+  VkMemoryRequirements memRequirements;
+  vkGetBufferMemoryRequirements(device, batch->staging, &memRequirements);
+  auto memoryType = FindMemoryType(physicalDevice_,
+                                   memRequirements.memoryTypeBits,
+                                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                       VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  if (!memoryType) {
+    return false;
+  }
+  VkMemoryAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocInfo.allocationSize = memRequirements.size;
+  allocInfo.memoryTypeIndex = *memoryType;
+  if (vkAllocateMemory(device, &allocInfo, AllocationCallbacks(),
+                       &batch->stagingMemory) != VK_SUCCESS) {
+    return false;
+  }
+  vkBindBufferMemory(device, batch->staging, batch->stagingMemory, 0);
+  void *mapped;
+  if (vkMapMemory(device, batch->stagingMemory, 0, VK_WHOLE_SIZE, 0,
+                  &mapped) != VK_SUCCESS) {
+    return false;
+  }
+  batch->mapped = static_cast<uint8_t *>(mapped);
+
+  VkCommandPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+  poolInfo.queueFamilyIndex = device_->transferFamily_;
+  if (vkCreateCommandPool(device, &poolInfo, AllocationCallbacks(),
+                          &batch->commandPool) != VK_SUCCESS) {
+    return false;
+  }
+  VkCommandBufferAllocateInfo commandInfo{};
+  commandInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  commandInfo.commandPool = batch->commandPool;
+  commandInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  commandInfo.commandBufferCount = 1;
+  if (vkAllocateCommandBuffers(device, &commandInfo, &batch->commandBuffer) !=
+      VK_SUCCESS) {
+    return false;
+  }
+
+  VkFenceCreateInfo fenceInfo{};
+  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+  VkSemaphoreCreateInfo semaphoreInfo{};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  return vkCreateFence(device, &fenceInfo, AllocationCallbacks(),
+                       &batch->fence) == VK_SUCCESS &&
+         vkCreateSemaphore(device, &semaphoreInfo, AllocationCallbacks(),
+                           &batch->semaphore) == VK_SUCCESS;
+}
+
+VkDeviceSize TextureStreamer::LevelSize(const Texture &t,
+                                        uint32_t level) const {
+  VkDeviceSize blocksX =
+      (LevelExtent(t.ktx.width, level) + t.block.width - 1) / t.block.width;
+  VkDeviceSize blocksY =
+      (LevelExtent(t.ktx.height, level) + t.block.height - 1) / t.block.height;
+  return blocksX * blocksY * t.block.bytes;
+}
+
+bool TextureStreamer::CreateImage(const Texture &t, uint32_t base,
+                                  Image *image) {
+  auto device = device_->device_;
+
+  VkImageCreateInfo imageInfo{};
+  imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType = VK_IMAGE_TYPE_2D;
+  imageInfo.format = t.format;
+  imageInfo.extent = {LevelExtent(t.ktx.width, base),
+                      LevelExtent(t.ktx.height, base), 1};
+  imageInfo.mipLevels = t.levelCount - base;
+  imageInfo.arrayLayers = 1;
+  imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+                    VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                    VK_IMAGE_USAGE_SAMPLED_BIT;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  // written by the transfer queue, read by graphics: no ownership transfers
+  uint32_t families[] = {device_->graphicsFamily_, device_->transferFamily_};
+  if (families[0] != families[1]) {
+    imageInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+    imageInfo.queueFamilyIndexCount = 2;
+    imageInfo.pQueueFamilyIndices = families;
+  } else {
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  }
+  if (vkCreateImage(device, &imageInfo, AllocationCallbacks(),
+                    &image->image) != VK_SUCCESS) {
+    return false;
+  }
+
+  VkMemoryRequirements memRequirements;
+  vkGetImageMemoryRequirements(device, image->image, &memRequirements);
+  auto memoryType =
+      FindMemoryType(physicalDevice_, memRequirements.memoryTypeBits,
+                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  if (!memoryType) {
+    DestroyImage(*image, false);
+    return false;
+  }
+  VkMemoryAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocInfo.allocationSize = memRequirements.size;
+  allocInfo.memoryTypeIndex = *memoryType;
+  if (vkAllocateMemory(device, &allocInfo, AllocationCallbacks(),
+                       &image->memory) != VK_SUCCESS) {
+    DestroyImage(*image, false);
+    return false;
+  }
+  vkBindImageMemory(device, image->image, image->memory, 0);
+
+  VkImageViewCreateInfo viewInfo{};
+  viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  viewInfo.image = image->image;
+  viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  viewInfo.format = t.format;
+  viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  viewInfo.subresourceRange.levelCount = imageInfo.mipLevels;
+  viewInfo.subresourceRange.layerCount = 1;
+  if (vkCreateImageView(device, &viewInfo, AllocationCallbacks(),
+                        &image->view) != VK_SUCCESS) {
+    DestroyImage(*image, false);
+    return false;
+  }
+
+  image->base = base;
+  image->bytes = memRequirements.size;
+  image->memoryType = *memoryType;
+  return true;
+}
+
+void TextureStreamer::DestroyImage(Image &image, bool deferred) {
+  if (deferred) {
+    auto &queue = device_->deletionQueue_;
+    queue->Destroy(image.view);
+    queue->Destroy(image.image);
+    queue->Destroy(image.memory);
+  } else {
+    auto device = device_->device_;
+    vkDestroyImageView(device, image.view, AllocationCallbacks());
+    vkDestroyImage(device, image.image, AllocationCallbacks());
+    vkFreeMemory(device, image.memory, AllocationCallbacks());
+  }
+  image = {};
+}
+
+TextureStreamer::Handle TextureStreamer::Load(const std::string &path,
+                                              std::string *error,
+                                              uint32_t priority) {
+  if (textures_.size() >= options_.maxTextures) {
+    *error = "too many textures";
+    return NONE;
+  }
+
+  Texture t;
+  t.priority = priority;
+  t.file = MappedFile::Open(path);
+  if (!t.file) {
+    *error = "can not open " + path;
+    return NONE;
+  }
+  if (!Ktx2::Parse(t.file->Data(), t.file->Size(), &t.ktx, error)) {
+    return NONE;
+  }
+  t.format = static_cast<VkFormat>(t.ktx.vkFormat);
+  if (!FormatBlock(t.format, &t.block.bytes, &t.block.width,
+                   &t.block.height)) {
+    *error = "unsupported format";
+    return NONE;
+  }
+  t.levelCount = static_cast<uint32_t>(t.ktx.levels.size());
+  for (uint32_t level = 0; level < t.levelCount; ++level) {
+    // rows are uploaded as they are laid out in the file
+    if (t.ktx.levels[level].size != LevelSize(t, level)) {
+      *error = "unexpected level size";
+      return NONE;
+    }
+  }
+  // a chunk is at least one block row; the widest level's must fit the
+  // staging buffer or the upload would never move forward
+  VkDeviceSize rowBytes =
+      static_cast<VkDeviceSize>((t.ktx.width + t.block.width - 1) /
+                                t.block.width) *
+      t.block.bytes;
+  if (rowBytes > options_.uploadBudget) {
+    *error = "a block row of level 0 exceeds the upload budget";
+    return NONE;
+  }
+
+  if (t.ktx.generateMips) {
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice_, t.format,
+                                        &properties);
+    VkFormatFeatureFlags required =
+        VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+        VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    if (t.block.width == 1 &&
+        (properties.optimalTilingFeatures & required) == required) {
+      t.generateMips = true;
+      auto largest = std::max(t.ktx.width, t.ktx.height);
+      t.levelCount = 1;
+      while (largest >> t.levelCount) {
+        ++t.levelCount;
+      }
+    }
+  }
+
+  // mip tail: the coarse levels that together fit into tailSize
+  t.tail = t.levelCount - 1;
+  if (!t.generateMips) {
+    auto bytes = LevelSize(t, t.tail);
+    while (t.tail > 0 &&
+           bytes + LevelSize(t, t.tail - 1) <= options_.tailSize) {
+      --t.tail;
+      bytes += LevelSize(t, t.tail);
+    }
+  } else {
+    // only level 0 is in the file
+    t.tail = 0;
+  }
+
+  VkDescriptorSetAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool = descriptorPool_;
+  allocInfo.descriptorSetCount = 1;
+  allocInfo.pSetLayouts = &descriptorSetLayout_;
+  if (vkAllocateDescriptorSets(device_->device_, &allocInfo,
+                               &t.descriptorSet) != VK_SUCCESS) {
+    *error = "failed to allocate descriptor set";
+    return NONE;
+  }
+
+  textures_.push_back(std::move(t));
+  return static_cast<Handle>(textures_.size() - 1);
+}
+
+void TextureStreamer::Request(Handle handle, uint32_t level) {
+  auto &t = textures_[handle];
+  t.wanted = std::min(level, t.levelCount - 1);
+}
+
+uint32_t TextureStreamer::ResidentLevel(Handle handle) const {
+  auto &t = textures_[handle];
+  return t.resident.image ? t.resident.base : t.levelCount;
+}
+
+bool TextureStreamer::Busy() const {
+  for (auto &t : textures_) {
+    if (t.pending.image || !t.resident.image) {
+      return true;
+    }
+    // same test as Update()
+    if (!t.generateMips && t.wanted < t.resident.base &&
+        residency_->HasHeadroom(t.resident.memoryType,
+                                t.resident.bytes * 4)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool TextureStreamer::BeginPending(Texture &t, uint32_t base,
+                                   VkCommandBuffer transfer) {
+  if (!CreateImage(t, base, &t.pending)) {
+    return false;
+  }
+  ImageBarrier(transfer, t.pending.image, 0, VK_REMAINING_MIP_LEVELS,
+               VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+               VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0,
+               VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+  t.uploadEnd = t.resident.image ? t.resident.base
+                                 : static_cast<uint32_t>(t.ktx.levels.size());
+  t.uploadLevel = t.uploadEnd - 1;
+  t.uploaded = 0;
+  t.ready = false;
+  return true;
+}
+
+// copy whole block rows of the current level(s) into staging, coarse levels
+// first; returns the staging bytes used
+VkDeviceSize TextureStreamer::Upload(Texture &t, Batch &batch,
+                                     VkDeviceSize offset,
+                                     VkDeviceSize budget) {
+  VkDeviceSize used = 0;
+  while (!t.ready) {
+    auto level = t.uploadLevel;
+    auto width = LevelExtent(t.ktx.width, level);
+    auto height = LevelExtent(t.ktx.height, level);
+    uint32_t blocksX = (width + t.block.width - 1) / t.block.width;
+    uint32_t blocksY = (height + t.block.height - 1) / t.block.height;
+    VkDeviceSize rowBytes = static_cast<VkDeviceSize>(blocksX) * t.block.bytes;
+
+    // copy offsets must be a multiple of the block size and of 4
+    auto aligned = (offset + used + 15) & ~VkDeviceSize(15);
+    if (aligned >= budget) {
+      break;
+    }
+    uint32_t rowsDone = static_cast<uint32_t>(t.uploaded / rowBytes);
+    uint32_t rows = static_cast<uint32_t>(std::min<VkDeviceSize>(
+        blocksY - rowsDone, (budget - aligned) / rowBytes));
+    if (rows == 0) {
+      break;
+    }
+
+    auto bytes = rows * rowBytes;
+    memcpy(batch.mapped + aligned, t.ktx.levels[level].data + t.uploaded,
+           bytes);
+
+    VkBufferImageCopy region{};
+    region.bufferOffset = aligned;
+    region.bufferRowLength = 0;
+    region.bufferImageHeight = 0;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = level - t.pending.base;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset = {0, static_cast<int32_t>(rowsDone * t.block.height),
+                          0};
+    region.imageExtent = {
+        width,
+        std::min(rows * t.block.height, height - rowsDone * t.block.height),
+        1};
+    vkCmdCopyBufferToImage(batch.commandBuffer, batch.staging, t.pending.image,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+    used = aligned + bytes - offset;
+    t.uploaded += bytes;
+    if (rowsDone + rows == blocksY) {
+      if (level == t.pending.base) {
+        t.ready = true;
+      } else {
+        --t.uploadLevel;
+        t.uploaded = 0;
+      }
+    }
+  }
+  return used;
+}
+
+void TextureStreamer::Update() {
+  Batch *batch = nullptr;
+  for (auto &b : batches_) {
+    if (vkGetFenceStatus(device_->device_, b.fence) == VK_SUCCESS) {
+      batch = &b;
+      break;
+    }
+  }
+  if (!batch) {
+    // the transfer queue is behind, try again next frame
+    return;
+  }
+
+  // next level each texture needs, coarsest first across all textures
+  struct Candidate {
+    Handle handle;
+    uint32_t level;
+  };
+  std::vector<Candidate> candidates;
+  for (Handle h = 0; h < textures_.size(); ++h) {
+    auto &t = textures_[h];
+    if (t.pending.image) {
+      if (!t.ready) {
+        candidates.push_back({h, t.pending.base});
+      }
+    } else if (!t.resident.image) {
+      candidates.push_back({h, t.tail});
+    } else if (!t.generateMips && t.wanted < t.resident.base &&
+               residency_->HasHeadroom(t.resident.memoryType,
+                                       t.resident.bytes * 4)) {
+      // a level is about 3/4 of the whole chain below it
+      candidates.push_back({h, t.resident.base - 1});
+    }
+  }
+  if (candidates.empty()) {
+    return;
+  }
+  std::sort(candidates.begin(), candidates.end(),
+            [this](const Candidate &a, const Candidate &b) {
+              if (a.level != b.level) {
+                return a.level > b.level;
+              }
+              return textures_[a.handle].priority >
+                     textures_[b.handle].priority;
+            });
+
+  vkResetCommandPool(device_->device_, batch->commandPool, 0);
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  if (vkBeginCommandBuffer(batch->commandBuffer, &beginInfo) != VK_SUCCESS) {
+    throw std::runtime_error("failed to begin recording command buffer!");
+  }
+
+  bool recorded = false;
+  VkDeviceSize offset = 0;
+  for (auto &c : candidates) {
+    auto &t = textures_[c.handle];
+    if (!t.pending.image) {
+      if (!BeginPending(t, c.level, batch->commandBuffer)) {
+        continue;
+      }
+      recorded = true;
+    }
+    auto used = Upload(t, *batch, offset, options_.uploadBudget);
+    recorded = recorded || used > 0;
+    offset += used;
+    if (offset >= options_.uploadBudget) {
+      break;
+    }
+  }
+
+  if (vkEndCommandBuffer(batch->commandBuffer) != VK_SUCCESS) {
+    throw std::runtime_error("failed to record command buffer!");
+  }
+  if (!recorded) {
+    return;
+  }
+
+  VkSubmitInfo submitInfo{};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &batch->commandBuffer;
+  submitInfo.signalSemaphoreCount = 1;
+  submitInfo.pSignalSemaphores = &batch->semaphore;
+  vkResetFences(device_->device_, 1, &batch->fence);
+  if (vkQueueSubmit(device_->transferQueue_, 1, &submitInfo, batch->fence) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("failed to submit upload command buffer!");
+  }
+  // the copies and the layout transitions of Record() happen on the graphics
+  // queue in this frame
+  device_->AddWait(batch->semaphore, VK_PIPELINE_STAGE_TRANSFER_BIT);
+}
+
+void TextureStreamer::Record(VkCommandBuffer commandBuffer) {
+  for (Handle h = 0; h < textures_.size(); ++h) {
+    if (textures_[h].ready) {
+      Finalize(commandBuffer, h);
+    }
+  }
+}
+
+void TextureStreamer::Finalize(VkCommandBuffer commandBuffer, Handle handle) {
+  auto &t = textures_[handle];
+  auto &pending = t.pending;
+  auto levels = t.levelCount - pending.base;
+
+  if (t.pendingOnGraphics) {
+    ImageBarrier(commandBuffer, pending.image, 0, levels,
+                 VK_IMAGE_LAYOUT_UNDEFINED,
+                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                 VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0,
+                 VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+  }
+
+  if (t.resident.image) {
+    // coarser levels move over from the old image
+    auto &old = t.resident;
+    ImageBarrier(commandBuffer, old.image, 0, t.levelCount - old.base,
+                 VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                 VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+                 VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+    std::vector<VkImageCopy> regions;
+    for (uint32_t level = std::max(t.uploadEnd, old.base);
+         level < t.levelCount; ++level) {
+      VkImageCopy region{};
+      region.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level - old.base, 0,
+                               1};
+      region.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT,
+                               level - pending.base, 0, 1};
+      region.extent = {LevelExtent(t.ktx.width, level),
+                       LevelExtent(t.ktx.height, level), 1};
+      regions.push_back(region);
+    }
+    vkCmdCopyImage(commandBuffer, old.image,
+                   VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, pending.image,
+                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                   static_cast<uint32_t>(regions.size()), regions.data());
+    // still read by this frame's copy
+    DestroyImage(old, true);
+  }
+
+  if (t.generateMips) {
+    for (uint32_t level = 1; level < levels; ++level) {
+      ImageBarrier(commandBuffer, pending.image, level - 1, 1,
+                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                   VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                   VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                   VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+      VkImageBlit blit{};
+      blit.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 0, 1};
+      blit.srcOffsets[1] = {
+          static_cast<int32_t>(LevelExtent(t.ktx.width, level - 1)),
+          static_cast<int32_t>(LevelExtent(t.ktx.height, level - 1)), 1};
+      blit.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1};
+      blit.dstOffsets[1] = {
+          static_cast<int32_t>(LevelExtent(t.ktx.width, level)),
+          static_cast<int32_t>(LevelExtent(t.ktx.height, level)), 1};
+      vkCmdBlitImage(commandBuffer, pending.image,
+                     VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, pending.image,
+                     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit,
+                     VK_FILTER_LINEAR);
+    }
+    if (levels > 1) {
+      ImageBarrier(commandBuffer, pending.image, 0, levels - 1,
+                   VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                   VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                   VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                   VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                   VK_ACCESS_SHADER_READ_BIT);
+    }
+    ImageBarrier(commandBuffer, pending.image, levels - 1, 1,
+                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                 VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                 VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                 VK_ACCESS_SHADER_READ_BIT);
+  } else {
+    ImageBarrier(commandBuffer, pending.image, 0, levels,
+                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                 VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                 VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                 VK_ACCESS_SHADER_READ_BIT);
+  }
+
+  t.resident = pending;
+  pending = {};
+  t.ready = false;
+  t.pendingOnGraphics = false;
+
+  // nothing in flight uses the set: the previous frame has completed
+  VkDescriptorImageInfo imageInfo{};
+  imageInfo.sampler = sampler_;
+  imageInfo.imageView = t.resident.view;
+  imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  VkWriteDescriptorSet write{};
+  write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write.dstSet = t.descriptorSet;
+  write.dstBinding = 0;
+  write.descriptorCount = 1;
+  write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  write.pImageInfo = &imageInfo;
+  vkUpdateDescriptorSets(device_->device_, 1, &write, 0, nullptr);
+
+  if (t.registered) {
+    residency_->Resize(t.residency, t.resident.bytes);
+  } else {
+    t.residency = residency_->Register(
+        t.resident.memoryType, t.resident.bytes, t.priority,
+        [this, handle] { return Evict(handle); });
+    t.registered = true;
+  }
+}
+
+// drop the finest resident level; the smaller image is filled from the
+// current one by the next Record()
+VkDeviceSize TextureStreamer::Evict(Handle handle) {
+  auto &t = textures_[handle];
+  if (t.pending.image || !t.resident.image || t.resident.base >= t.tail ||
+      t.resident.base + 1 >= t.levelCount) {
+    return 0;
+  }
+  if (!CreateImage(t, t.resident.base + 1, &t.pending)) {
+    return 0;
+  }
+  t.pendingOnGraphics = true;
+  t.uploadEnd = t.pending.base;
+  t.ready = true;
+  return t.resident.bytes > t.pending.bytes
+             ? t.resident.bytes - t.pending.bytes
+             : 0;
+}
+
+bool TextureStreamer::Bind(VkCommandBuffer commandBuffer,
+                           VkPipelineLayout layout, Handle handle) {
+  auto &t = textures_[handle];
+  if (!t.resident.image) {
+    return false;
+  }
+  if (t.registered) {
+    residency_->Touch(t.residency);
+  }
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                          layout, 0, 1, &t.descriptorSet, 0, nullptr);
+  return true;
+}
+
+} // namespace Vulkan
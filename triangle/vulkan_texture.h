@@ -0,0 +1,159 @@
+#pragma once
+#include "ktx2.h"
+#include "mapped_file.h"
+#include "vulkan_residency.h"
+#include <memory>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace Vulkan {
+
+struct Device;
+
+//
+// Progressive KTX2 texture streaming.
+//
+// Files are memory mapped and never read as a whole. Each texture owns an
+// image holding only its resident mip levels [base, levelCount): the mip
+// tail is uploaded first, then one finer level at a time as long as the
+// memory budget has room. Uploads run on the transfer queue out of a small
+// ring of staging buffers, limited to a byte budget per frame; a level larger
+// than the budget is split into row chunks over several frames. A finer level
+// goes into a new, larger image; once its upload is complete the graphics
+// queue copies the coarser levels over and the texture switches to it.
+// Files without a mip chain get theirs generated with vkCmdBlitImage.
+//
+// Per frame: Update() after the frame fence, Record() at the start of the
+// frame's command buffer, Bind() when drawing.
+//
+class TextureStreamer {
+public:
+  using Handle = uint32_t;
+  static constexpr Handle NONE = ~0u;
+
+  struct Options {
+    // staging bytes per frame
+    VkDeviceSize uploadBudget = 4 * 1024 * 1024;
+    // coarse levels that fit into this are uploaded together
+    VkDeviceSize tailSize = 64 * 1024;
+    uint32_t maxTextures = 64;
+  };
+
+private:
+  struct Block {
+    uint32_t bytes;
+    uint32_t width;
+    uint32_t height;
+  };
+
+  struct Image {
+    VkImage image = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+    // finest level of the full chain this image holds
+    uint32_t base = 0;
+    VkDeviceSize bytes = 0;
+    uint32_t memoryType = 0;
+  };
+
+  struct Texture {
+    std::shared_ptr<MappedFile> file;
+    Ktx2 ktx;
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    Block block{};
+    // full chain, generated levels included
+    uint32_t levelCount = 0;
+    bool generateMips = false;
+    uint32_t priority = 0;
+    // finest level asked for
+    uint32_t wanted = 0;
+    // coarsest levels, uploaded first and never evicted
+    uint32_t tail = 0;
+
+    Image resident;
+    // being filled; replaces resident once complete
+    Image pending;
+    // pending.image was created on the graphics queue (downgrade), it still
+    // needs its initial layout transition
+    bool pendingOnGraphics = false;
+    // pending levels [pending.base, uploadEnd) come from the file, the rest
+    // from the resident image
+    uint32_t uploadEnd = 0;
+    // level being uploaded (coarse to fine) and its bytes done
+    uint32_t uploadLevel = 0;
+    size_t uploaded = 0;
+    bool ready = false;
+
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    ResidencyManager::Handle residency = 0;
+    bool registered = false;
+  };
+
+  struct Batch {
+    VkBuffer staging = VK_NULL_HANDLE;
+    VkDeviceMemory stagingMemory = VK_NULL_HANDLE;
+    uint8_t *mapped = nullptr;
+    VkCommandPool commandPool = VK_NULL_HANDLE;
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE;
+    // waited on by the graphics submit of the same frame
+    VkSemaphore semaphore = VK_NULL_HANDLE;
+  };
+
+  std::shared_ptr<Device> device_;
+  VkPhysicalDevice physicalDevice_;
+  std::shared_ptr<ResidencyManager> residency_;
+  Options options_;
+  std::vector<Batch> batches_;
+  std::vector<Texture> textures_;
+  VkSampler sampler_ = VK_NULL_HANDLE;
+  VkDescriptorPool descriptorPool_ = VK_NULL_HANDLE;
+
+  TextureStreamer(const std::shared_ptr<Device> &device,
+                  VkPhysicalDevice physicalDevice,
+                  const std::shared_ptr<ResidencyManager> &residency,
+                  const Options &options)
+      : device_(device), physicalDevice_(physicalDevice),
+        residency_(residency), options_(options) {}
+  bool CreateBatch(Batch *batch);
+  bool CreateImage(const Texture &t, uint32_t base, Image *image);
+  void DestroyImage(Image &image, bool deferred);
+  VkDeviceSize LevelSize(const Texture &t, uint32_t level) const;
+  bool BeginPending(Texture &t, uint32_t base, VkCommandBuffer transfer);
+  VkDeviceSize Upload(Texture &t, Batch &batch, VkDeviceSize offset,
+                      VkDeviceSize budget);
+  void Finalize(VkCommandBuffer commandBuffer, Handle handle);
+  VkDeviceSize Evict(Handle handle);
+
+public:
+  VkDescriptorSetLayout descriptorSetLayout_ = VK_NULL_HANDLE;
+
+  ~TextureStreamer();
+  static std::shared_ptr<TextureStreamer>
+  Create(const std::shared_ptr<Device> &device,
+         VkPhysicalDevice physicalDevice,
+         const std::shared_ptr<ResidencyManager> &residency,
+         const Options &options);
+
+  // NONE on failure
+  Handle Load(const std::string &path, std::string *error,
+              uint32_t priority = 0);
+  // stream up to this level (0: full resolution)
+  void Request(Handle handle, uint32_t level);
+  // finest resident level, levelCount while nothing is resident
+  uint32_t ResidentLevel(Handle handle) const;
+  // uploads are in flight or still to be made; false once every texture
+  // is as fine as the budget allows
+  bool Busy() const;
+
+  // after the frame fence: record and submit this frame's uploads
+  void Update();
+  // graphics side of completed uploads, outside any render pass
+  void Record(VkCommandBuffer commandBuffer);
+  // bind the texture as set 0; false while nothing is resident
+  bool Bind(VkCommandBuffer commandBuffer, VkPipelineLayout layout,
+            Handle handle);
+};
+
+} // namespace Vulkan